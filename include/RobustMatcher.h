@@ -11,6 +11,7 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/features2d/features2d.hpp>
 #include <opencv2/cudafeatures2d.hpp>
+#include "kdforestindex.h"
 
 
 class RobustMatcher
@@ -18,6 +19,10 @@ class RobustMatcher
     
 public:
     enum class Feature { orb, hahog, sift, surf };
+    // bruteForce runs cv::BFMatcher kNN in both directions, simd runs the single pass kernel in simdmatcher.h
+    // and kdForest searches approximate neighbours in a kd-forest per image (float descriptors only, binary
+    // descriptors use the simd kernel)
+    enum class MatchingMode { bruteForce, simd, kdForest };
 
 #if 0
     RobustMatcher(
@@ -61,6 +66,16 @@ public:
     // Compute the descriptors and keypoint for an image
     void detectAndCompute(const cv::Mat &image, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors);
 
+    // Choose how descriptors are matched by robustMatch
+    void setMatchingMode(MatchingMode mode) { matchingMode_ = mode; }
+
+    MatchingMode getMatchingMode() const { return matchingMode_; }
+
+    // Maximum number of comparisons per kd-forest query, 0 searches exhaustively
+    void setMaxComparisons(int maxComparisons) { maxComparisons_ = maxComparisons; }
+
+    int getMaxComparisons() const { return maxComparisons_; }
+
     // Set ratio parameter for the ratio test
     void setRatio(float rat) { ratio_ = rat; }
 
@@ -82,6 +97,14 @@ public:
     //Match feature point using  ratio and symmetry test
     void robustMatch(const cv::Mat descriptors1, const cv::Mat descriptors2, std::vector<cv::DMatch> &matches);
 
+    // Ratio and symmetry test matching of CV_8U (Hamming) or CV_32F (L2) descriptors in a single pass.
+    // Appends to matches like the BFMatcher path.
+    bool simdRobustMatch(const cv::Mat &descriptors1, const cv::Mat &descriptors2, std::vector<cv::DMatch> &matches) const;
+
+    // Ratio and symmetry test matching with prebuilt kd-forests of the query and train descriptors.
+    // Appends to matches like the BFMatcher path.
+    void forestRobustMatch(const KdForestIndex &index1, const KdForestIndex &index2, std::vector<cv::DMatch> &matches) const;
+
     // Match feature points using ratio test
     void fastRobustMatch(const cv::Mat queryImg, std::vector<cv::DMatch> &good_matches,
         std::vector<cv::KeyPoint> &queryKeypoints,
@@ -105,4 +128,6 @@ private:
     // max ratio between 1st and 2nd NN
     float ratio_;
     bool cudaEnabled_ = false;
+    MatchingMode matchingMode_ = MatchingMode::bruteForce;
+    int maxComparisons_ = KdForestIndex::DEFAULT_MAX_COMPARISONS;
 };
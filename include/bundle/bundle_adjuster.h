@@ -6,6 +6,7 @@
 #include <map>
 #include <vector>
 #include <string>
+#include <utility>
 
 #include "ceres/ceres.h"
 
@@ -381,6 +382,57 @@ struct BAPointPositionWorld {
   PositionConstraintType type;
 };
 
+// Size of a bundle problem as the linear solver sees it: the shots and points that are
+// optimized, the reprojection observations and the edges of the camera-camera visibility
+// graph, i.e. the shot pairs that see a common point. The pairs are only counted when
+// NeedsVisibilityDensity says the solver choice depends on them, -1 otherwise.
+struct BAProblemStatistics {
+  int num_shots;
+  int num_points;
+  long long num_observations;
+  long long num_covisible_pairs;
+
+  // An uncounted visibility graph is taken as dense
+  double VisibilityDensity() const {
+    if (num_covisible_pairs < 0 || num_shots <= 1) {
+      return 1.0;
+    }
+    return 2.0 * num_covisible_pairs / (double(num_shots) * (num_shots - 1));
+  }
+};
+
+struct BASolverChoice {
+  ceres::LinearSolverType linear_solver_type;
+  ceres::PreconditionerType preconditioner_type;
+  int num_threads;
+};
+
+// Sparse linear algebra libraries of the Ceres build
+struct BALinearAlgebra {
+  bool sparse;        // SuiteSparse or Eigen, for SPARSE_SCHUR and SPARSE_NORMAL_CHOLESKY
+  bool suite_sparse;  // for the visibility based preconditioners
+};
+BALinearAlgebra AvailableLinearAlgebra();
+
+// Picks the linear solver, the preconditioner and the thread count for a problem, using
+// at most max_threads threads and the libraries of the Ceres build
+BASolverChoice ChooseSolver(const BAProblemStatistics &statistics, int max_threads);
+BASolverChoice ChooseSolver(const BAProblemStatistics &statistics, int max_threads,
+                            const BALinearAlgebra &available);
+// True when ChooseSolver looks at the visibility density of a problem of this size.
+// Counting the covisible pairs walks every observation of the covisible shots, so it is
+// skipped for the problems that never need it.
+bool NeedsVisibilityDensity(int num_shots, int num_points);
+bool NeedsVisibilityDensity(int num_shots, int num_points,
+                            const BALinearAlgebra &available);
+// Number of distinct shot pairs seeing a common point, from (point, shot) observation
+// pairs with shot ids from 0. The pairs are sorted in place, the shot pairs themselves
+// are never stored.
+long long CountCovisiblePairs(std::vector<std::pair<int, int> > *point_shots);
+// One line description of a choice for the logs
+std::string SolverChoiceReport(const BAProblemStatistics &statistics,
+                               const BASolverChoice &choice);
+
 class BundleAdjuster {
  public:
   BundleAdjuster();
@@ -525,12 +577,47 @@ class BundleAdjuster {
                            const Eigen::Vector3d& bearing,
                            double std_deviation);
 
+  // Dense integer API
+  //
+  // Cameras, shots and points are numbered from 0 in the order they are added and their
+  // parameters live in contiguous arrays, so adding an observation is a few appends instead
+  // of string map lookups. Reprojection errors go to a flat buffer indexed by observation.
+  // Only perspective cameras are supported. The indexed problem is solved by Run() together
+  // with the string keyed one, but the two do not share any variable.
+  void ReserveIndexed(int num_shots, int num_points, int num_observations);
+  int AddIndexedPerspectiveCamera(
+      double focal,
+      double k1,
+      double k2,
+      double focal_prior,
+      double k1_prior,
+      double k2_prior,
+      bool constant);
+  int AddIndexedShot(
+      int camera,
+      const Eigen::Vector3d& rotation,
+      const Eigen::Vector3d& translation,
+      bool constant);
+  int AddIndexedPoint(const Eigen::Vector3d& position, bool constant);
+  int AddIndexedPointProjectionObservation(
+      int shot,
+      int point,
+      double x,
+      double y,
+      double std_deviation);
+  void AddIndexedPositionPrior(
+      int shot,
+      const Eigen::Vector3d& position,
+      double std_deviation);
+
   // minimization setup
   void SetPointProjectionLossFunction(std::string name, double threshold);
   void SetRelativeMotionLossFunction(std::string name, double threshold);
 
   void SetMaxNumIterations(int miter);
   void SetNumThreads(int n);
+  // "AUTO" picks the solver, the preconditioner and the thread count with ChooseSolver
+  // when Run() is called, the number of threads set above is then an upper bound
   void SetLinearSolverType(std::string t);
 
   void SetInternalParametersPriorSD(
@@ -552,8 +639,13 @@ class BundleAdjuster {
       const BAPointProjectionObservation &observation,
       ceres::LossFunction *loss,
       ceres::Problem *problem);
+  void AddIndexedObservationResidualBlock(
+      int observation,
+      ceres::LossFunction *loss,
+      ceres::Problem *problem);
   void ComputeCovariances(ceres::Problem *problem);
   void ComputeReprojectionErrors();
+  BAProblemStatistics ComputeProblemStatistics() const;
 
   // getters
   BAPerspectiveCamera GetPerspectiveCamera(const std::string &id);
@@ -564,6 +656,18 @@ class BundleAdjuster {
   BAReconstruction GetReconstruction(const std::string &id);
   BAPoint GetPoint(const std::string &id);
 
+  // indexed getters
+  int NumIndexedShots() const { return indexed_shot_camera_.size(); }
+  int NumIndexedPoints() const { return indexed_point_constant_.size(); }
+  int NumIndexedObservations() const { return indexed_observation_shot_.size(); }
+  BAPerspectiveCamera GetIndexedPerspectiveCamera(int camera) const;
+  Eigen::Vector3d GetIndexedShotRotation(int shot) const;
+  Eigen::Vector3d GetIndexedShotTranslation(int shot) const;
+  Eigen::Vector3d GetIndexedPoint(int point) const;
+  int GetIndexedObservationShot(int observation) const { return indexed_observation_shot_[observation]; }
+  int GetIndexedObservationPoint(int observation) const { return indexed_observation_point_[observation]; }
+  Eigen::Vector2d GetIndexedReprojectionError(int observation) const;
+
   // minimization details
   std::string BriefReport();
   std::string FullReport();
@@ -575,6 +679,28 @@ class BundleAdjuster {
   std::map<std::string, BAReconstruction> reconstructions_;
   std::map<std::string, BAPoint> points_;
   
+  // indexed variables, BA_CAMERA_NUM_PARAMS values per camera, BA_SHOT_NUM_PARAMS per shot
+  // and 3 per point
+  std::vector<double> indexed_camera_parameters_;
+  std::vector<double> indexed_camera_priors_;
+  std::vector<bool> indexed_camera_constant_;
+  std::vector<double> indexed_shot_parameters_;
+  std::vector<int> indexed_shot_camera_;
+  std::vector<bool> indexed_shot_constant_;
+  std::vector<double> indexed_point_parameters_;
+  std::vector<bool> indexed_point_constant_;
+
+  // indexed observations, 2 coordinates and 2 reprojection errors per observation
+  std::vector<int> indexed_observation_shot_;
+  std::vector<int> indexed_observation_point_;
+  std::vector<double> indexed_observation_coordinates_;
+  std::vector<double> indexed_observation_std_deviation_;
+  std::vector<double> indexed_reprojection_errors_;
+
+  // indexed position priors, x, y, z and the standard deviation per prior
+  std::vector<int> indexed_position_prior_shot_;
+  std::vector<double> indexed_position_priors_;
+
   // minimization constraints
 
   // reprojection observation
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "reconstruction.h"
+#include "trackstore.h"
+#include "bundle/bundle_adjuster.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Bundle adjustment problem that lives as long as the reconstruction it adjusts.
+ *
+ * The parameter blocks are the rotation and translation of every Pose and the position of every
+ * CloudPoint of the reconstruction, so the solver works on the reconstruction in place and nothing
+ * is copied in or out apart from the three camera parameters. The cached rotation matrices and
+ * origins of the poses are refreshed after every solve. sync() brings the problem up to date
+ * with the reconstruction: shots and points added since the last run get their blocks and residuals,
+ * points that were erased and observations that were removed from the track store are dropped. The
+ * rest of the problem is kept from run to run instead of being rebuilt.
+ *
+ * The reconstruction must not be copied or moved while a session refers to it.
+ */
+class BundleSession {
+private:
+    Reconstruction& rec_;
+    const TrackStore& tracks_;
+    bool useGps_;
+    ceres::Problem problem_;
+    std::unique_ptr<ceres::LossFunction> loss_;
+    double camera_[BA_CAMERA_NUM_PARAMS];
+    std::vector<Pose*> poses_;
+    size_t numShots_;
+    std::unordered_map<int, double*> points_;
+    std::unordered_map<uint32_t, ceres::ResidualBlockId> observations_;
+    int maxIterations_;
+    int numThreads_;
+    std::string linearSolverType_;
+    ceres::Solver::Summary summary_;
+
+    void _addShot(int image, Shot& shot);
+    void _addPoint(int track, CloudPoint& cloudPoint);
+    void _addObservation(uint32_t observation, double* point);
+    void _removePoint(int track, double* point);
+    BAProblemStatistics _computeProblemStatistics() const;
+    void _computeReprojectionErrors();
+
+public:
+    // The camera is kept near its initial focal and distortion with the given standard deviations
+    BundleSession(Reconstruction& rec, const TrackStore& tracks, bool useGps, bool fixCamera,
+        double focalSD = 0.01, double k1SD = 0.01, double k2SD = 0.01);
+    BundleSession(const BundleSession&) = delete;
+    BundleSession& operator=(const BundleSession&) = delete;
+    // Adds what is new in the reconstruction and drops what was removed since the last call
+    void sync();
+    // Syncs, solves and stores the camera and the reprojection errors of the points in the reconstruction
+    void run();
+    void setMaxIterations(int maxIterations) { maxIterations_ = maxIterations; }
+    // With the "AUTO" solver type this is the most threads the solver may use
+    void setNumThreads(int numThreads) { numThreads_ = numThreads; }
+    // A ceres linear solver name, or "AUTO" to choose it from the size of the problem on every run
+    void setLinearSolverType(const std::string& linearSolverType) { linearSolverType_ = linearSolverType; }
+    Reconstruction& getReconstruction() { return rec_; }
+    bool usesGps() const { return useGps_; }
+    size_t numShots() const { return numShots_; }
+    size_t numPoints() const { return points_.size(); }
+    size_t numObservations() const { return observations_.size(); }
+    const ceres::Solver::Summary& getSummary() const { return summary_; }
+};
@@ -2,28 +2,44 @@
 #define CAMERA_HPP_
 
 #include <opencv2/opencv.hpp>
+#include <Eigen/Core>
 #include <opengv/types.hpp>
 #include <ostream>
 #include "types.h"
+#include "cameramodels.h"
 
+/*
+ * Rotation vector and translation of a shot, with the rotation matrix and the camera center cached
+ * whenever they are set. Code that writes through rotationData or translationData calls
+ * updateCache once it is done.
+ */
 class Pose {
   private:
     ShoColumnVector3d translation_;
     ShoColumnVector3d rotation_; //Rotation is stored in short format as a vec 3d (3 channel Mat)
+    cv::Matx33d rotationMatrix_;
+    ShoColumnVector3d origin_;
 
   public:
-    Pose() : rotation_({ 0,0,0 }), translation_({ 0,0,0 }) {}
+    Pose() : translation_(0, 0, 0), rotation_(0, 0, 0), rotationMatrix_(cv::Matx33d::eye()), origin_(0, 0, 0) {}
     Pose(cv::Mat rotation, cv::Vec3d translation) : translation_(translation) { setRotationVector(rotation); }
-    cv::Matx33d getRotationMatrix() const;
-    ShoColumnVector3d getRotationVector() const;
-    cv::Mat getRotationMatrixInverse() const;
+    const cv::Matx33d& getRotationMatrix() const { return rotationMatrix_; }
+    const ShoColumnVector3d& getRotationVector() const { return rotation_; }
+    cv::Matx33d getRotationMatrixInverse() const { return rotationMatrix_.t(); }
     void setRotationVector(cv::Mat rot);
     void setTranslation(ShoColumnVector3d t);
-    ShoColumnVector3d getOrigin() const;
+    const ShoColumnVector3d& getOrigin() const { return origin_; }
     friend std::ostream & operator << (std::ostream& out, const Pose& p);
     Pose poseInverse() const;
     Pose compose(const Pose& p) const;
-    ShoColumnVector3d getTranslation() const;
+    const ShoColumnVector3d& getTranslation() const { return translation_; }
+    // Storage of the rotation vector and the translation, BundleSession optimizes them in place
+    double* rotationData() { return rotation_.val; }
+    double* translationData() { return translation_.val; }
+    // Recomputes the rotation matrix and the origin from the rotation vector and the translation
+    void updateCache();
+    // Rotates the columns of camera frame bearings into the world frame, R^T * b
+    void rotateBearingsToWorld(const Eigen::Matrix3Xd& bearings, Eigen::Matrix3Xd& worldBearings) const;
 };
 
 class Camera
@@ -59,6 +75,15 @@ class Camera
     template <typename T>
     opengv::bearingVector_t  normalizedPointToBearingVec(const cv::Point_<T>& point) const;
     cv::Point2d projectBearing(opengv::bearingVector_t);
+    // The camera as one of the models of the batch kernels in cameramodels.h
+    template <class Model>
+    Model getModel() const;
+    // Bearings of normalized image points, the batch version of normalizedPointToBearingVec
+    template <class Model>
+    void normalizedPointsToBearings(const ImagePoints& points, Bearings& bearings) const;
+    // Normalized image projections of points in the camera frame, the batch version of projectBearing
+    template <class Model>
+    void projectPoints(const Bearings& points, ImagePoints& projections) const;
     double getK1() const;
     double getK2() const;
     double getInitialK1() const;
@@ -89,5 +114,12 @@ class Camera
     double&  getK2();
 };
 
+template <>
+PerspectiveModel Camera::getModel<PerspectiveModel>() const;
+template <>
+BrownModel Camera::getModel<BrownModel>() const;
+template <>
+FisheyeModel Camera::getModel<FisheyeModel>() const;
+
 #include "camera.inl"
 #endif
\ No newline at end of file
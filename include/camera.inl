@@ -35,12 +35,20 @@ inline cv::Point_<T> Camera::normalizeImageCoordinate(const cv::Point_<T>& pixel
 template <typename T>
 inline opengv::bearingVectors_t Camera::normalizedPointsToBearingVec(const std::vector<cv::Point_<T>>& points) const
 {
-    opengv::bearingVectors_t bearings;
-    for (const auto point : points) {
-        auto bearing = normalizedPointToBearingVec(point);
-        bearings.push_back(bearing);
+    ImagePoints imagePoints;
+    imagePoints.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        imagePoints.x[i] = points[i].x;
+        imagePoints.y[i] = points[i].y;
+    }
+    Bearings bearings;
+    normalizedPointsToBearings<BrownModel>(imagePoints, bearings);
+
+    opengv::bearingVectors_t bearingVectors(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        bearingVectors[i] = opengv::bearingVector_t(bearings.x[i], bearings.y[i], bearings.z[i]);
     }
-    return bearings;
+    return bearingVectors;
 }
 
 template <typename T>
@@ -85,3 +93,15 @@ inline std::vector<cv::Point_<T>> Camera::denormalizeImageCoordinates(const std:
     }
     return results;
 }
+
+template <class Model>
+inline void Camera::normalizedPointsToBearings(const ImagePoints& points, Bearings& bearings) const
+{
+    undistortToBearings(getModel<Model>(), points, bearings);
+}
+
+template <class Model>
+inline void Camera::projectPoints(const Bearings& points, ImagePoints& projections) const
+{
+    projectToImage(getModel<Model>(), points, projections);
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Normalized image coordinates as a structure of arrays
+struct ImagePoints {
+    std::vector<double> x;
+    std::vector<double> y;
+
+    size_t size() const { return x.size(); }
+    void resize(size_t n) { x.resize(n); y.resize(n); }
+};
+
+// Bearings, or points in the camera frame, as a structure of arrays
+struct Bearings {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+
+    size_t size() const { return x.size(); }
+    void resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); }
+};
+
+// Fixed point iterations that invert the distortion, there is no early exit so the loops vectorize
+const int UNDISTORT_ITERATIONS = 10;
+
+/*
+ * Camera models of the batch kernels, with the parameters and the formulas of the bundle adjuster.
+ *
+ * project maps a point in the camera frame to the normalized image and bearing maps a normalized
+ * image point back to the unit bearing it was projected from. Both work on one point without
+ * branches on the data, the kernels below run them over whole arrays.
+ */
+struct PerspectiveModel {
+    double focal;
+    double k1;
+    double k2;
+
+    void project(double x, double y, double z, double& u, double& v) const
+    {
+        const auto xp = x / z;
+        const auto yp = y / z;
+        const auto r2 = xp * xp + yp * yp;
+        const auto distortion = 1.0 + r2 * (k1 + r2 * k2);
+        u = focal * distortion * xp;
+        v = focal * distortion * yp;
+    }
+
+    void bearing(double u, double v, double& bx, double& by, double& bz) const
+    {
+        const auto xd = u / focal;
+        const auto yd = v / focal;
+        auto xp = xd;
+        auto yp = yd;
+        for (auto i = 0; i < UNDISTORT_ITERATIONS; ++i) {
+            const auto r2 = xp * xp + yp * yp;
+            const auto inverseDistortion = 1.0 / (1.0 + r2 * (k1 + r2 * k2));
+            xp = xd * inverseDistortion;
+            yp = yd * inverseDistortion;
+        }
+        const auto inverseNorm = 1.0 / std::sqrt(xp * xp + yp * yp + 1.0);
+        bx = xp * inverseNorm;
+        by = yp * inverseNorm;
+        bz = inverseNorm;
+    }
+};
+
+// Brown-Conrady distortion with the rational (k4, k5, k6) and thin prism (s1 to s4) terms of OpenCV
+// calibrations, they are zero for a plain five coefficient calibration
+struct BrownModel {
+    double focalX;
+    double focalY;
+    double cx;
+    double cy;
+    double k1;
+    double k2;
+    double p1;
+    double p2;
+    double k3;
+    double k4;
+    double k5;
+    double k6;
+    double s1;
+    double s2;
+    double s3;
+    double s4;
+
+    void project(double x, double y, double z, double& u, double& v) const
+    {
+        const auto xp = x / z;
+        const auto yp = y / z;
+        const auto r2 = xp * xp + yp * yp;
+        const auto radial = (1.0 + r2 * (k1 + r2 * (k2 + r2 * k3))) / (1.0 + r2 * (k4 + r2 * (k5 + r2 * k6)));
+        u = focalX * (xp * radial + 2.0 * p1 * xp * yp + p2 * (r2 + 2.0 * xp * xp) + r2 * (s1 + r2 * s2)) + cx;
+        v = focalY * (yp * radial + p1 * (r2 + 2.0 * yp * yp) + 2.0 * p2 * xp * yp + r2 * (s3 + r2 * s4)) + cy;
+    }
+
+    void bearing(double u, double v, double& bx, double& by, double& bz) const
+    {
+        //Same iteration as cv::undistortPoints: the tangential and prism parts are removed, then the radial one
+        const auto xd = (u - cx) / focalX;
+        const auto yd = (v - cy) / focalY;
+        auto xp = xd;
+        auto yp = yd;
+        for (auto i = 0; i < UNDISTORT_ITERATIONS; ++i) {
+            const auto r2 = xp * xp + yp * yp;
+            const auto inverseRadial = (1.0 + r2 * (k4 + r2 * (k5 + r2 * k6))) / (1.0 + r2 * (k1 + r2 * (k2 + r2 * k3)));
+            const auto deltaX = 2.0 * p1 * xp * yp + p2 * (r2 + 2.0 * xp * xp) + r2 * (s1 + r2 * s2);
+            const auto deltaY = p1 * (r2 + 2.0 * yp * yp) + 2.0 * p2 * xp * yp + r2 * (s3 + r2 * s4);
+            xp = (xd - deltaX) * inverseRadial;
+            yp = (yd - deltaY) * inverseRadial;
+        }
+        const auto inverseNorm = 1.0 / std::sqrt(xp * xp + yp * yp + 1.0);
+        bx = xp * inverseNorm;
+        by = yp * inverseNorm;
+        bz = inverseNorm;
+    }
+};
+
+struct FisheyeModel {
+    double focal;
+    double k1;
+    double k2;
+
+    void project(double x, double y, double z, double& u, double& v) const
+    {
+        const auto l = std::sqrt(x * x + y * y);
+        const auto theta = std::atan2(l, z);
+        const auto theta2 = theta * theta;
+        const auto thetaD = theta * (1.0 + theta2 * (k1 + theta2 * k2));
+        //On the optical axis the limit of thetaD / l is 1 / z
+        const auto s = l > 0.0 ? focal * thetaD / l : focal / z;
+        u = s * x;
+        v = s * y;
+    }
+
+    void bearing(double u, double v, double& bx, double& by, double& bz) const
+    {
+        //Newton iterations on theta * (1 + k1 theta^2 + k2 theta^4) = thetaD
+        const auto xd = u / focal;
+        const auto yd = v / focal;
+        const auto thetaD = std::sqrt(xd * xd + yd * yd);
+        auto theta = thetaD;
+        for (auto i = 0; i < UNDISTORT_ITERATIONS; ++i) {
+            const auto theta2 = theta * theta;
+            const auto f = theta * (1.0 + theta2 * (k1 + theta2 * k2)) - thetaD;
+            const auto df = 1.0 + theta2 * (3.0 * k1 + 5.0 * k2 * theta2);
+            theta -= f / df;
+        }
+        const auto s = thetaD > 0.0 ? std::sin(theta) / thetaD : 1.0;
+        bx = s * xd;
+        by = s * yd;
+        bz = std::cos(theta);
+    }
+};
+
+// Bearings of every point, resized to the number of points
+template <class Model>
+void undistortToBearings(const Model& model, const ImagePoints& points, Bearings& bearings)
+{
+    const auto n = points.size();
+    bearings.resize(n);
+    const auto x = points.x.data();
+    const auto y = points.y.data();
+    auto bx = bearings.x.data();
+    auto by = bearings.y.data();
+    auto bz = bearings.z.data();
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        model.bearing(x[i], y[i], bx[i], by[i], bz[i]);
+    }
+}
+
+// Normalized image projections of every point in the camera frame, resized to the number of points
+template <class Model>
+void projectToImage(const Model& model, const Bearings& points, ImagePoints& projections)
+{
+    const auto n = points.size();
+    projections.resize(n);
+    const auto x = points.x.data();
+    const auto y = points.y.data();
+    const auto z = points.z.data();
+    auto u = projections.x.data();
+    auto v = projections.y.data();
+#pragma omp simd
+    for (size_t i = 0; i < n; ++i) {
+        model.project(x[i], y[i], z[i], u[i], v[i]);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "flightsession.h"
+#include "kdforestindex.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+ * Least recently used cache of image features with a memory budget in bytes.
+ *
+ * Entries are handed out as shared, read only handles so a matching thread never copies
+ * descriptors and an entry evicted while in use stays valid until its last handle is gone.
+ * The kd-forest of an image is built on first use and evicted together with its features.
+ */
+class FeatureCache {
+private:
+    struct Entry {
+        std::string imageName;
+        std::shared_ptr<const ImageFeatures> features;
+        std::shared_ptr<const KdForestIndex> forest;
+        size_t bytes;
+    };
+
+    const FlightSession& flight_;
+    size_t budget_;
+    size_t bytes_;
+    size_t hits_;
+    size_t misses_;
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+    void _evict();
+
+public:
+    FeatureCache(const FlightSession& flight, size_t budget);
+    std::shared_ptr<const ImageFeatures> get(const std::string& imageName);
+    // Returns nullptr when the descriptors of the image can not be indexed (binary descriptors)
+    std::shared_ptr<const KdForestIndex> getForest(const std::string& imageName, int maxComparisons);
+    size_t getBytes() const { return bytes_; }
+    size_t getHits() const { return hits_; }
+    size_t getMisses() const { return misses_; }
+    static size_t getFeatureBytes(const ImageFeatures& features);
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Versioned binary container for the features of a single image.
+ *
+ * A file starts with a FeatureFileHeader and is followed by the structure of arrays
+ * x, y, size and angle (float32 each), the descriptor block (numFeatures rows of
+ * descriptorRowBytes bytes) and the colors (3 bytes per feature). Every section starts
+ * on a FEATURE_FILE_ALIGNMENT boundary so that a memory mapped file can be used directly.
+ */
+const uint32_t FEATURE_FILE_MAGIC = 0x46534853; // "SHSF"
+const uint32_t FEATURE_FILE_VERSION = 1;
+const uint64_t FEATURE_FILE_ALIGNMENT = 16;
+const std::string FEATURE_FILE_EXTENSION = ".features";
+const std::string LEGACY_FEATURE_FILE_EXTENSION = ".yaml";
+
+struct FeatureFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numFeatures;
+    uint32_t descriptorCols;
+    int32_t descriptorType;
+    uint32_t descriptorRowBytes;
+    uint64_t xOffset;
+    uint64_t yOffset;
+    uint64_t sizeOffset;
+    uint64_t angleOffset;
+    uint64_t descriptorOffset;
+    uint64_t colorOffset;
+    uint64_t fileSize;
+};
+
+// Read only view over the features of an image. The memory backing the view (a mapped
+// file or an in memory buffer) stays alive for as long as a copy of the view exists.
+class FeatureView {
+private:
+    std::shared_ptr<const void> storage_;
+    const char* base_;
+    const FeatureFileHeader* header_;
+
+public:
+    FeatureView() : storage_(), base_(nullptr), header_(nullptr) {}
+    FeatureView(std::shared_ptr<const void> storage, const char* base);
+    bool empty() const { return header_ == nullptr; }
+    size_t size() const { return header_ ? header_->numFeatures : 0; }
+    const float* x() const;
+    const float* y() const;
+    const float* sizes() const;
+    const float* angles() const;
+    const uint8_t* colors() const;
+    // Descriptor matrix that points into the view. It must be treated as read only.
+    cv::Mat descriptors() const;
+    cv::KeyPoint keypoint(size_t i) const;
+    cv::Scalar color(size_t i) const;
+    std::vector<cv::KeyPoint> keypoints() const;
+    std::vector<cv::Scalar> colorList() const;
+    const std::shared_ptr<const void>& storage() const { return storage_; }
+};
+
+class FeatureStore {
+public:
+    static std::vector<char> encode(
+        const std::vector<cv::KeyPoint>& keypoints,
+        const cv::Mat& descriptors,
+        const std::vector<cv::Scalar>& colors
+    );
+    // Writes the file through a temporary so readers never observe a partial file
+    static bool write(
+        const std::string& featureFile,
+        const std::vector<cv::KeyPoint>& keypoints,
+        const cv::Mat& descriptors,
+        const std::vector<cv::Scalar>& colors
+    );
+    // Memory maps a binary feature file. Returns an empty view if the file is not valid.
+    static FeatureView map(const std::string& featureFile);
+    // Parses a legacy cv::FileStorage YAML feature file into an in memory view
+    static FeatureView fromYaml(const std::string& yamlFile);
+    static FeatureView fromBuffer(std::vector<char> buffer);
+};
@@ -2,8 +2,13 @@
 
 #include "image.hpp"
 #include "camera.h"
+#include "featurestore.h"
+#include "imageloader.h"
+#include "matchstore.h"
 #include <boost/filesystem.hpp>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -12,6 +17,8 @@ public:
     std::vector<cv::KeyPoint> keypoints;
     cv::Mat descriptors;
     std::vector<cv::Scalar> colors;
+    // Keeps the memory behind descriptors alive when it points into a feature file
+    FeatureView view;
     std::vector<cv::KeyPoint> getKeypoints() const { return keypoints; }
     cv::Mat getDescriptors() const { return descriptors; }
 };
@@ -33,11 +40,19 @@ private:
     std::map<std::string, double> referenceLLA_;
     std::string _extractProjectionTypeFromExif(Exiv2::ExifData exifData) const;
     bool gpsDataPresent_ = true;
+    // The match writer is created on the first write, so sessions that only read never touch the
+    // match files. Copies of a session share it.
+    struct LazyMatchWriter {
+        std::mutex mutex;
+        std::unique_ptr<MatchStoreWriter> writer;
+    };
+    std::shared_ptr<LazyMatchWriter> matchWriter_;
+    std::shared_ptr<ImageLoader> imageLoader_;
 
 public:
     FlightSession();
     FlightSession(std::string imageDirectory, std::string calibFile = std::string());
-    std::vector<Img> getImageSet() const;
+    const std::vector<Img>& getImageSet() const;
     const boost::filesystem::path getImageDirectoryPath() const;
     const boost::filesystem::path getImageFeaturesPath() const;
     const boost::filesystem::path getImageMatchesPath() const;
@@ -56,7 +71,14 @@ public:
     );
     bool saveImageExifFile(std::string imageName, ImageMetadata imageExif);
     bool saveMatches(std::string fileName, const std::map<std::string, std::vector<cv::DMatch>>& matches);
+    bool savePairMatches(std::string queryImage, std::string trainImage, const std::vector<cv::DMatch>& matches);
+    MatchStore openMatchStore() const;
     ImageFeatures loadFeatures(std::string imageName) const;
+    // Maps the binary features of an image, converting a legacy YAML feature file on its first load
+    FeatureView loadFeatureView(std::string imageName) const;
+    const boost::filesystem::path getImageFeaturesFile(std::string imageName) const;
+    bool hasImageFeatures(std::string imageName) const;
+    ImageLoader& getImageLoader() const;
     const Camera& getCamera() const;
     Camera& getCamera();
     void setCamera(Camera camera);
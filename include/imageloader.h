@@ -0,0 +1,40 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+ * Decodes every image file once and hands out the decoded frame to all the stages of a run
+ * that need it. Full resolution frames are kept in a small least recently used cache keyed by
+ * file, and downscaled working images are derived from the cached frame, so extraction,
+ * undistortion and match plotting share a single decode of each image.
+ */
+class ImageLoader {
+private:
+    using CacheEntry = std::pair<std::string, std::shared_ptr<const cv::Mat>>;
+
+    size_t capacity_;
+    std::mutex mutex_;
+    std::list<CacheEntry> frames_;
+    std::unordered_map<std::string, std::list<CacheEntry>::iterator> index_;
+
+public:
+    explicit ImageLoader(size_t capacity = 4);
+    // Full resolution BGR frame as returned by cv::imread. Returns nullptr if the file can not be read.
+    std::shared_ptr<const cv::Mat> load(const std::string& imagePath);
+    /*
+     * RGB color and grayscale frames derived from the cached full resolution frame. Frames larger
+     * than workingSize are downscaled to it, an empty workingSize keeps the full resolution.
+     */
+    bool loadWorkingImages(
+        const std::string& imagePath,
+        cv::Size workingSize,
+        cv::Mat& color,
+        cv::Mat& gray
+    );
+    void clear();
+};
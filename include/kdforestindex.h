@@ -0,0 +1,54 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct _VlKDForest;
+
+// Two nearest neighbours of a descriptor, distances are squared L2. index is -1 when
+// the index holds fewer than two descriptors.
+struct ForestNeighbours {
+    int index;
+    float distance;
+    float secondDistance;
+};
+
+/*
+ * Randomized kd-forest (vlfeat) over the float descriptors of one image.
+ *
+ * A forest is built once per image and queried for every candidate pair of that image.
+ * maxComparisons bounds the number of leaves checked per query and trades recall for
+ * speed, 0 makes the search exact. The index shares reference counted descriptors and copies
+ * descriptors that do not own their memory, so it never points into a released mapping.
+ */
+class KdForestIndex {
+private:
+    cv::Mat descriptors_;
+    _VlKDForest* forest_;
+    // vlfeat keeps a list of searchers in the forest, creating and deleting them is not thread safe
+    mutable std::mutex searcherMutex_;
+
+    KdForestIndex(const cv::Mat& descriptors, int numTrees, int maxComparisons);
+
+public:
+    static const int DEFAULT_NUM_TREES = 4;
+    static const int DEFAULT_MAX_COMPARISONS = 256;
+
+    ~KdForestIndex();
+    KdForestIndex(const KdForestIndex&) = delete;
+    KdForestIndex& operator=(const KdForestIndex&) = delete;
+
+    // Returns nullptr unless descriptors are continuous CV_32F rows
+    static std::shared_ptr<const KdForestIndex> build(
+        const cv::Mat& descriptors,
+        int numTrees = DEFAULT_NUM_TREES,
+        int maxComparisons = DEFAULT_MAX_COMPARISONS
+    );
+    int size() const { return descriptors_.rows; }
+    const cv::Mat& getDescriptors() const { return descriptors_; }
+    size_t getMemoryBytes() const;
+    // Safe to call from several threads at once, every call uses its own searcher
+    void searchTwoNearest(const cv::Mat& queries, std::vector<ForestNeighbours>& neighbours) const;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Columnar match database for a whole flight.
+ *
+ * The database lives in three append only files inside the matches directory:
+ *  - matches.images : one image name per line, the position of a name is its image id
+ *  - matches.dat    : for every matched pair the arrays queryIdx (int32), trainIdx (int32)
+ *                     and distance (float32), each starting on a MATCH_FILE_ALIGNMENT boundary
+ *  - matches.idx    : a MatchFileHeader followed by one MatchPairEntry per matched pair
+ *
+ * The pair entry is written last so an interrupted matching run leaves at most a partial
+ * entry at the tail of the index, which readers ignore and the writer truncates. When the
+ * same pair is written twice the later entry wins.
+ */
+const uint32_t MATCH_FILE_MAGIC = 0x4d534853; // "SHSM"
+const uint32_t MATCH_FILE_VERSION = 1;
+const uint64_t MATCH_FILE_ALIGNMENT = 16;
+const std::string MATCH_INDEX_FILE = "matches.idx";
+const std::string MATCH_DATA_FILE = "matches.dat";
+const std::string MATCH_IMAGES_FILE = "matches.images";
+
+struct MatchFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entrySize;
+    uint32_t reserved;
+};
+
+struct MatchPairEntry {
+    uint32_t queryImage;
+    uint32_t trainImage;
+    uint64_t offset;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+// Matches of one image pair pointing into the mapped data file
+struct PairMatches {
+    uint32_t queryImage;
+    uint32_t trainImage;
+    uint32_t count;
+    const int32_t* queryIdx;
+    const int32_t* trainIdx;
+    const float* distance;
+
+    std::vector<cv::DMatch> toDMatches(int imgIdx = -1) const;
+};
+
+// Read only snapshot of the match database
+class MatchStore {
+private:
+    std::shared_ptr<const void> indexStorage_;
+    std::shared_ptr<const void> dataStorage_;
+    const char* data_;
+    std::vector<std::string> imageNames_;
+    std::unordered_map<std::string, uint32_t> imageIds_;
+    std::vector<MatchPairEntry> entries_;
+    std::unordered_map<uint64_t, size_t> pairIndex_;
+    std::unordered_map<uint32_t, std::vector<size_t>> queryIndex_;
+
+    PairMatches _makePair(const MatchPairEntry& entry) const;
+
+public:
+    MatchStore();
+    // Maps the database in matchesDirectory. Returns an empty store if there is none.
+    static MatchStore open(const std::string& matchesDirectory);
+    bool empty() const { return entries_.empty(); }
+    size_t numPairs() const { return entries_.size(); }
+    // Pairs are streamed in the order they were written
+    PairMatches pair(size_t i) const;
+    bool find(const std::string& queryImage, const std::string& trainImage, PairMatches& matches) const;
+    bool hasPair(const std::string& queryImage, const std::string& trainImage) const;
+    std::vector<PairMatches> pairsForQuery(const std::string& queryImage) const;
+    const std::string& imageName(uint32_t imageId) const { return imageNames_[imageId]; }
+    const std::vector<std::string>& imageNames() const { return imageNames_; }
+};
+
+// Appends pairs to the match database. Appends from several threads are serialised.
+class MatchStoreWriter {
+private:
+    std::string directory_;
+    std::unordered_map<std::string, uint32_t> imageIds_;
+    uint32_t numImages_;
+    uint64_t dataSize_;
+    std::mutex mutex_;
+
+    uint32_t _imageId(const std::string& imageName);
+
+public:
+    MatchStoreWriter(const std::string& matchesDirectory);
+    bool append(const std::string& queryImage, const std::string& trainImage, const std::vector<cv::DMatch>& matches);
+};
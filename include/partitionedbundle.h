@@ -0,0 +1,73 @@
+#pragma once
+
+#include "reconstruction.h"
+#include "trackstore.h"
+#include <vector>
+
+struct PartitionedBundleReport {
+    int numClusters;
+    int numSeparators;
+    int outerIterations;
+    // Root mean square distance of the separator copies to their consensus position
+    double primalResidual;
+    // Root mean square distance of the camera copies of the clusters to the consensus camera
+    double cameraResidual;
+    // Root mean square reprojection error over every observation after the solve
+    double rmsReprojectionError;
+};
+
+/*
+ * Bundle adjustment of a large reconstruction split into clusters of shots solved in parallel.
+ *
+ * The shot co-visibility graph is cut into clusters of at most maxClusterShots shots by merging
+ * along the edges with the most shared tracks first. Every cluster is its own ceres problem over
+ * its shots and every point they see, so a point seen from several clusters (a separator) has one
+ * copy per cluster and the clusters overlap on those points. The copies are reconciled with
+ * consensus ADMM: every outer iteration solves the clusters independently with a proximal term
+ * pulling the separator copies towards their consensus position, averages the copies into the new
+ * consensus and updates the dual variables.
+ *
+ * Unless it is fixed, the camera is a separator shared by every cluster. Each cluster refines its
+ * own copy under the same proximal pull, and the copies are averaged into the consensus camera that
+ * is written back. The prior on the camera is split evenly between the clusters, so their sum is
+ * the prior of the whole problem.
+ *
+ * The clusters are solved by the threads of one process.
+ */
+class PartitionedBundle {
+private:
+    Reconstruction& rec_;
+    const TrackStore& tracks_;
+    bool useGps_;
+    bool fixCamera_;
+    double focalSD_;
+    double k1SD_;
+    double k2SD_;
+    int maxClusterShots_;
+    int maxOuterIterations_;
+    int maxInnerIterations_;
+    double penalty_;
+    double tolerance_;
+    PartitionedBundleReport report_;
+
+    std::vector<std::vector<int>> _partition() const;
+
+public:
+    // The camera is kept near its initial focal and distortion with the given standard deviations, as in BundleSession
+    PartitionedBundle(Reconstruction& rec, const TrackStore& tracks, bool useGps, bool fixCamera = true,
+        double focalSD = 0.01, double k1SD = 0.01, double k2SD = 0.01);
+    // Solves and writes the shots, the points, the camera and the reprojection errors back to the reconstruction
+    void run();
+    void setMaxClusterShots(int maxClusterShots) { maxClusterShots_ = maxClusterShots; }
+    void setMaxOuterIterations(int maxOuterIterations) { maxOuterIterations_ = maxOuterIterations; }
+    // Ceres iterations of every cluster in one outer iteration
+    void setMaxInnerIterations(int maxInnerIterations) { maxInnerIterations_ = maxInnerIterations; }
+    // Weight of the proximal term, higher values enforce consensus faster but slow down the clusters
+    void setPenalty(double penalty) { penalty_ = penalty; }
+    // The outer loop stops once the primal and dual residuals are below this
+    void setTolerance(double tolerance) { tolerance_ = tolerance; }
+    const PartitionedBundleReport& getReport() const { return report_; }
+
+    // Root mean square reprojection error of the points of a reconstruction over their observations
+    static double rmsReprojectionError(const Reconstruction& rec, const TrackStore& tracks);
+};
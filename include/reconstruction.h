@@ -1,6 +1,7 @@
 #pragma once
 #include "shot.h"
 #include "flightsession.h"
+#include "trackstore.h"
 
 const int BUNDLE_INTERVAL = 999999;
 const double NEW_POINTS_RATIO = 1.2;
@@ -33,25 +34,43 @@ class Reconstruction {
     private:
         std::map<std::string, Shot> shots;
         std::map<int, CloudPoint> cloudPoints;
-        Camera camera;
+        // Camera table indexed by the camera ids of the shots. The bundles and the exporters only
+        // handle DEFAULT_CAMERA_ID so far, the table holds the one camera the reconstruction is
+        // created with and addShot refuses shots of any other camera.
+        std::vector<Camera> cameras;
         int lastPointCount;
         int lastShotCount;
         bool usesGPS = false;
+        const TrackStore* trackStore = nullptr;
+        std::vector<int> imageTrackCounts;
+        std::vector<int> changedImages;
+        std::vector<uint8_t> imageChanged;
+        void _markChanged(int image);
+        void _countTrack(int trackId, int delta);
 
     public:
         Reconstruction();
         Reconstruction(Camera camera);
-        void addShot(std::string shotId, Shot shot);
+        void addShot(const std::string& shotId, const Shot& shot);
         std::map<std::string, Shot>& getReconstructionShots();
         const std::map<std::string, Shot>& getReconstructionShots() const;
-        bool hasShot(std::string shotId) const;
+        bool hasShot(const std::string& shotId) const;
         const std::map<int, CloudPoint>& getCloudPoints() const;
         std::map<int, CloudPoint>& getCloudPoints();
         void addCloudPoint(CloudPoint cPoint);
-        bool hasTrack(std::string trackId) const;
-        const Camera& getCamera() const;
+        bool hasTrack(int trackId) const;
+        void removeCloudPoint(int trackId);
+        // Keeps live per image counts of the alive observations of reconstructed tracks. The store
+        // must outlive the reconstruction and observations of reconstructed tracks are removed through
+        // removeObservation before they are removed from the store
+        void setTrackStore(const TrackStore& tracks);
+        void removeObservation(int trackId, int image);
+        int reconstructedTrackCount(int image) const { return imageTrackCounts[image]; }
+        // Images whose count changed since the last call
+        std::vector<int> takeChangedImages();
+        const Camera& getCamera(int cameraId = DEFAULT_CAMERA_ID) const;
         void saveReconstruction(const std::string recFileName) const;
-        Camera& getCamera();
+        Camera& getCamera(int cameraId = DEFAULT_CAMERA_ID);
         void updateLastCounts();
         bool needsBundling();
         bool needsRetriangulation();
@@ -59,8 +78,8 @@ class Reconstruction {
         void alignToGps();
         void applySimilarity(double s, cv::Matx33d a, ShoColumnVector3d b);
         void setGPS(bool useGps);
-        const Shot& getShot(std::string shotId) const;
-        Shot& getShot(std::string shotId);
+        const Shot& getShot(const std::string& shotId) const;
+        Shot& getShot(const std::string& shotId);
         bool usesGps() const;
         std::tuple<double, cv::Matx33d, ShoColumnVector3d> getGPSTransform();
 };
\ No newline at end of file
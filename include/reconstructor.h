@@ -4,6 +4,8 @@
 #include "shotracking.h"
 #include "camera.h"
 #include "bundle/bundle_adjuster.h"
+#include "bundlesession.h"
+#include "partitionedbundle.h"
 #include "reconstruction.h"
 #include <tuple>
 #include <optional>
@@ -12,6 +14,16 @@ struct ReconstructionReport {
     int numCommonPoints;
     int numInliers;
 };
+// Pose of a candidate image from PnP-RANSAC against the reconstruction, not yet added to it
+struct Resection {
+    int image;
+    bool status;
+    ReconstructionReport report;
+    cv::Mat rotation;
+    cv::Mat translation;
+    // Reconstructed tracks of the inlier correspondences
+    std::vector<int> inlierTracks;
+};
 //Essential matrix, rotation and translation
 typedef std::tuple <bool, cv::Mat, cv::Mat, cv::Mat> TwoViewPose;
 //Loss function for the ceres problem (see: http://ceres-solver.org/modeling.html#lossfunction)
@@ -34,10 +46,15 @@ const double RADIAL_DISTORTION_P1_SD = 0.01;
 const double RADIAL_DISTORTION_P2_SD = 0.01;
 //The standard deviation of the third radial distortion parameter
 const double RADIAL_DISTORTION_K3_SD = 0.01;
-// Number of threads to use
+// Most threads a bundle adjustment may use, small problems use fewer
 const int NUM_PROCESESS = 8;
 const int MAX_ITERATIONS = 10;
-const auto LINEAR_SOLVER_TYPE = "DENSE_QR";
+// Bundle adjustments choose their linear solver and preconditioner from the size of the problem
+const auto LINEAR_SOLVER_TYPE = "AUTO";
+// Reconstructions with at least this many shots are bundled in clusters solved in parallel
+const size_t PARTITIONED_BUNDLE_MIN_SHOTS = 3000;
+// Most shots in one cluster of a partitioned bundle
+const int PARTITIONED_BUNDLE_CLUSTER_SHOTS = 500;
 const int MIN_INLIERS = 20;
 const double BUNDLE_OUTLIER_THRESHOLD = 0.006;
 const bool OPTIMIZE_CAMERA_PARAEMETERS = true;
@@ -45,64 +62,69 @@ const bool OPTIMIZE_CAMERA_PARAEMETERS = true;
 const int LOCAL_BUNDLE_MAX_SHOTS = 30;
 const int LOCAL_BUNDLE_MIN_COMMON_POINTS = 20;
 const int LOCAL_BUNDLE_RADIUS = 3;
+// Image pairs sharing the most tracks that are scored as initial pairs
+const size_t RECONSTRUCTABILITY_MAX_PAIRS = 500;
+// Images seeing fewer reconstructed tracks are not resected
+const int RESECTION_MIN_POINTS = 5;
+// Candidate images resected concurrently in every step of continueReconstruction
+const size_t RESECTION_BATCH_SIZE = 8;
 
 
 class Reconstructor
 {
 public:
-    using TrackName = std::string;
     using ImageName = std::string;
-    using TrackNodes = std::map<TrackName, TrackGraph::vertex_descriptor>;
-    using ImageNodes = std::map<ImageName, TrackGraph::vertex_descriptor>;
 
 private:
   FlightSession flight_;
-  TrackGraph tg_;
-  TrackNodes trackNodes_;
-  ImageNodes imageNodes_;
-  std::map<std::string, ShoColumnVector3d> shotOrigins;
-  std::map<std::string, cv::Mat> rInverses;
+  TrackStore tracks_;
   void _alignMatchingPoints(const CommonTrack track, std::vector<cv::Point2f>& points1, std::vector<cv::Point2f>& points2) const;
   std::vector<cv::DMatch> _getTrackDMatchesForImagePair(const CommonTrack track) const;
-  void _addCameraToBundle(BundleAdjuster& ba, const Camera camera, bool fixCameras);
-  void _getCameraFromBundle(BundleAdjuster& ba, Camera& cam);
+  // Adds the camera to the indexed bundle problem and returns its index
+  int _addCameraToBundle(BundleAdjuster& ba, const Camera& camera, bool fixCameras);
+  void _getCameraFromBundle(BundleAdjuster& ba, int camera, Camera& cam);
   void _computeTwoViewReconstructionInliers(opengv::bearingVectors_t b1, opengv::bearingVectors_t b2, 
       opengv::rotation_t r, opengv::translation_t t) const;
+  // Alive observations of each image whose track is in the reconstruction, in track order
+  std::vector<std::vector<uint32_t>> _reconstructedObservations(const Reconstruction& rec, const std::vector<int>& images) const;
+  Resection _solveResection(const Reconstruction& rec, int image, const std::vector<uint32_t>& observations,
+      int iterations, double probability) const;
+  void _addResectedShot(Reconstruction& rec, const Resection& resection);
   TwoViewPose _computeRotationInliers(opengv::bearingVectors_t& b1, opengv::bearingVectors_t& b2,
       const opengv::rotation_t& rotation, cv::Mat& cvMask) const;
 
 public:
-  Reconstructor(FlightSession flight, TrackGraph tg);
+  Reconstructor(FlightSession flight, TrackStore tracks);
   TwoViewPose recoverTwoCameraViewPose(CommonTrack track, cv::Mat& mask);
-  TwoViewPose twoViewReconstructionRotationOnly(CommonTrack track, cv::Mat &mask);
+  // Rotation between the two images of a pair with the shared tracks consistent with it in the mask
+  TwoViewPose twoViewReconstructionRotationOnly(const CommonTrack& track, cv::Mat &mask) const;
   template <typename T>
   void twoViewReconstructionInliers(std::vector<cv::Mat>& Rs_decomp, std::vector<cv::Mat>& ts_decomp, std::vector<int> possibleSolutions,
       std::vector<cv::Point_<T>> points1, std::vector<cv::Point_<T>> points2) const;
   TwoViewPose recoverTwoViewPoseWithHomography(CommonTrack track, cv::Mat& mask);
-  float computeReconstructabilityScore(int tracks, cv::Mat inliers, int treshold = 0.3);
+  float computeReconstructabilityScore(int tracks, cv::Mat inliers, int treshold = 0.3) const;
+  // Scores candidate pairs in parallel, best first. Pairs that can not beat the best score are left
+  // unscored with a score of -1 after the scored ones
   void computeReconstructability(const ShoTracker& tracker, std::vector<CommonTrack>& commonTracks);
   std::tuple<cv::Mat, std::vector<cv::Point2f>, std::vector<cv::Point2f>, cv::Mat> commonTrackHomography(CommonTrack commonTrack) const;
   void runIncrementalReconstruction (const ShoTracker& tracker);
 
   using OptionalReconstruction = std::optional<Reconstruction>;
   OptionalReconstruction beginReconstruction (CommonTrack track, const ShoTracker& tracker);
+  // Adds the images that can be resected, solving PnP for a batch of the best candidates at once
   void continueReconstruction(Reconstruction& rec, std::set<std::string>& images);
   void triangulateShotTracks(std::string image1, Reconstruction& rec);
-  void triangulateTrack(std::string trackId, Reconstruction& rec);
+  // Triangulates the tracks from the shots of the reconstruction in one parallel pass
+  void triangulateTracks(const std::vector<int>& trackIds, Reconstruction& rec);
   void retriangulate(Reconstruction& rec);
-  ShoColumnVector3d getShotOrigin(const Shot& shot);
-  cv::Mat getRotationInverse(const Shot& shot);
   void singleViewBundleAdjustment(std::string shotId, Reconstruction& rec);
-  void localBundleAdjustment(std::string centralShotId, Reconstruction& rec);
-  const vertex_descriptor getImageNode(const std::string imageName) const;
-  const vertex_descriptor getTrackNode(std::string trackId) const;
+  // Bundles the shots around a shot and returns the tracks whose points it moved
+  std::vector<int> localBundleAdjustment(std::string centralShotId, Reconstruction& rec);
+  const TrackStore& getTrackStore() const { return tracks_; }
   void plotTracks(CommonTrack track) const;
   void exportToMvs(const Reconstruction& rec, const std::string mvsFileName);
-  void bundle(Reconstruction& rec);
+  void bundle(BundleSession& session);
   void removeOutliers(Reconstruction & rec);
-  std::tuple<bool, ReconstructionReport> resect(Reconstruction & rec, const vertex_descriptor imageVetex,
-      double threshold = 0.004, int iterations = 1000, double probability = 0.999, int resectionInliers = 10 );
-  std::vector<std::pair<std::string, int>> reconstructedPointForImages(const Reconstruction & rec, std::set<std::string>& images);
   void colorReconstruction(Reconstruction &rec);
   std::set<std::string> directShotNeighbors(std::set<std::string> shotIds, const Reconstruction& rec, 
       int maxNeighbors, int minCommonPoints = LOCAL_BUNDLE_MIN_COMMON_POINTS);
@@ -8,37 +8,62 @@
 #include <opencv2/features2d/features2d.hpp>
 
 const int FEATURE_PROCESS_SIZE = 2000;
-
-inline double dist_sq(double *a1, double *a2, int dims)
-{
-    double dist_sq = 0, diff;
-    while (--dims >= 0)
-    {
-        diff = (a1[dims] - a2[dims]);
-        dist_sq += diff * diff;
-    }
-    return dist_sq;
-}
+// Descriptors per image used to train the retrieval vocabulary
+const int RETRIEVAL_SAMPLES_PER_IMAGE = 200;
+// Vocabulary tree kept next to the flight directories when no index file is given, so every
+// flight of a project adds to the same tree
+const std::string VOCABULARY_TREE_FILE = "vocabulary.tree";
+// Memory budget of the descriptor cache used while matching pairs
+const size_t FEATURE_CACHE_BYTES = size_t(2) << 30;
 
 class ShoMatcher
 {
 private:
     FlightSession flight_;
     bool runCuda_ = true;
-    void *kd_;
-    int dimensions_ = 2;
     int featureSize_ = 5000;
     std::map<std::string, std::vector<std::string>> candidateImages;
-    bool _extractFeature(std::string fileName, bool resize = false);
-    cv::Ptr<RobustMatcher> rMatcher_;
+    RobustMatcher::Feature feature_;
+    RobustMatcher::MatchingMode matchingMode_ = RobustMatcher::MatchingMode::bruteForce;
+    int maxComparisons_ = KdForestIndex::DEFAULT_MAX_COMPARISONS;
+
+    struct DecodedImage {
+        std::string fileName;
+        cv::Mat color;
+        cv::Mat gray;
+    };
+
+    struct ExtractedFeatures {
+        std::string fileName;
+        std::vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+        std::vector<cv::Scalar> colors;
+    };
+
+    std::vector<std::string> _getImagesToExtract() const;
+    std::vector<cv::Point3d> _getTopocentricPositions() const;
+    cv::Mat _sampleRetrievalDescriptors(const std::vector<std::string>& images, std::vector<FeatureView>& featureViews,
+        std::vector<cv::Mat>& imageDescriptors) const;
+    int _extractFeatures(const std::vector<std::string>& images, bool resize);
+    bool _decodeImage(const std::string& fileName, bool resize, DecodedImage& decoded) const;
+    void _detectFeatures(RobustMatcher& matcher, const DecodedImage& decoded, ExtractedFeatures& features) const;
 
 public:
-    ShoMatcher(FlightSession flight, bool runCuda = true);
-    void getCandidateMatchesUsingSpatialSearch(double range = 0.000125);
+    ShoMatcher(FlightSession flight, bool runCuda = true, RobustMatcher::Feature feature = RobustMatcher::Feature::orb);
+    // Pairs every image with the images taken within range metres of it, only the maxNeighbours
+    // closest of them when maxNeighbours is positive
+    void getCandidateMatchesUsingSpatialSearch(double range = 15.0, int maxNeighbours = 0);
     void getCandidateMatchesFromFile(std::string candidateFile);
+    // Pairs every image with the k images that look most alike. Needs no GPS, extracts features for all images.
+    void getCandidateMatchesUsingRetrieval(int k = 20, bool resize = false);
+    // Same as retrieval but ranks through a vocabulary tree, which scales to multi flight projects.
+    // The tree in indexFile is reused when it exists and this flight's images are added to it.
+    void getCandidateMatchesUsingVocabularyTree(int k = 20, std::string indexFile = std::string(), bool resize = false);
     int extractFeatures(bool resize = false);
-    void runRobustFeatureMatching();
-    void buildKdTree();
+    void setMatchingMode(RobustMatcher::MatchingMode mode) { matchingMode_ = mode; }
+    // Accuracy/speed trade off of the kdForest matching mode
+    void setMaxComparisons(int maxComparisons) { maxComparisons_ = maxComparisons; }
+    void runRobustFeatureMatching(size_t featureCacheBytes = FEATURE_CACHE_BYTES);
     std::map<std::string, std::vector<std::string>> getCandidateImages() const;
     void plotMatches(std::string img1, std::string img2) const;
 };
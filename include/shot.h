@@ -10,27 +10,32 @@ struct ShotMetadata {
     int orientation;
     ShotMetadata();
     ShotMetadata(cv::Point3d gpsPosition, double dop, double captureTime, int orientation);
-    ShotMetadata(ImageMetadata imageExif, const FlightSession& flight);
+    ShotMetadata(const ImageMetadata& imageExif, const FlightSession& flight);
 };
 
+// Id of the camera a reconstruction is created with in its camera table
+const int DEFAULT_CAMERA_ID = 0;
+
+/*
+ * A shot refers to its camera by id in the camera table of its reconstruction, so shots of the
+ * same camera share its parameters and copying a shot copies no camera.
+ */
 class Shot {
     private:
         std::string imageName;
-        Camera camera;
+        int cameraId;
         Pose cameraPose;
         ShotMetadata metadata;
 
     public: 
-        Shot():imageName(), camera (), cameraPose(), metadata(){}
-        Shot(std::string imaeName, Camera camera, Pose pose) : imageName(imageName), camera(camera),
-            cameraPose(pose) {}
-        Shot(std::string image, Camera camera, Pose pose, ShotMetadata metadata) : imageName(image)
-            , camera(camera), cameraPose(pose), metadata(metadata) {}
-        std::string getId() const {return this->imageName;}
-        Camera getCamera() const {return this->camera;}
+        Shot():imageName(), cameraId(DEFAULT_CAMERA_ID), cameraPose(), metadata(){}
+        Shot(std::string image, int cameraId, Pose pose, ShotMetadata metadata = ShotMetadata()) : imageName(image)
+            , cameraId(cameraId), cameraPose(pose), metadata(metadata) {}
+        const std::string& getId() const {return this->imageName;}
+        int getCameraId() const { return this->cameraId; }
         const Pose& getPose() const {return this->cameraPose;}
         Pose& getPose() { return this->cameraPose; }
-        const ShotMetadata getMetadata() const { return metadata; }
+        const ShotMetadata& getMetadata() const { return metadata; }
         std::tuple<ShoRowVector3d, ShoRowVector3d, ShoRowVector3d> getOrientationVectors() const;
         friend std::ostream & operator << (std::ostream &out, const Pose &p); 
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/*
+ * Static kd-tree over 3D points, used to find the images taken near each other.
+ *
+ * The tree is built in one pass by recursive median splits of a flat array of points, so a
+ * node is just the middle element of a range of the array and no node is allocated. Points are
+ * expected in metres (topocentric coordinates of the flight) so distances are Euclidean.
+ * Queries are read only and can run from many threads, the batch queries do so with OpenMP.
+ */
+class SpatialIndex {
+private:
+    std::vector<cv::Point3d> points_;
+    // Original index of every reordered point
+    std::vector<int> ids_;
+    // Split axis of the range whose median is at the same position
+    std::vector<uint8_t> axes_;
+
+    void _build(size_t begin, size_t end);
+    void _radius(size_t begin, size_t end, const cv::Point3d& center, double squaredRadius, std::vector<int>& result) const;
+    void _nearest(size_t begin, size_t end, const cv::Point3d& center, size_t k,
+        std::vector<std::pair<double, int>>& heap, double& squaredBound) const;
+
+public:
+    SpatialIndex();
+    explicit SpatialIndex(const std::vector<cv::Point3d>& points);
+    size_t size() const { return points_.size(); }
+    // Indices of the points within radius of center, in no particular order
+    std::vector<int> radius(const cv::Point3d& center, double radius) const;
+    // Up to k closest points within maxDistance of center as (index, distance), closest first
+    std::vector<std::pair<int, double>> nearest(const cv::Point3d& center, int k,
+        double maxDistance = std::numeric_limits<double>::infinity()) const;
+    // Radius query around every center, in parallel
+    std::vector<std::vector<int>> radius(const std::vector<cv::Point3d>& centers, double radius) const;
+    // Nearest neighbour query around every center, in parallel
+    std::vector<std::vector<std::pair<int, double>>> nearest(const std::vector<cv::Point3d>& centers, int k,
+        double maxDistance = std::numeric_limits<double>::infinity()) const;
+};
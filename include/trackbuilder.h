@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+ * Builds feature tracks from pairwise matches using dense integer ids only.
+ *
+ * Features are numbered globally: the id of feature f of image i is featureOffset(i) + f, where
+ * the offsets are the prefix sum of the feature counts of the images. Matches are merged with a
+ * lock free union-find over these ids (parents are linked to the smaller root with a compare and
+ * swap, finds halve their path) so pairs can be added from many threads at once.
+ *
+ * A track is a set of at least minTrackLength matched features with at most one feature per
+ * image. Sets that have two features of the same image are inconsistent and are dropped.
+ */
+class TrackBuilder {
+private:
+    std::vector<uint32_t> featureOffsets_;
+    std::unique_ptr<std::atomic<uint32_t>[]> parents_;
+    std::unique_ptr<std::atomic<uint8_t>[]> matched_;
+    std::vector<uint32_t> trackOffsets_;
+    std::vector<uint32_t> trackFeatures_;
+
+    uint32_t _find(uint32_t feature) const;
+    void _unite(uint32_t a, uint32_t b);
+
+public:
+    TrackBuilder();
+    explicit TrackBuilder(const std::vector<size_t>& featureCounts);
+    size_t numImages() const { return featureOffsets_.size() - 1; }
+    size_t numFeatures() const { return featureOffsets_.back(); }
+    uint32_t featureOffset(int image) const { return featureOffsets_[image]; }
+    uint32_t featureId(int image, int feature) const { return featureOffsets_[image] + feature; }
+    // Image of a global feature id
+    int imageOf(uint32_t featureId) const;
+    int featureIndexOf(uint32_t featureId) const { return featureId - featureOffsets_[imageOf(featureId)]; }
+    // True when every feature index of the matches is within the feature count of its image
+    bool validMatches(int queryImage, int trainImage, const int32_t* queryIdx, const int32_t* trainIdx, size_t count) const;
+    // Merges the features of count matches between two images. Safe to call concurrently, never throws.
+    // Returns false and merges nothing when the matches are not valid.
+    bool addMatches(int queryImage, int trainImage, const int32_t* queryIdx, const int32_t* trainIdx, size_t count);
+    // Collects the consistent tracks from the merged matches
+    void buildTracks(int minTrackLength = 2);
+    size_t numTracks() const { return trackOffsets_.size() - 1; }
+    // Features of a track ordered by image
+    const uint32_t* trackBegin(size_t track) const { return trackFeatures_.data() + trackOffsets_[track]; }
+    const uint32_t* trackEnd(size_t track) const { return trackFeatures_.data() + trackOffsets_[track + 1]; }
+    size_t trackSize(size_t track) const { return trackOffsets_[track + 1] - trackOffsets_[track]; }
+};
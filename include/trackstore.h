@@ -0,0 +1,87 @@
+#pragma once
+
+#include "cameramodels.h"
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Bipartite graph of images and tracks with integer ids.
+ *
+ * Every edge is an observation: the feature of a track seen in an image. Observations are stored
+ * as a structure of arrays (image, track, feature index, x, y, scale and color) in track order, so
+ * the observations of track t are [trackBegin(t), trackEnd(t)). The observations of an image are
+ * reached through a second CSR index, ordered by track.
+ *
+ * Observations are added track by track and buildIndex() is called once they are all in. After
+ * that the store only shrinks: removeObservation marks an observation dead (a tombstone) and the
+ * iterating code skips it with isAlive, so the CSR arrays never have to be rebuilt.
+ *
+ * The bearings of the observations can be stored next to them, so they are computed once for the
+ * whole store instead of on every triangulation.
+ */
+class TrackStore {
+private:
+    std::vector<std::string> imageNames_;
+    std::unordered_map<std::string, int> imageIds_;
+
+    std::vector<int32_t> observationImage_;
+    std::vector<int32_t> observationTrack_;
+    std::vector<int32_t> observationFeature_;
+    std::vector<float> observationX_;
+    std::vector<float> observationY_;
+    std::vector<float> observationScale_;
+    std::vector<uint8_t> observationColor_;
+    std::vector<uint8_t> alive_;
+    Bearings bearings_;
+
+    std::vector<uint32_t> trackOffsets_;
+    std::vector<int32_t> trackDegree_;
+    std::vector<uint32_t> imageOffsets_;
+    std::vector<uint32_t> imageObservations_;
+
+public:
+    TrackStore();
+    // Returns the id of an image, adding it if it is new
+    int addImage(const std::string& imageName);
+    // Observations must be added in increasing track order, tracks are numbered from 0 without gaps
+    void addObservation(int track, int image, int feature, const cv::Point2f& point, float scale, const cv::Scalar& color);
+    // Builds the image to observation index, call once after the last observation was added
+    void buildIndex();
+
+    size_t numImages() const { return imageNames_.size(); }
+    size_t numTracks() const { return trackOffsets_.size() - 1; }
+    size_t numObservations() const { return observationImage_.size(); }
+    // Id of an image or -1 if the image has no observations
+    int imageId(const std::string& imageName) const;
+    const std::string& imageName(int image) const { return imageNames_[image]; }
+    const std::vector<std::string>& imageNames() const { return imageNames_; }
+
+    uint32_t trackBegin(int track) const { return trackOffsets_[track]; }
+    uint32_t trackEnd(int track) const { return trackOffsets_[track + 1]; }
+    // Number of observations of a track that are still alive
+    int trackDegree(int track) const { return trackDegree_[track]; }
+    // Observations of an image in track order, the range of an unknown image (-1) is empty
+    const uint32_t* imageBegin(int image) const { return imageObservations_.data() + (image < 0 ? 0 : imageOffsets_[image]); }
+    const uint32_t* imageEnd(int image) const { return imageObservations_.data() + (image < 0 ? 0 : imageOffsets_[image + 1]); }
+
+    bool isAlive(uint32_t observation) const { return alive_[observation] != 0; }
+    int image(uint32_t observation) const { return observationImage_[observation]; }
+    int track(uint32_t observation) const { return observationTrack_[observation]; }
+    int feature(uint32_t observation) const { return observationFeature_[observation]; }
+    cv::Point2d point(uint32_t observation) const { return { observationX_[observation], observationY_[observation] }; }
+    double scale(uint32_t observation) const { return observationScale_[observation]; }
+    cv::Scalar color(uint32_t observation) const;
+    // The alive observation of a track in an image or -1
+    int64_t findObservation(int track, int image) const;
+    void removeObservation(uint32_t observation);
+    // Normalized image coordinates of all the observations, in observation order
+    ImagePoints observationPoints() const;
+    // Stores the bearing of every observation, in observation order
+    void setBearings(Bearings bearings);
+    const Bearings& bearings() const { return bearings_; }
+    // Removes every observation of a track
+    void removeTrack(int track);
+};
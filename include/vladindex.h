@@ -0,0 +1,44 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Global image descriptors for candidate pair selection when there is no GPS.
+ *
+ * A k-means vocabulary (vlfeat) is trained on a sample of local descriptors and every image is
+ * summarised by its VLAD vector: the residuals of its descriptors to their nearest visual word,
+ * square rooted and L2 normalised. Images that look alike have a large dot product between their
+ * VLAD vectors. Binary descriptors are unpacked to one float per bit first.
+ */
+class VladIndex {
+private:
+    int numWords_;
+    int dimension_;
+    std::vector<float> words_;
+    std::vector<std::string> imageNames_;
+    std::vector<float> encodings_;
+
+    std::vector<float> _encode(const cv::Mat& descriptors) const;
+    // One row per image over encodings_
+    cv::Mat _encodingMatrix() const;
+
+public:
+    static const int DEFAULT_NUM_WORDS = 64;
+
+    explicit VladIndex(int numWords = DEFAULT_NUM_WORDS);
+    // Trains the vocabulary on the rows of samples (any descriptor type, see toFloatDescriptors)
+    void train(const cv::Mat& samples);
+    bool isTrained() const { return !words_.empty(); }
+    void add(const std::string& imageName, const cv::Mat& descriptors);
+    size_t size() const { return imageNames_.size(); }
+    // The k most similar indexed images to the image at imageIndex, best first
+    std::vector<std::pair<int, float>> query(int imageIndex, int k) const;
+    // query for every image at once, the similarities come from one matrix product per block of images
+    std::vector<std::vector<std::pair<int, float>>> queryAll(int k) const;
+    const std::string& getImageName(int imageIndex) const { return imageNames_[imageIndex]; }
+    // CV_32F copy of descriptors, CV_8U descriptors are unpacked to one float per bit
+    static cv::Mat toFloatDescriptors(const cv::Mat& descriptors);
+};
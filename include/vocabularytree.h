@@ -0,0 +1,122 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Vocabulary tree image retrieval for projects too large for a flat VladIndex scan.
+ *
+ * A hierarchical integer k-means tree (vlfeat hikmeans) quantizes every descriptor to one of its
+ * leaves, the visual words. Each indexed image is a bag of words and every word keeps an inverted
+ * list of the images it occurs in. A query only visits the lists of its own words, scoring images
+ * by the cosine of their TF-IDF weighted word histograms, so the cost depends on how many images
+ * share words with the query rather than on the size of the index.
+ *
+ * The tree and the bags of words persist to a single binary file. The inverted lists and the
+ * TF-IDF weights are derived from the bags when loading, so images of new flights can be added to
+ * a saved index without retraining it. Drone file names repeat from one flight to the next, so an
+ * index shared by several flights keys its images with imageKey rather than by file name.
+ */
+const uint32_t VOCABULARY_FILE_MAGIC = 0x54565348; // "HSVT"
+const uint32_t VOCABULARY_FILE_VERSION = 1;
+
+struct VocabularyFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t branching;
+    uint32_t depth;
+    uint32_t dimension;
+    uint32_t numNodes;
+    uint32_t numCenters;
+    uint32_t numWords;
+    uint64_t numImages;
+    uint64_t numTerms;
+};
+
+class VocabularyTree {
+public:
+    struct Term {
+        uint32_t word;
+        uint32_t count;
+    };
+
+private:
+    struct Posting {
+        uint32_t image;
+        uint32_t count;
+    };
+
+    int branching_;
+    int depth_;
+    int dimension_;
+    uint32_t numWords_;
+    // Node i owns the centers [nodeFirstCenter_[i], nodeFirstCenter_[i] + nodeNumCenters_[i])
+    std::vector<uint32_t> nodeFirstCenter_;
+    std::vector<uint32_t> nodeNumCenters_;
+    std::vector<int32_t> centers_;
+    // Child node of a center, or -(word + 1) when the center is a leaf
+    std::vector<int32_t> centerNext_;
+
+    std::vector<std::string> imageNames_;
+    std::unordered_map<std::string, int> imageIds_;
+    // Bag of words of image i is imageTerms_[imageTermOffsets_[i], imageTermOffsets_[i + 1])
+    std::vector<uint64_t> imageTermOffsets_;
+    std::vector<Term> imageTerms_;
+    std::vector<std::vector<Posting>> invertedLists_;
+
+    mutable std::mutex weightsMutex_;
+    mutable bool weightsDirty_;
+    mutable std::vector<float> idf_;
+    mutable std::vector<float> imageNorms_;
+
+    int _flatten(const void* node);
+    uint32_t _quantizeOne(const uint8_t* descriptor) const;
+    void _updateWeights() const;
+    void _addTerms(const std::string& imageName, const std::vector<Term>& terms);
+    std::vector<std::pair<int, float>> _score(const std::vector<Term>& terms, int k, int exclude,
+        const std::function<bool(int)>& accept) const;
+
+public:
+    static const int DEFAULT_BRANCHING = 10;
+    static const int DEFAULT_DEPTH = 4;
+
+    VocabularyTree(int branching = DEFAULT_BRANCHING, int depth = DEFAULT_DEPTH);
+    // Trains the tree on the rows of samples (any descriptor type, see toByteDescriptors). Clears the index.
+    void train(const cv::Mat& samples);
+    bool isTrained() const { return numWords_ > 0; }
+    uint32_t numWords() const { return numWords_; }
+    // Length of the byte descriptors the tree was trained on
+    int dimension() const { return dimension_; }
+    // Visual word of every row of descriptors, which must have the dimension of the tree once converted
+    std::vector<uint32_t> quantize(const cv::Mat& descriptors) const;
+    // Bag of words of descriptors sorted by word
+    std::vector<Term> bagOfWords(const cv::Mat& descriptors) const;
+    // Indexes an image and returns its index. An image that is already indexed is left unchanged.
+    int add(const std::string& imageName, const cv::Mat& descriptors);
+    size_t size() const { return imageNames_.size(); }
+    // Index of an image or -1 if it is not indexed
+    int find(const std::string& imageName) const;
+    const std::string& getImageName(int imageIndex) const { return imageNames_[imageIndex]; }
+    // The k most similar indexed images to the image at imageIndex, best first. Only images for
+    // which accept returns true are ranked when it is given.
+    std::vector<std::pair<int, float>> query(int imageIndex, int k,
+        const std::function<bool(int)>& accept = nullptr) const;
+    // The k most similar indexed images to an image that is not in the index
+    std::vector<std::pair<int, float>> query(const cv::Mat& descriptors, int k,
+        const std::function<bool(int)>& accept = nullptr) const;
+    bool save(const std::string& indexFile) const;
+    // Replaces this tree with the one saved in indexFile. Returns false and leaves the tree unchanged on failure.
+    bool load(const std::string& indexFile);
+    // CV_8U descriptors for the integer tree. Float descriptors are L2 normalised, scaled by 512 and
+    // clamped to a byte like the uint8 SIFT descriptors of vlfeat, CV_8U descriptors are binary and
+    // are unpacked to 0 or 255 per bit.
+    static cv::Mat toByteDescriptors(const cv::Mat& descriptors);
+    // Name of an image of a flight in an index shared by several flights
+    static std::string imageKey(const std::string& flightDirectory, const std::string& imageName);
+};
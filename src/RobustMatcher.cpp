@@ -7,6 +7,8 @@
 
 #include "RobustMatcher.h"
 #include "HahogFeatureDetector.h"
+#include "simdmatcher.h"
+#include <cmath>
 #include <iostream>
 #include <time.h>
 #include <opencv2/cudafeatures2d.hpp>
@@ -306,6 +308,17 @@ void RobustMatcher::robustMatch(
     std::vector<cv::DMatch>& matches
 )
 {
+    if (matchingMode_ == MatchingMode::kdForest && descriptors1.type() == CV_32F) {
+        const auto index1 = KdForestIndex::build(descriptors1, KdForestIndex::DEFAULT_NUM_TREES, maxComparisons_);
+        const auto index2 = KdForestIndex::build(descriptors2, KdForestIndex::DEFAULT_NUM_TREES, maxComparisons_);
+        if (index1 && index2) {
+            forestRobustMatch(*index1, *index2, matches);
+            return;
+        }
+    }
+    if (matchingMode_ != MatchingMode::bruteForce && simdRobustMatch(descriptors1, descriptors2, matches))
+        return;
+
     std::vector<std::vector<cv::DMatch>> matches12, matches21;
 
     // Symmetric matching using two nearest neighbours. Use CUDA if available
@@ -339,6 +352,69 @@ void RobustMatcher::robustMatch(
   symmetryTest(matches12, matches21, matches);
 }
 
+bool RobustMatcher::simdRobustMatch(
+    const cv::Mat &descriptors1,
+    const cv::Mat &descriptors2,
+    std::vector<cv::DMatch> &matches
+) const
+{
+    const auto type = descriptors1.type();
+    if (type != descriptors2.type() || descriptors1.cols != descriptors2.cols || (type != CV_8U && type != CV_32F))
+        return false;
+
+    //Appended like the symmetry test of the BFMatcher path, callers may collect several pairs in one vector
+    if (descriptors1.empty() || descriptors2.empty())
+        return true;
+
+    std::vector<SimdMatch> simdMatches;
+    if (type == CV_8U) {
+        simdMatchHamming(
+            descriptors1.ptr<uint8_t>(), descriptors1.step[0], descriptors1.rows,
+            descriptors2.ptr<uint8_t>(), descriptors2.step[0], descriptors2.rows,
+            descriptors1.cols, ratio_, simdMatches);
+    }
+    else {
+        simdMatchL2(
+            descriptors1.ptr<float>(), descriptors1.step[0] / sizeof(float), descriptors1.rows,
+            descriptors2.ptr<float>(), descriptors2.step[0] / sizeof(float), descriptors2.rows,
+            descriptors1.cols, ratio_, simdMatches);
+    }
+
+    matches.reserve(matches.size() + simdMatches.size());
+    for (const auto& match : simdMatches) {
+        matches.push_back(cv::DMatch(match.queryIdx, match.trainIdx, match.distance));
+    }
+    return true;
+}
+
+void RobustMatcher::forestRobustMatch(
+    const KdForestIndex &index1,
+    const KdForestIndex &index2,
+    std::vector<cv::DMatch> &matches
+) const
+{
+    std::vector<ForestNeighbours> matches12, matches21;
+    index2.searchTwoNearest(index1.getDescriptors(), matches12);
+    index1.searchTwoNearest(index2.getDescriptors(), matches21);
+
+    // Forest distances are squared so the ratio is squared as well
+    const auto squaredRatio = ratio_ * ratio_;
+    const auto passesRatio = [squaredRatio](const ForestNeighbours &n) {
+        return n.index >= 0 && n.distance <= squaredRatio * n.secondDistance;
+    };
+
+    for (size_t i = 0; i < matches12.size(); ++i) {
+        const auto &forward = matches12[i];
+        if (!passesRatio(forward))
+            continue;
+
+        const auto &backward = matches21[forward.index];
+        if (backward.index == static_cast<int>(i) && passesRatio(backward)) {
+            matches.push_back(cv::DMatch(static_cast<int>(i), forward.index, std::sqrt(forward.distance)));
+        }
+    }
+}
+
 void RobustMatcher::fastRobustMatch(
     const cv::Mat queryImg, 
     std::vector<cv::DMatch>& goodMatches, 
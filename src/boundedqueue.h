@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Fixed capacity queue used to connect the stages of a pipeline. push blocks while the
+// queue is full so a fast stage cannot run ahead of a slow one and hold every image in
+// memory. Once close() is called pop drains the remaining items and then returns false.
+template <typename T>
+class BoundedQueue {
+private:
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_;
+    std::mutex mutex_;
+    std::condition_variable notFull_;
+    std::condition_variable notEmpty_;
+
+public:
+    explicit BoundedQueue(size_t capacity) : items_(), capacity_(capacity), closed_(false) {}
+
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_)
+            return false;
+
+        items_.push_back(std::move(item));
+        lock.unlock();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notEmpty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty())
+            return false;
+
+        item = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+};
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <Eigen/Eigen>
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+#include "../../bootstrap.h"
+
+// Reprojection errors with hand derived jacobians.
+//
+// They compute the same residuals as the autodiff functors of projection_errors.h
+// without dual numbers. A camera model provides the projection of a point in camera
+// coordinates together with its derivatives with respect to that point and to the
+// camera parameters, and the cost functions below chain them with the derivatives
+// of the world to camera transform. The model is a template argument so the whole
+// evaluation is specialized at compile time.
+
+typedef Eigen::Matrix<double, 2, 3, Eigen::RowMajor> ProjectionPointJacobian;
+
+// Derivatives of R(w) * x with respect to the angle axis vector w, where
+// rotated = R(w) * x. Uses d(R(w) x)/dw = -[R(w) x]_x * J(w) with J the left
+// jacobian of SO(3).
+inline Eigen::Matrix3d AngleAxisRotatePointJacobian(const double* const angle_axis,
+                                                    const Eigen::Vector3d& rotated) {
+  const Eigen::Map<const Eigen::Vector3d> w(angle_axis);
+  const double theta2 = w.squaredNorm();
+
+  Eigen::Matrix3d w_hat;
+  w_hat << 0, -w(2), w(1),
+           w(2), 0, -w(0),
+           -w(1), w(0), 0;
+  double a, b;
+  if (theta2 > std::numeric_limits<double>::epsilon()) {
+    const double theta = sqrt(theta2);
+    a = (1.0 - cos(theta)) / theta2;
+    b = (theta - sin(theta)) / (theta2 * theta);
+  } else {
+    a = 0.5;
+    b = 1.0 / 6.0;
+  }
+  const Eigen::Matrix3d left_jacobian =
+      Eigen::Matrix3d::Identity() + a * w_hat + b * w_hat * w_hat;
+
+  Eigen::Matrix3d rotated_hat;
+  rotated_hat << 0, -rotated(2), rotated(1),
+                 rotated(2), 0, -rotated(0),
+                 -rotated(1), rotated(0), 0;
+  return -rotated_hat * left_jacobian;
+}
+
+struct PerspectiveCameraModel {
+  static constexpr int kNumParameters = BA_CAMERA_NUM_PARAMS;
+
+  // d_point and d_camera are row major, either may be null
+  static void Project(const double* const camera,
+                      const double point[3],
+                      double projection[2],
+                      double* d_point,
+                      double* d_camera) {
+    const double xp = point[0] / point[2];
+    const double yp = point[1] / point[2];
+    const double focal = camera[BA_CAMERA_FOCAL];
+    const double k1 = camera[BA_CAMERA_K1];
+    const double k2 = camera[BA_CAMERA_K2];
+    const double r2 = xp * xp + yp * yp;
+    const double distortion = 1.0 + r2 * (k1 + r2 * k2);
+
+    projection[0] = focal * distortion * xp;
+    projection[1] = focal * distortion * yp;
+
+    if (d_point) {
+      // d(projection)/d(xp, yp) times d(xp, yp)/d(point)
+      const double d_distortion = 2.0 * (k1 + 2.0 * k2 * r2);
+      const double dxx = focal * (distortion + d_distortion * xp * xp);
+      const double dxy = focal * d_distortion * xp * yp;
+      const double dyy = focal * (distortion + d_distortion * yp * yp);
+      const double inverse_z = 1.0 / point[2];
+      d_point[0] = dxx * inverse_z;
+      d_point[1] = dxy * inverse_z;
+      d_point[2] = -(dxx * xp + dxy * yp) * inverse_z;
+      d_point[3] = dxy * inverse_z;
+      d_point[4] = dyy * inverse_z;
+      d_point[5] = -(dxy * xp + dyy * yp) * inverse_z;
+    }
+    if (d_camera) {
+      d_camera[BA_CAMERA_FOCAL] = distortion * xp;
+      d_camera[BA_CAMERA_K1] = focal * r2 * xp;
+      d_camera[BA_CAMERA_K2] = focal * r2 * r2 * xp;
+      d_camera[kNumParameters + BA_CAMERA_FOCAL] = distortion * yp;
+      d_camera[kNumParameters + BA_CAMERA_K1] = focal * r2 * yp;
+      d_camera[kNumParameters + BA_CAMERA_K2] = focal * r2 * r2 * yp;
+    }
+  }
+};
+
+struct BrownPerspectiveCameraModel {
+  static constexpr int kNumParameters = BA_BROWN_CAMERA_NUM_PARAMS;
+
+  static void Project(const double* const camera,
+                      const double point[3],
+                      double projection[2],
+                      double* d_point,
+                      double* d_camera) {
+    const double xp = point[0] / point[2];
+    const double yp = point[1] / point[2];
+    const double focal_x = camera[BA_BROWN_CAMERA_FOCAL_X];
+    const double focal_y = camera[BA_BROWN_CAMERA_FOCAL_Y];
+    const double k1 = camera[BA_BROWN_CAMERA_K1];
+    const double k2 = camera[BA_BROWN_CAMERA_K2];
+    const double p1 = camera[BA_BROWN_CAMERA_P1];
+    const double p2 = camera[BA_BROWN_CAMERA_P2];
+    const double k3 = camera[BA_BROWN_CAMERA_K3];
+    const double r2 = xp * xp + yp * yp;
+    const double radial_distortion = 1.0 + r2 * (k1 + r2 * (k2 + r2 * k3));
+    const double x_distorted = xp * radial_distortion + 2.0 * p1 * xp * yp + p2 * (r2 + 2.0 * xp * xp);
+    const double y_distorted = yp * radial_distortion + p1 * (r2 + 2.0 * yp * yp) + 2.0 * p2 * xp * yp;
+
+    projection[0] = focal_x * x_distorted + camera[BA_BROWN_CAMERA_C_X];
+    projection[1] = focal_y * y_distorted + camera[BA_BROWN_CAMERA_C_Y];
+
+    if (d_point) {
+      const double d_radial = k1 + r2 * (2.0 * k2 + 3.0 * k3 * r2);
+      const double dxx = focal_x * (radial_distortion + 2.0 * xp * xp * d_radial + 2.0 * p1 * yp + 6.0 * p2 * xp);
+      const double dxy = focal_x * (2.0 * xp * yp * d_radial + 2.0 * p1 * xp + 2.0 * p2 * yp);
+      const double dyx = focal_y * (2.0 * xp * yp * d_radial + 2.0 * p1 * xp + 2.0 * p2 * yp);
+      const double dyy = focal_y * (radial_distortion + 2.0 * yp * yp * d_radial + 6.0 * p1 * yp + 2.0 * p2 * xp);
+      const double inverse_z = 1.0 / point[2];
+      d_point[0] = dxx * inverse_z;
+      d_point[1] = dxy * inverse_z;
+      d_point[2] = -(dxx * xp + dxy * yp) * inverse_z;
+      d_point[3] = dyx * inverse_z;
+      d_point[4] = dyy * inverse_z;
+      d_point[5] = -(dyx * xp + dyy * yp) * inverse_z;
+    }
+    if (d_camera) {
+      double* d_x = d_camera;
+      double* d_y = d_camera + kNumParameters;
+      d_x[BA_BROWN_CAMERA_FOCAL_X] = x_distorted;
+      d_x[BA_BROWN_CAMERA_FOCAL_Y] = 0.0;
+      d_x[BA_BROWN_CAMERA_C_X] = 1.0;
+      d_x[BA_BROWN_CAMERA_C_Y] = 0.0;
+      d_x[BA_BROWN_CAMERA_K1] = focal_x * xp * r2;
+      d_x[BA_BROWN_CAMERA_K2] = focal_x * xp * r2 * r2;
+      d_x[BA_BROWN_CAMERA_P1] = focal_x * 2.0 * xp * yp;
+      d_x[BA_BROWN_CAMERA_P2] = focal_x * (r2 + 2.0 * xp * xp);
+      d_x[BA_BROWN_CAMERA_K3] = focal_x * xp * r2 * r2 * r2;
+      d_y[BA_BROWN_CAMERA_FOCAL_X] = 0.0;
+      d_y[BA_BROWN_CAMERA_FOCAL_Y] = y_distorted;
+      d_y[BA_BROWN_CAMERA_C_X] = 0.0;
+      d_y[BA_BROWN_CAMERA_C_Y] = 1.0;
+      d_y[BA_BROWN_CAMERA_K1] = focal_y * yp * r2;
+      d_y[BA_BROWN_CAMERA_K2] = focal_y * yp * r2 * r2;
+      d_y[BA_BROWN_CAMERA_P1] = focal_y * (r2 + 2.0 * yp * yp);
+      d_y[BA_BROWN_CAMERA_P2] = focal_y * 2.0 * xp * yp;
+      d_y[BA_BROWN_CAMERA_K3] = focal_y * yp * r2 * r2 * r2;
+    }
+  }
+};
+
+struct FisheyeCameraModel {
+  static constexpr int kNumParameters = BA_CAMERA_NUM_PARAMS;
+
+  static void Project(const double* const camera,
+                      const double point[3],
+                      double projection[2],
+                      double* d_point,
+                      double* d_camera) {
+    const double x = point[0];
+    const double y = point[1];
+    const double z = point[2];
+    const double focal = camera[BA_CAMERA_FOCAL];
+    const double k1 = camera[BA_CAMERA_K1];
+    const double k2 = camera[BA_CAMERA_K2];
+    const double l2 = x * x + y * y;
+    const double l = sqrt(l2);
+    const double theta = atan2(l, z);
+    const double theta2 = theta * theta;
+    const double theta_d = theta * (1.0 + theta2 * (k1 + theta2 * k2));
+    const double s = focal * theta_d / l;
+
+    projection[0] = s * x;
+    projection[1] = s * y;
+
+    if (d_point) {
+      // s depends on the point through l and theta
+      const double d_theta_d = 1.0 + theta2 * (3.0 * k1 + 5.0 * k2 * theta2);
+      const double norm2 = l2 + z * z;
+      const double d_theta_dl = z / norm2;
+      const double d_theta_dz = -l / norm2;
+      const double d_s_dl = focal * (d_theta_d * d_theta_dl / l - theta_d / l2);
+      const double d_s_dz = focal * d_theta_d * d_theta_dz / l;
+      const double d_s_dx = d_s_dl * x / l;
+      const double d_s_dy = d_s_dl * y / l;
+      d_point[0] = s + x * d_s_dx;
+      d_point[1] = x * d_s_dy;
+      d_point[2] = x * d_s_dz;
+      d_point[3] = y * d_s_dx;
+      d_point[4] = s + y * d_s_dy;
+      d_point[5] = y * d_s_dz;
+    }
+    if (d_camera) {
+      const double theta3 = theta2 * theta;
+      d_camera[BA_CAMERA_FOCAL] = theta_d / l * x;
+      d_camera[BA_CAMERA_K1] = focal * theta3 / l * x;
+      d_camera[BA_CAMERA_K2] = focal * theta3 * theta2 / l * x;
+      d_camera[kNumParameters + BA_CAMERA_FOCAL] = theta_d / l * y;
+      d_camera[kNumParameters + BA_CAMERA_K1] = focal * theta3 / l * y;
+      d_camera[kNumParameters + BA_CAMERA_K2] = focal * theta3 * theta2 / l * y;
+    }
+  }
+};
+
+// Shared evaluation of the camera models: rotation and translation jacobians are
+// written to their own row major 2x3 blocks, any output may be null
+template <class CameraModel>
+bool EvaluateAnalyticReprojection(const double* const camera,
+                                  const double* const rotation,
+                                  const double* const translation,
+                                  const double* const point,
+                                  double observed_x,
+                                  double observed_y,
+                                  double scale,
+                                  double* residuals,
+                                  double* d_camera,
+                                  double* d_rotation,
+                                  double* d_translation,
+                                  double* d_point) {
+  double camera_point[3];
+  ceres::AngleAxisRotatePoint(rotation, point, camera_point);
+  const Eigen::Vector3d rotated(camera_point[0], camera_point[1], camera_point[2]);
+  camera_point[0] += translation[0];
+  camera_point[1] += translation[1];
+  camera_point[2] += translation[2];
+
+  double projection[2];
+  ProjectionPointJacobian d_projection;
+  const bool need_point_jacobian = d_rotation || d_translation || d_point;
+  CameraModel::Project(camera, camera_point, projection,
+                       need_point_jacobian ? d_projection.data() : NULL,
+                       d_camera);
+  residuals[0] = scale * (projection[0] - observed_x);
+  residuals[1] = scale * (projection[1] - observed_y);
+
+  if (d_camera) {
+    for (int i = 0; i < 2 * CameraModel::kNumParameters; ++i) {
+      d_camera[i] *= scale;
+    }
+  }
+  if (!need_point_jacobian) {
+    return true;
+  }
+
+  d_projection *= scale;
+  if (d_translation) {
+    Eigen::Map<ProjectionPointJacobian> jacobian(d_translation);
+    jacobian = d_projection;
+  }
+  if (d_rotation) {
+    Eigen::Map<ProjectionPointJacobian> jacobian(d_rotation);
+    jacobian = d_projection * AngleAxisRotatePointJacobian(rotation, rotated);
+  }
+  if (d_point) {
+    Eigen::Matrix3d r;
+    ceres::AngleAxisToRotationMatrix(rotation, ceres::ColumnMajorAdapter3x3(r.data()));
+    Eigen::Map<ProjectionPointJacobian> jacobian(d_point);
+    jacobian = d_projection * r;
+  }
+  return true;
+}
+
+// Analytic counterpart of PerspectiveReprojectionError, BrownPerspectiveReprojectionError
+// and FisheyeReprojectionError over the camera, the 6 parameters shot and the point
+template <class CameraModel>
+class AnalyticReprojectionError
+    : public ceres::SizedCostFunction<2, CameraModel::kNumParameters, BA_SHOT_NUM_PARAMS, 3> {
+ public:
+  AnalyticReprojectionError(double observed_x, double observed_y, double std_deviation)
+      : observed_x_(observed_x)
+      , observed_y_(observed_y)
+      , scale_(1.0 / std_deviation)
+  {}
+
+  bool Evaluate(double const* const* parameters,
+                double* residuals,
+                double** jacobians) const override {
+    const double* shot = parameters[1];
+    if (!jacobians || !jacobians[1]) {
+      return EvaluateAnalyticReprojection<CameraModel>(
+          parameters[0], shot + BA_SHOT_RX, shot + BA_SHOT_TX, parameters[2],
+          observed_x_, observed_y_, scale_, residuals,
+          jacobians ? jacobians[0] : NULL, NULL, NULL,
+          jacobians ? jacobians[2] : NULL);
+    }
+
+    double d_rotation[6];
+    double d_translation[6];
+    EvaluateAnalyticReprojection<CameraModel>(
+        parameters[0], shot + BA_SHOT_RX, shot + BA_SHOT_TX, parameters[2],
+        observed_x_, observed_y_, scale_, residuals,
+        jacobians[0], d_rotation, d_translation, jacobians[2]);
+    for (int row = 0; row < 2; ++row) {
+      for (int i = 0; i < 3; ++i) {
+        jacobians[1][row * BA_SHOT_NUM_PARAMS + BA_SHOT_RX + i] = d_rotation[row * 3 + i];
+        jacobians[1][row * BA_SHOT_NUM_PARAMS + BA_SHOT_TX + i] = d_translation[row * 3 + i];
+      }
+    }
+    return true;
+  }
+
+ private:
+  double observed_x_;
+  double observed_y_;
+  double scale_;
+};
+
+// Same residual with the rotation and the translation of the shot as separate blocks
+template <class CameraModel>
+class AnalyticPoseReprojectionError
+    : public ceres::SizedCostFunction<2, CameraModel::kNumParameters, 3, 3, 3> {
+ public:
+  AnalyticPoseReprojectionError(double observed_x, double observed_y, double std_deviation)
+      : observed_x_(observed_x)
+      , observed_y_(observed_y)
+      , scale_(1.0 / std_deviation)
+  {}
+
+  bool Evaluate(double const* const* parameters,
+                double* residuals,
+                double** jacobians) const override {
+    return EvaluateAnalyticReprojection<CameraModel>(
+        parameters[0], parameters[1], parameters[2], parameters[3],
+        observed_x_, observed_y_, scale_, residuals,
+        jacobians ? jacobians[0] : NULL,
+        jacobians ? jacobians[1] : NULL,
+        jacobians ? jacobians[2] : NULL,
+        jacobians ? jacobians[3] : NULL);
+  }
+
+ private:
+  double observed_x_;
+  double observed_y_;
+  double scale_;
+};
+
+// Analytic counterpart of EquirectangularReprojectionError, the camera has no parameters
+class AnalyticEquirectangularReprojectionError
+    : public ceres::SizedCostFunction<3, BA_SHOT_NUM_PARAMS, 3> {
+ public:
+  AnalyticEquirectangularReprojectionError(double observed_x, double observed_y, double std_deviation)
+      : scale_(1.0 / std_deviation)
+  {
+    const double lon = observed_x * 2 * M_PI;
+    const double lat = -observed_y * 2 * M_PI;
+    bearing_vector_ << cos(lat) * sin(lon), -sin(lat), cos(lat) * cos(lon);
+  }
+
+  bool Evaluate(double const* const* parameters,
+                double* residuals,
+                double** jacobians) const override {
+    const double* shot = parameters[0];
+    const double* point = parameters[1];
+    double rotated[3];
+    ceres::AngleAxisRotatePoint(shot + BA_SHOT_RX, point, rotated);
+    const Eigen::Vector3d p(rotated[0] + shot[BA_SHOT_TX],
+                            rotated[1] + shot[BA_SHOT_TY],
+                            rotated[2] + shot[BA_SHOT_TZ]);
+    const double l = p.norm();
+    const Eigen::Vector3d unit = p / l;
+    Eigen::Map<Eigen::Vector3d> residual(residuals);
+    residual = scale_ * (unit - bearing_vector_);
+
+    if (!jacobians || (!jacobians[0] && !jacobians[1])) {
+      return true;
+    }
+
+    // Derivative of the normalization
+    const Eigen::Matrix3d d_unit =
+        scale_ / l * (Eigen::Matrix3d::Identity() - unit * unit.transpose());
+    typedef Eigen::Matrix<double, 3, 3, Eigen::RowMajor> RowMajorMatrix3d;
+    if (jacobians[0]) {
+      Eigen::Map<Eigen::Matrix<double, 3, BA_SHOT_NUM_PARAMS, Eigen::RowMajor> > d_shot(jacobians[0]);
+      d_shot.block<3, 3>(0, BA_SHOT_RX) = d_unit * AngleAxisRotatePointJacobian(
+          shot + BA_SHOT_RX, Eigen::Vector3d(rotated[0], rotated[1], rotated[2]));
+      d_shot.block<3, 3>(0, BA_SHOT_TX) = d_unit;
+    }
+    if (jacobians[1]) {
+      Eigen::Matrix3d r;
+      ceres::AngleAxisToRotationMatrix(shot + BA_SHOT_RX, ceres::ColumnMajorAdapter3x3(r.data()));
+      Eigen::Map<RowMajorMatrix3d> d_point(jacobians[1]);
+      d_point = d_unit * r;
+    }
+    return true;
+  }
+
+ private:
+  Eigen::Vector3d bearing_vector_;
+  double scale_;
+};
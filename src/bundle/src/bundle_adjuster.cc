@@ -4,6 +4,12 @@
 #include "motion_prior_terms.h"
 #include "relative_motion_terms.h"
 #include "projection_errors.h"
+#include "analytic_projection_errors.h"
+
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include <unordered_map>
 
 BundleAdjuster::BundleAdjuster() {
   SetPointProjectionLossFunction("CauchyLoss", 1.0);
@@ -335,6 +341,79 @@ void BundleAdjuster::AddPointPositionWorld(const std::string &point_id,
   point_positions_world_.push_back(a);
 }
 
+void BundleAdjuster::ReserveIndexed(int num_shots,
+                                    int num_points,
+                                    int num_observations) {
+  indexed_shot_parameters_.reserve(num_shots * BA_SHOT_NUM_PARAMS);
+  indexed_shot_camera_.reserve(num_shots);
+  indexed_shot_constant_.reserve(num_shots);
+  indexed_point_parameters_.reserve(num_points * 3);
+  indexed_point_constant_.reserve(num_points);
+  indexed_observation_shot_.reserve(num_observations);
+  indexed_observation_point_.reserve(num_observations);
+  indexed_observation_coordinates_.reserve(num_observations * 2);
+  indexed_observation_std_deviation_.reserve(num_observations);
+}
+
+int BundleAdjuster::AddIndexedPerspectiveCamera(
+    double focal,
+    double k1,
+    double k2,
+    double focal_prior,
+    double k1_prior,
+    double k2_prior,
+    bool constant) {
+  indexed_camera_parameters_.insert(indexed_camera_parameters_.end(),
+                                    {focal, k1, k2});
+  indexed_camera_priors_.insert(indexed_camera_priors_.end(),
+                                {focal_prior, k1_prior, k2_prior});
+  indexed_camera_constant_.push_back(constant);
+  return indexed_camera_constant_.size() - 1;
+}
+
+int BundleAdjuster::AddIndexedShot(int camera,
+                                   const Eigen::Vector3d& rotation,
+                                   const Eigen::Vector3d& translation,
+                                   bool constant) {
+  indexed_shot_parameters_.insert(indexed_shot_parameters_.end(),
+                                  rotation.data(), rotation.data() + 3);
+  indexed_shot_parameters_.insert(indexed_shot_parameters_.end(),
+                                  translation.data(), translation.data() + 3);
+  indexed_shot_camera_.push_back(camera);
+  indexed_shot_constant_.push_back(constant);
+  return indexed_shot_camera_.size() - 1;
+}
+
+int BundleAdjuster::AddIndexedPoint(const Eigen::Vector3d& position,
+                                    bool constant) {
+  indexed_point_parameters_.insert(indexed_point_parameters_.end(),
+                                   position.data(), position.data() + 3);
+  indexed_point_constant_.push_back(constant);
+  return indexed_point_constant_.size() - 1;
+}
+
+int BundleAdjuster::AddIndexedPointProjectionObservation(int shot,
+                                                         int point,
+                                                         double x,
+                                                         double y,
+                                                         double std_deviation) {
+  indexed_observation_shot_.push_back(shot);
+  indexed_observation_point_.push_back(point);
+  indexed_observation_coordinates_.push_back(x);
+  indexed_observation_coordinates_.push_back(y);
+  indexed_observation_std_deviation_.push_back(std_deviation);
+  return indexed_observation_shot_.size() - 1;
+}
+
+void BundleAdjuster::AddIndexedPositionPrior(int shot,
+                                             const Eigen::Vector3d& position,
+                                             double std_deviation) {
+  indexed_position_prior_shot_.push_back(shot);
+  indexed_position_priors_.insert(indexed_position_priors_.end(),
+                                  {position.x(), position.y(), position.z(),
+                                   std_deviation});
+}
+
 void BundleAdjuster::SetPointProjectionLossFunction(std::string name,
                                                         double threshold) {
   point_projection_loss_name_ = name;
@@ -423,6 +502,175 @@ ceres::LinearSolverType LinearSolverTypeFromNamae(std::string name) {
   return ceres::SPARSE_SCHUR;
 }
 
+namespace {
+// Up to this many shots the reduced camera matrix is small enough to factor densely
+const int kDenseSchurMaxShots = 100;
+// Above this many shots the sparse factorization of the reduced camera matrix gets
+// expensive and the iterative solver wins
+const int kSparseSchurMaxShots = 1000;
+// Visibility graphs sparser than this are well approximated by the clusters of the
+// visibility based preconditioner
+const double kClusterJacobiMaxDensity = 0.05;
+// Residual blocks per thread, fewer are not worth the thread overhead
+const long long kObservationsPerThread = 10000;
+}  // namespace
+
+BALinearAlgebra AvailableLinearAlgebra() {
+  BALinearAlgebra available;
+  available.suite_sparse =
+      ceres::IsSparseLinearAlgebraLibraryTypeAvailable(ceres::SUITE_SPARSE);
+  available.sparse =
+      available.suite_sparse ||
+      ceres::IsSparseLinearAlgebraLibraryTypeAvailable(ceres::EIGEN_SPARSE);
+  return available;
+}
+
+BASolverChoice ChooseSolver(const BAProblemStatistics &statistics, int max_threads) {
+  return ChooseSolver(statistics, max_threads, AvailableLinearAlgebra());
+}
+
+BASolverChoice ChooseSolver(const BAProblemStatistics &statistics, int max_threads,
+                            const BALinearAlgebra &available) {
+  BASolverChoice choice;
+  choice.preconditioner_type = ceres::JACOBI;
+
+  if (statistics.num_points == 0) {
+    // Nothing to eliminate, e.g. a single shot resected against fixed points
+    choice.linear_solver_type = statistics.num_shots <= 10 || !available.sparse
+                                    ? ceres::DENSE_QR
+                                    : ceres::SPARSE_NORMAL_CHOLESKY;
+  } else if (statistics.num_shots <= kDenseSchurMaxShots) {
+    choice.linear_solver_type = ceres::DENSE_SCHUR;
+  } else if (statistics.num_shots <= kSparseSchurMaxShots && available.sparse) {
+    choice.linear_solver_type = ceres::SPARSE_SCHUR;
+  } else {
+    // The visibility based preconditioners factor their clusters with SuiteSparse
+    choice.linear_solver_type = ceres::ITERATIVE_SCHUR;
+    choice.preconditioner_type =
+        available.suite_sparse &&
+                statistics.VisibilityDensity() <= kClusterJacobiMaxDensity
+            ? ceres::CLUSTER_JACOBI
+            : ceres::SCHUR_JACOBI;
+  }
+
+  const long long threads = statistics.num_observations / kObservationsPerThread + 1;
+  choice.num_threads = int(std::max(1LL, std::min<long long>(threads, max_threads)));
+  return choice;
+}
+
+bool NeedsVisibilityDensity(int num_shots, int num_points) {
+  return NeedsVisibilityDensity(num_shots, num_points, AvailableLinearAlgebra());
+}
+
+bool NeedsVisibilityDensity(int num_shots, int num_points,
+                            const BALinearAlgebra &available) {
+  // Mirrors the branch of ChooseSolver that may end in CLUSTER_JACOBI
+  return num_points > 0 && num_shots > kSparseSchurMaxShots && available.suite_sparse;
+}
+
+long long CountCovisiblePairs(std::vector<std::pair<int, int> > *point_shots) {
+  std::sort(point_shots->begin(), point_shots->end());
+
+  // Observations of each shot, as the index of the first observation of their point
+  int num_shots = 0;
+  for (const auto &observation : *point_shots) {
+    num_shots = std::max(num_shots, observation.second + 1);
+  }
+  std::vector<int> shot_begin(num_shots + 1, 0);
+  for (const auto &observation : *point_shots) {
+    ++shot_begin[observation.second + 1];
+  }
+  std::partial_sum(shot_begin.begin(), shot_begin.end(), shot_begin.begin());
+  std::vector<int> shot_points(point_shots->size());
+  std::vector<int> shot_fill(shot_begin.begin(), shot_begin.end() - 1);
+  for (size_t begin = 0, i = 0; i < point_shots->size(); ++i) {
+    if ((*point_shots)[i].first != (*point_shots)[begin].first) {
+      begin = i;
+    }
+    shot_points[shot_fill[(*point_shots)[i].second]++] = int(begin);
+  }
+
+  // Each shot marks its covisible shots of higher index, so every pair is counted once
+  // without storing the pairs
+  std::vector<int> marked_by(num_shots, -1);
+  long long pairs = 0;
+  for (int shot = 0; shot < num_shots; ++shot) {
+    for (int k = shot_begin[shot]; k < shot_begin[shot + 1]; ++k) {
+      const int point = (*point_shots)[shot_points[k]].first;
+      for (size_t i = shot_points[k];
+           i < point_shots->size() && (*point_shots)[i].first == point; ++i) {
+        const int other = (*point_shots)[i].second;
+        if (other > shot && marked_by[other] != shot) {
+          marked_by[other] = shot;
+          ++pairs;
+        }
+      }
+    }
+  }
+  return pairs;
+}
+
+std::string SolverChoiceReport(const BAProblemStatistics &statistics,
+                               const BASolverChoice &choice) {
+  std::ostringstream report;
+  report << statistics.num_shots << " shots, " << statistics.num_points
+         << " points, " << statistics.num_observations << " observations, "
+         << "visibility density " << statistics.VisibilityDensity() << ": "
+         << ceres::LinearSolverTypeToString(choice.linear_solver_type);
+  if (choice.linear_solver_type == ceres::ITERATIVE_SCHUR) {
+    report << " with "
+           << ceres::PreconditionerTypeToString(choice.preconditioner_type);
+  }
+  report << " on " << choice.num_threads << " threads";
+  return report.str();
+}
+
+BAProblemStatistics BundleAdjuster::ComputeProblemStatistics() const {
+  BAProblemStatistics statistics;
+  statistics.num_shots = 0;
+  statistics.num_points = 0;
+
+  // Shots and points of both interfaces get one numbering for the visibility graph
+  std::unordered_map<const BAShot *, int> shot_index;
+  std::unordered_map<const BAPoint *, int> point_index;
+  for (const auto &i : shots_) {
+    shot_index.emplace(&i.second, shot_index.size());
+    statistics.num_shots += !i.second.constant;
+  }
+  for (const auto &i : points_) {
+    point_index.emplace(&i.second, point_index.size());
+    statistics.num_points += !i.second.constant;
+  }
+  for (int i = 0; i < NumIndexedShots(); ++i) {
+    statistics.num_shots += !indexed_shot_constant_[i];
+  }
+  for (int i = 0; i < NumIndexedPoints(); ++i) {
+    statistics.num_points += !indexed_point_constant_[i];
+  }
+
+  statistics.num_observations =
+      point_projection_observations_.size() + NumIndexedObservations();
+  statistics.num_covisible_pairs = -1;
+  if (!NeedsVisibilityDensity(statistics.num_shots, statistics.num_points)) {
+    return statistics;
+  }
+
+  std::vector<std::pair<int, int> > point_shots;
+  point_shots.reserve(statistics.num_observations);
+  for (const auto &observation : point_projection_observations_) {
+    point_shots.emplace_back(point_index.at(observation.point),
+                             shot_index.at(observation.shot));
+  }
+  const int point_offset = points_.size();
+  const int shot_offset = shots_.size();
+  for (int i = 0; i < NumIndexedObservations(); ++i) {
+    point_shots.emplace_back(point_offset + indexed_observation_point_[i],
+                             shot_offset + indexed_observation_shot_[i]);
+  }
+  statistics.num_covisible_pairs = CountCovisiblePairs(&point_shots);
+  return statistics;
+}
+
 void BundleAdjuster::AddLinearMotion(const std::string &shot0_id,
                                          const std::string &shot1_id,
                                          const std::string &shot2_id,
@@ -452,6 +700,29 @@ void BundleAdjuster::Run() {
     }
   }
 
+  for (int i = 0; i < NumIndexedShots(); ++i) {
+    double *shot = &indexed_shot_parameters_[i * BA_SHOT_NUM_PARAMS];
+    problem.AddParameterBlock(shot, BA_SHOT_NUM_PARAMS);
+    if (indexed_shot_constant_[i]) {
+      problem.SetParameterBlockConstant(shot);
+    }
+  }
+
+  for (int i = 0; i < indexed_camera_constant_.size(); ++i) {
+    double *camera = &indexed_camera_parameters_[i * BA_CAMERA_NUM_PARAMS];
+    problem.AddParameterBlock(camera, BA_CAMERA_NUM_PARAMS);
+    if (indexed_camera_constant_[i]) {
+      problem.SetParameterBlockConstant(camera);
+    }
+  }
+
+  for (int i = 0; i < NumIndexedPoints(); ++i) {
+    if (indexed_point_constant_[i]) {
+      problem.AddParameterBlock(&indexed_point_parameters_[i * 3], 3);
+      problem.SetParameterBlockConstant(&indexed_point_parameters_[i * 3]);
+    }
+  }
+
   for (auto &i : cameras_) {
     if (i.second->constant) {
       switch (i.second->type()) {
@@ -508,6 +779,9 @@ void BundleAdjuster::Run() {
   for (auto &observation : point_projection_observations_) {
     AddObservationResidualBlock(observation, projection_loss, &problem);
   }
+  for (int i = 0; i < NumIndexedObservations(); ++i) {
+    AddIndexedObservationResidualBlock(i, projection_loss, &problem);
+  }
 
   // Add rotation priors
   for (auto &rp : rotation_priors_) {
@@ -542,6 +816,18 @@ void BundleAdjuster::Run() {
                              pp.shot->parameters.data());
   }
 
+  for (int i = 0; i < indexed_position_prior_shot_.size(); ++i) {
+    ceres::CostFunction* cost_function =
+        new ceres::AutoDiffCostFunction<PositionPriorError, 3, 6>(
+            new PositionPriorError(&indexed_position_priors_[i * 4],
+                                   indexed_position_priors_[i * 4 + 3]));
+
+    problem.AddResidualBlock(
+        cost_function,
+        NULL,
+        &indexed_shot_parameters_[indexed_position_prior_shot_[i] * BA_SHOT_NUM_PARAMS]);
+  }
+
   // Add point position priors
   for (auto &pp : point_position_priors_) {
     ceres::CostFunction* cost_function =
@@ -612,6 +898,19 @@ void BundleAdjuster::Run() {
     }
   }
 
+  for (int i = 0; i < indexed_camera_constant_.size(); ++i) {
+    const double *prior = &indexed_camera_priors_[i * BA_CAMERA_NUM_PARAMS];
+    ceres::CostFunction* cost_function =
+        new ceres::AutoDiffCostFunction<BasicRadialInternalParametersPriorError, 3, 3>(
+            new BasicRadialInternalParametersPriorError(prior[BA_CAMERA_FOCAL], focal_prior_sd_,
+                                                        prior[BA_CAMERA_K1], k1_sd_,
+                                                        prior[BA_CAMERA_K2], k2_sd_));
+
+    problem.AddResidualBlock(cost_function,
+                             NULL,
+                             &indexed_camera_parameters_[i * BA_CAMERA_NUM_PARAMS]);
+  }
+
   // Add unit translation block
   if (unit_translation_shot_) {
     ceres::CostFunction* cost_function =
@@ -818,10 +1117,22 @@ void BundleAdjuster::Run() {
   options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
   options.linear_solver_type = LinearSolverTypeFromNamae(linear_solver_type_);
   options.num_threads = num_threads_;
+  if (linear_solver_type_ == "AUTO") {
+    const BAProblemStatistics statistics = ComputeProblemStatistics();
+    const BASolverChoice choice = ChooseSolver(statistics, num_threads_);
+    options.linear_solver_type = choice.linear_solver_type;
+    options.preconditioner_type = choice.preconditioner_type;
+    options.num_threads = choice.num_threads;
+    std::cout << "Bundle adjuster: " << SolverChoiceReport(statistics, choice) << std::endl;
+  }
   options.logging_type = ceres::PER_MINIMIZER_ITERATION;
   options.max_num_iterations = max_num_iterations_;
 
   ceres::Solve(options, &problem, &last_run_summary_);
+  std::cout << "Bundle adjuster: solved in " << last_run_summary_.total_time_in_seconds
+            << "s, " << last_run_summary_.linear_solver_time_in_seconds
+            << "s in " << ceres::LinearSolverTypeToString(options.linear_solver_type)
+            << std::endl;
 
   if (compute_covariances_) {
     ComputeCovariances(&problem);
@@ -840,10 +1151,9 @@ void BundleAdjuster::AddObservationResidualBlock(
     {
       BAPerspectiveCamera &c = static_cast<BAPerspectiveCamera &>(*observation.camera);
       ceres::CostFunction* cost_function =
-          new ceres::AutoDiffCostFunction<PerspectiveReprojectionError, 2, 3, 6, 3>(
-              new PerspectiveReprojectionError(observation.coordinates[0],
-                                               observation.coordinates[1],
-                                               observation.std_deviation));
+          new AnalyticReprojectionError<PerspectiveCameraModel>(observation.coordinates[0],
+                                                                observation.coordinates[1],
+                                                                observation.std_deviation);
 
       problem->AddResidualBlock(cost_function,
                                 loss,
@@ -856,10 +1166,9 @@ void BundleAdjuster::AddObservationResidualBlock(
     {
       BABrownPerspectiveCamera &c = static_cast<BABrownPerspectiveCamera &>(*observation.camera);
       ceres::CostFunction* cost_function =
-          new ceres::AutoDiffCostFunction<BrownPerspectiveReprojectionError, 2, 9, 6, 3>(
-              new BrownPerspectiveReprojectionError(observation.coordinates[0],
-                                                    observation.coordinates[1],
-                                                    observation.std_deviation));
+          new AnalyticReprojectionError<BrownPerspectiveCameraModel>(observation.coordinates[0],
+                                                                     observation.coordinates[1],
+                                                                     observation.std_deviation);
 
       problem->AddResidualBlock(cost_function,
                                 loss,
@@ -872,10 +1181,9 @@ void BundleAdjuster::AddObservationResidualBlock(
     {
       BAFisheyeCamera &c = static_cast<BAFisheyeCamera &>(*observation.camera);
       ceres::CostFunction* cost_function =
-          new ceres::AutoDiffCostFunction<FisheyeReprojectionError, 2, 3, 6, 3>(
-              new FisheyeReprojectionError(observation.coordinates[0],
-                                           observation.coordinates[1],
-                                           observation.std_deviation));
+          new AnalyticReprojectionError<FisheyeCameraModel>(observation.coordinates[0],
+                                                            observation.coordinates[1],
+                                                            observation.std_deviation);
 
       problem->AddResidualBlock(cost_function,
                                 loss,
@@ -888,10 +1196,9 @@ void BundleAdjuster::AddObservationResidualBlock(
     {
       BAEquirectangularCamera &c = static_cast<BAEquirectangularCamera &>(*observation.camera);
       ceres::CostFunction* cost_function =
-          new ceres::AutoDiffCostFunction<EquirectangularReprojectionError, 3, 6, 3>(
-              new EquirectangularReprojectionError(observation.coordinates[0],
-                                                   observation.coordinates[1],
-                                                   observation.std_deviation));
+          new AnalyticEquirectangularReprojectionError(observation.coordinates[0],
+                                                       observation.coordinates[1],
+                                                       observation.std_deviation);
 
       problem->AddResidualBlock(cost_function,
                                 loss,
@@ -902,6 +1209,25 @@ void BundleAdjuster::AddObservationResidualBlock(
   }
 }
 
+void BundleAdjuster::AddIndexedObservationResidualBlock(
+    int observation,
+    ceres::LossFunction *loss,
+    ceres::Problem *problem) {
+  const int shot = indexed_observation_shot_[observation];
+  const int camera = indexed_shot_camera_[shot];
+  ceres::CostFunction* cost_function =
+      new AnalyticReprojectionError<PerspectiveCameraModel>(
+          indexed_observation_coordinates_[observation * 2],
+          indexed_observation_coordinates_[observation * 2 + 1],
+          indexed_observation_std_deviation_[observation]);
+
+  problem->AddResidualBlock(cost_function,
+                            loss,
+                            &indexed_camera_parameters_[camera * BA_CAMERA_NUM_PARAMS],
+                            &indexed_shot_parameters_[shot * BA_SHOT_NUM_PARAMS],
+                            &indexed_point_parameters_[indexed_observation_point_[observation] * 3]);
+}
+
 void BundleAdjuster::ComputeCovariances(ceres::Problem *problem) {
   bool computed = false;
 
@@ -1017,6 +1343,19 @@ void BundleAdjuster::ComputeReprojectionErrors() {
       }
     }
   }
+
+  indexed_reprojection_errors_.resize(NumIndexedObservations() * 2);
+  for (int i = 0; i < NumIndexedObservations(); ++i) {
+    const int shot = indexed_observation_shot_[i];
+    const int camera = indexed_shot_camera_[shot];
+    PerspectiveReprojectionError pre(indexed_observation_coordinates_[i * 2],
+                                     indexed_observation_coordinates_[i * 2 + 1],
+                                     1.0);
+    pre(&indexed_camera_parameters_[camera * BA_CAMERA_NUM_PARAMS],
+        &indexed_shot_parameters_[shot * BA_SHOT_NUM_PARAMS],
+        &indexed_point_parameters_[indexed_observation_point_[i] * 3],
+        &indexed_reprojection_errors_[i * 2]);
+  }
 }
 
 BAPerspectiveCamera BundleAdjuster::GetPerspectiveCamera(
@@ -1051,6 +1390,38 @@ BAReconstruction BundleAdjuster::GetReconstruction(const std::string &id) {
   return reconstructions_[id];
 }
 
+BAPerspectiveCamera BundleAdjuster::GetIndexedPerspectiveCamera(
+    int camera) const {
+  BAPerspectiveCamera c;
+  c.id = std::to_string(camera);
+  c.constant = indexed_camera_constant_[camera];
+  for (int i = 0; i < BA_CAMERA_NUM_PARAMS; ++i) {
+    c.parameters[i] = indexed_camera_parameters_[camera * BA_CAMERA_NUM_PARAMS + i];
+  }
+  c.focal_prior = indexed_camera_priors_[camera * BA_CAMERA_NUM_PARAMS + BA_CAMERA_FOCAL];
+  c.k1_prior = indexed_camera_priors_[camera * BA_CAMERA_NUM_PARAMS + BA_CAMERA_K1];
+  c.k2_prior = indexed_camera_priors_[camera * BA_CAMERA_NUM_PARAMS + BA_CAMERA_K2];
+  return c;
+}
+
+Eigen::Vector3d BundleAdjuster::GetIndexedShotRotation(int shot) const {
+  return Eigen::Map<const Eigen::Vector3d>(
+      &indexed_shot_parameters_[shot * BA_SHOT_NUM_PARAMS + BA_SHOT_RX]);
+}
+
+Eigen::Vector3d BundleAdjuster::GetIndexedShotTranslation(int shot) const {
+  return Eigen::Map<const Eigen::Vector3d>(
+      &indexed_shot_parameters_[shot * BA_SHOT_NUM_PARAMS + BA_SHOT_TX]);
+}
+
+Eigen::Vector3d BundleAdjuster::GetIndexedPoint(int point) const {
+  return Eigen::Map<const Eigen::Vector3d>(&indexed_point_parameters_[point * 3]);
+}
+
+Eigen::Vector2d BundleAdjuster::GetIndexedReprojectionError(int observation) const {
+  return Eigen::Map<const Eigen::Vector2d>(&indexed_reprojection_errors_[observation * 2]);
+}
+
 std::string BundleAdjuster::BriefReport() {
   return last_run_summary_.BriefReport();
 }
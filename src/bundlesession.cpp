@@ -0,0 +1,246 @@
+#include "bundlesession.h"
+#include "bundle/src/projection_errors.h"
+#include "bundle/src/analytic_projection_errors.h"
+#include <ceres/rotation.h>
+#include <iostream>
+
+using std::cout;
+using std::endl;
+using std::map;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace
+{
+    //Same residual as PositionPriorError with the rotation and translation as separate blocks
+    struct PosePositionPriorError {
+        PosePositionPriorError(const cv::Point3d& position, double stdDeviation)
+            : position_{ position.x, position.y, position.z }
+            , scale_(1.0 / stdDeviation)
+        {}
+
+        template <typename T>
+        bool operator()(const T* const rotation, const T* const translation, T* residuals) const
+        {
+            const T inverseRotation[3] = { -rotation[0], -rotation[1], -rotation[2] };
+            T p[3];
+            ceres::AngleAxisRotatePoint(inverseRotation, translation, p);
+            residuals[0] = T(scale_) * (p[0] + T(position_[0]));
+            residuals[1] = T(scale_) * (p[1] + T(position_[1]));
+            residuals[2] = T(scale_) * (p[2] + T(position_[2]));
+            return true;
+        }
+
+        double position_[3];
+        double scale_;
+    };
+
+    ceres::Problem::Options problemOptions()
+    {
+        //Points and observations are removed between runs, the loss is shared by all the residuals
+        ceres::Problem::Options options;
+        options.enable_fast_removal = true;
+        options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+        return options;
+    }
+} //namespace
+
+BundleSession::BundleSession(Reconstruction& rec, const TrackStore& tracks, bool useGps, bool fixCamera,
+    double focalSD, double k1SD, double k2SD)
+    : rec_(rec)
+    , tracks_(tracks)
+    , useGps_(useGps)
+    , problem_(problemOptions())
+    , loss_(new ceres::CauchyLoss(1.0))
+    , camera_()
+    , poses_(tracks.numImages(), nullptr)
+    , numShots_(0)
+    , points_()
+    , observations_()
+    , maxIterations_(50)
+    , numThreads_(1)
+    , linearSolverType_("SPARSE_SCHUR")
+    , summary_()
+{
+    const auto& camera = rec_.getCamera();
+    camera_[BA_CAMERA_FOCAL] = camera.getPhysicalFocalLength();
+    camera_[BA_CAMERA_K1] = camera.getK1();
+    camera_[BA_CAMERA_K2] = camera.getK2();
+    problem_.AddResidualBlock(
+        new ceres::AutoDiffCostFunction<BasicRadialInternalParametersPriorError, 3, 3>(
+            new BasicRadialInternalParametersPriorError(camera.getInitialPhysicalFocal(), focalSD,
+                camera.getInitialK1(), k1SD, camera.getInitialK2(), k2SD)),
+        nullptr,
+        camera_);
+    if (fixCamera)
+        problem_.SetParameterBlockConstant(camera_);
+}
+
+void BundleSession::_addShot(int image, Shot& shot)
+{
+    auto& pose = shot.getPose();
+    poses_[image] = &pose;
+    numShots_++;
+    problem_.AddParameterBlock(pose.rotationData(), 3);
+    problem_.AddParameterBlock(pose.translationData(), 3);
+    if (useGps_) {
+        problem_.AddResidualBlock(
+            new ceres::AutoDiffCostFunction<PosePositionPriorError, 3, 3, 3>(
+                new PosePositionPriorError(shot.getMetadata().gpsPosition, shot.getMetadata().gpsDop)),
+            nullptr,
+            pose.rotationData(),
+            pose.translationData());
+    }
+}
+
+void BundleSession::_addPoint(int track, CloudPoint& cloudPoint)
+{
+    auto point = &cloudPoint.getPosition().x;
+    points_[track] = point;
+    problem_.AddParameterBlock(point, 3);
+}
+
+void BundleSession::_addObservation(uint32_t observation, double* point)
+{
+    auto& pose = *poses_[tracks_.image(observation)];
+    const auto coordinates = tracks_.point(observation);
+    observations_[observation] = problem_.AddResidualBlock(
+        new AnalyticPoseReprojectionError<PerspectiveCameraModel>(coordinates.x, coordinates.y, tracks_.scale(observation)),
+        loss_.get(),
+        camera_,
+        pose.rotationData(),
+        pose.translationData(),
+        point);
+}
+
+void BundleSession::_removePoint(int track, double* point)
+{
+    //Removing the block removes its residuals, only the bookkeeping is left to drop
+    problem_.RemoveParameterBlock(point);
+    for (auto observation = tracks_.trackBegin(track); observation < tracks_.trackEnd(track); ++observation) {
+        observations_.erase(observation);
+    }
+    points_.erase(track);
+}
+
+void BundleSession::sync()
+{
+    const auto& camera = rec_.getCamera();
+    camera_[BA_CAMERA_FOCAL] = camera.getPhysicalFocalLength();
+    camera_[BA_CAMERA_K1] = camera.getK1();
+    camera_[BA_CAMERA_K2] = camera.getK2();
+
+    //Erased points go first so the storage of a new point can not be mistaken for an old one
+    vector<std::pair<int, double*>> erasedPoints;
+    for (const auto& [track, point] : points_) {
+        const auto cloudPoint = rec_.getCloudPoints().find(track);
+        if (cloudPoint == rec_.getCloudPoints().end() || &cloudPoint->second.getPosition().x != point)
+            erasedPoints.emplace_back(track, point);
+    }
+    for (const auto& [track, point] : erasedPoints) {
+        _removePoint(track, point);
+    }
+
+    for (auto observation = observations_.begin(); observation != observations_.end();) {
+        if (tracks_.isAlive(observation->first)) {
+            ++observation;
+        }
+        else {
+            problem_.RemoveResidualBlock(observation->second);
+            observation = observations_.erase(observation);
+        }
+    }
+
+    for (auto& [shotId, shot] : rec_.getReconstructionShots()) {
+        const auto image = tracks_.imageId(shotId);
+        if (image >= 0 && !poses_[image])
+            _addShot(image, shot);
+    }
+
+    for (auto& [track, cloudPoint] : rec_.getCloudPoints()) {
+        if (!points_.count(track))
+            _addPoint(track, cloudPoint);
+    }
+
+    //New shots see old points and new points are seen by old shots, every missing pair is added
+    for (const auto& [track, point] : points_) {
+        for (auto observation = tracks_.trackBegin(track); observation < tracks_.trackEnd(track); ++observation) {
+            if (tracks_.isAlive(observation) && poses_[tracks_.image(observation)] && !observations_.count(observation))
+                _addObservation(observation, point);
+        }
+    }
+}
+
+void BundleSession::run()
+{
+    sync();
+
+    ceres::Solver::Options options;
+    if (linearSolverType_ == "AUTO") {
+        const auto statistics = _computeProblemStatistics();
+        const auto choice = ChooseSolver(statistics, numThreads_);
+        options.linear_solver_type = choice.linear_solver_type;
+        options.preconditioner_type = choice.preconditioner_type;
+        options.num_threads = choice.num_threads;
+        cout << "Bundle session: " << SolverChoiceReport(statistics, choice) << endl;
+    }
+    else {
+        ceres::StringToLinearSolverType(linearSolverType_, &options.linear_solver_type);
+        options.num_threads = numThreads_;
+    }
+    options.max_num_iterations = maxIterations_;
+    options.logging_type = ceres::PER_MINIMIZER_ITERATION;
+    ceres::Solve(options, &problem_, &summary_);
+    cout << "Bundled " << numShots_ << " shots, " << points_.size() << " points and " << observations_.size()
+        << " observations in " << summary_.total_time_in_seconds << "s, " << summary_.linear_solver_time_in_seconds
+        << "s in " << ceres::LinearSolverTypeToString(options.linear_solver_type) << endl;
+
+    //The solver wrote the poses in place
+    for (const auto pose : poses_) {
+        if (pose)
+            pose->updateCache();
+    }
+    auto& camera = rec_.getCamera();
+    camera.setFocalWithPhysical(camera_[BA_CAMERA_FOCAL]);
+    camera.setK1(camera_[BA_CAMERA_K1]);
+    camera.setK2(camera_[BA_CAMERA_K2]);
+    _computeReprojectionErrors();
+}
+
+BAProblemStatistics BundleSession::_computeProblemStatistics() const
+{
+    BAProblemStatistics statistics;
+    statistics.num_shots = static_cast<int>(numShots_);
+    statistics.num_points = static_cast<int>(points_.size());
+    statistics.num_observations = static_cast<long long>(observations_.size());
+    statistics.num_covisible_pairs = -1;
+    if (!NeedsVisibilityDensity(statistics.num_shots, statistics.num_points))
+        return statistics;
+
+    vector<std::pair<int, int>> pointShots;
+    pointShots.reserve(observations_.size());
+    for (const auto& [observation, residualBlock] : observations_) {
+        pointShots.emplace_back(tracks_.track(observation), tracks_.image(observation));
+    }
+    statistics.num_covisible_pairs = CountCovisiblePairs(&pointShots);
+    return statistics;
+}
+
+void BundleSession::_computeReprojectionErrors()
+{
+    unordered_map<int, map<string, Eigen::VectorXd>> errors;
+    for (const auto& [observation, residualBlock] : observations_) {
+        const auto image = tracks_.image(observation);
+        const auto track = tracks_.track(observation);
+        const auto coordinates = tracks_.point(observation);
+        double residuals[2];
+        EvaluateAnalyticReprojection<PerspectiveCameraModel>(camera_, poses_[image]->rotationData(),
+            poses_[image]->translationData(), points_.at(track), coordinates.x, coordinates.y, 1.0, residuals,
+            nullptr, nullptr, nullptr, nullptr);
+        errors[track][tracks_.imageName(image)] = Eigen::Vector2d(residuals[0], residuals[1]);
+    }
+    for (auto& [track, cloudPoint] : rec_.getCloudPoints()) {
+        cloudPoint.setError(errors[track]);
+    }
+}
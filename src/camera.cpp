@@ -18,40 +18,15 @@ using cv::Point_;
 using cv::Size;
 using opengv::bearingVector_t;
 using opengv::bearingVectors_t;
-
-Matx33d Pose::getRotationMatrix() const
-{
-    Mat rods;
-    Rodrigues(rotation_, rods);
-    return rods;
-}
-
-ShoColumnVector3d Pose::getRotationVector() const
-{
-    return rotation_;
-}
-
-cv::Mat Pose::getRotationMatrixInverse() const {
-    auto r = getRotationMatrix();
-    Mat tR;
-    transpose(r, tR);
-    return tR;
-}
-
-ShoColumnVector3d Pose::getOrigin() const
-{
-    auto origin = -(getRotationMatrix());
-    auto t = Mat(origin.t() * Mat(translation_));
-    return t;
-}
-
-ShoColumnVector3d Pose::getTranslation() const{
-    return translation_;
-}
+using Eigen::Map;
+using Eigen::Matrix;
+using Eigen::RowMajor;
+using Eigen::Vector3d;
 
 void Pose::setTranslation(ShoColumnVector3d t)
 {
     translation_ = t;
+    updateCache();
 }
 
 void Pose::setRotationVector(cv::Mat src) {
@@ -63,11 +38,25 @@ void Pose::setRotationVector(cv::Mat src) {
         cv::Rodrigues(src, src);
     }
     rotation_ = src;
+    updateCache();
+}
+
+void Pose::updateCache()
+{
+    cv::Rodrigues(rotation_, rotationMatrix_);
+    origin_ = -(rotationMatrix_.t() * translation_);
+}
+
+void Pose::rotateBearingsToWorld(const Eigen::Matrix3Xd& bearings, Eigen::Matrix3Xd& worldBearings) const
+{
+    //One product over the whole array, Eigen vectorizes it
+    const Map<const Matrix<double, 3, 3, RowMajor>> rotation(rotationMatrix_.val);
+    worldBearings.noalias() = rotation.transpose() * bearings;
 }
 
 Pose Pose::poseInverse() const {
     auto inv = Pose{};
-    auto r = getRotationMatrix();
+    const auto& r = getRotationMatrix();
     std::cout << "R was " << r << "\n\n";
     cv::Matx33d transposedRotation;
     cv::transpose(r, transposedRotation);
@@ -246,6 +235,35 @@ Point2d Camera::projectBearing(bearingVector_t b) {
     };
 }
 
+template <>
+PerspectiveModel Camera::getModel<PerspectiveModel>() const
+{
+    return { getPhysicalFocalLength(), getK1(), getK2() };
+}
+
+template <>
+BrownModel Camera::getModel<BrownModel>() const
+{
+    //The distortion coefficients are in the OpenCV order k1, k2, p1, p2, k3, k4, k5, k6, s1, s2, s3, s4
+    //with the missing ones zero, the normalized K matrix has no principal point
+    const auto distortion = getDistortionMatrix();
+    const auto coefficient = [&distortion](int i) { return i < distortion.rows ? distortion.at<double>(i, 0) : 0.0; };
+
+    //The tilted sensor terms of a 14 coefficient calibration are not modelled, refuse them rather than drop them
+    CV_Assert(distortion.rows <= 12 || (coefficient(12) == 0.0 && coefficient(13) == 0.0));
+    const auto focal = getPhysicalFocalLength();
+    return { focal, focal, 0.0, 0.0,
+        coefficient(0), coefficient(1), coefficient(2), coefficient(3), coefficient(4),
+        coefficient(5), coefficient(6), coefficient(7),
+        coefficient(8), coefficient(9), coefficient(10), coefficient(11) };
+}
+
+template <>
+FisheyeModel Camera::getModel<FisheyeModel>() const
+{
+    return { getPhysicalFocalLength(), getK1(), getK2() };
+}
+
 Camera Camera::getCameraFromCalibrationFile(string calibrationFile) {
     int height, width;
     cv::Mat cameraMatrix, distortionParameters;
@@ -0,0 +1,92 @@
+#include "featurecache.h"
+
+using std::lock_guard;
+using std::make_shared;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+
+FeatureCache::FeatureCache(const FlightSession& flight, size_t budget)
+    : flight_(flight)
+    , budget_(budget)
+    , bytes_(0)
+    , hits_(0)
+    , misses_(0)
+    , mutex_()
+    , entries_()
+    , index_()
+{
+}
+
+size_t FeatureCache::getFeatureBytes(const ImageFeatures& features)
+{
+    return features.descriptors.total() * features.descriptors.elemSize() +
+        features.keypoints.size() * sizeof(cv::KeyPoint) +
+        features.colors.size() * sizeof(cv::Scalar);
+}
+
+void FeatureCache::_evict()
+{
+    //Always keep the most recent entry even if it alone is over budget
+    while (bytes_ > budget_ && entries_.size() > 1) {
+        bytes_ -= entries_.back().bytes;
+        index_.erase(entries_.back().imageName);
+        entries_.pop_back();
+    }
+}
+
+shared_ptr<const ImageFeatures> FeatureCache::get(const string& imageName)
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        const auto cached = index_.find(imageName);
+        if (cached != index_.end()) {
+            hits_++;
+            entries_.splice(entries_.begin(), entries_, cached->second);
+            return cached->second->features;
+        }
+        misses_++;
+    }
+
+    //Load outside of the lock so a slow read does not stall threads that hit the cache
+    const auto features = make_shared<const ImageFeatures>(flight_.loadFeatures(imageName));
+    lock_guard<mutex> lock(mutex_);
+    const auto cached = index_.find(imageName);
+    if (cached != index_.end())
+        return cached->second->features;
+
+    entries_.push_front({ imageName, features, nullptr, getFeatureBytes(*features) });
+    index_[imageName] = entries_.begin();
+    bytes_ += entries_.front().bytes;
+    _evict();
+    return features;
+}
+
+shared_ptr<const KdForestIndex> FeatureCache::getForest(const string& imageName, int maxComparisons)
+{
+    const auto features = get(imageName);
+    {
+        lock_guard<mutex> lock(mutex_);
+        const auto cached = index_.find(imageName);
+        if (cached != index_.end() && cached->second->forest)
+            return cached->second->forest;
+    }
+
+    const auto forest = KdForestIndex::build(features->descriptors, KdForestIndex::DEFAULT_NUM_TREES, maxComparisons);
+    if (!forest)
+        return nullptr;
+
+    lock_guard<mutex> lock(mutex_);
+    const auto cached = index_.find(imageName);
+    if (cached == index_.end())
+        return forest;
+
+    if (cached->second->forest)
+        return cached->second->forest;
+
+    cached->second->forest = forest;
+    cached->second->bytes += forest->getMemoryBytes();
+    bytes_ += forest->getMemoryBytes();
+    _evict();
+    return forest;
+}
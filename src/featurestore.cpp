@@ -0,0 +1,256 @@
+#include "featurestore.h"
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
+using boost::interprocess::read_only;
+using cv::KeyPoint;
+using cv::Mat;
+using cv::Scalar;
+using std::cerr;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace
+{
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + FEATURE_FILE_ALIGNMENT - 1) / FEATURE_FILE_ALIGNMENT * FEATURE_FILE_ALIGNMENT;
+    }
+
+    uint8_t toByte(double v)
+    {
+        return static_cast<uint8_t>(std::min(255.0, std::max(0.0, v)));
+    }
+
+    bool isValidHeader(const char* base, size_t length)
+    {
+        if (length < sizeof(FeatureFileHeader))
+            return false;
+
+        const auto header = reinterpret_cast<const FeatureFileHeader*>(base);
+        if (header->magic != FEATURE_FILE_MAGIC || header->version != FEATURE_FILE_VERSION)
+            return false;
+
+        const uint64_t n = header->numFeatures;
+        return header->fileSize <= length &&
+            header->xOffset + n * sizeof(float) <= length &&
+            header->yOffset + n * sizeof(float) <= length &&
+            header->sizeOffset + n * sizeof(float) <= length &&
+            header->angleOffset + n * sizeof(float) <= length &&
+            header->descriptorOffset + n * header->descriptorRowBytes <= length &&
+            header->colorOffset + n * 3 <= length;
+    }
+
+    struct MappedFeatureFile {
+        file_mapping file;
+        mapped_region region;
+    };
+} //namespace
+
+FeatureView::FeatureView(shared_ptr<const void> storage, const char* base)
+    : storage_(storage)
+    , base_(base)
+    , header_(reinterpret_cast<const FeatureFileHeader*>(base))
+{
+}
+
+const float* FeatureView::x() const
+{
+    return reinterpret_cast<const float*>(base_ + header_->xOffset);
+}
+
+const float* FeatureView::y() const
+{
+    return reinterpret_cast<const float*>(base_ + header_->yOffset);
+}
+
+const float* FeatureView::sizes() const
+{
+    return reinterpret_cast<const float*>(base_ + header_->sizeOffset);
+}
+
+const float* FeatureView::angles() const
+{
+    return reinterpret_cast<const float*>(base_ + header_->angleOffset);
+}
+
+const uint8_t* FeatureView::colors() const
+{
+    return reinterpret_cast<const uint8_t*>(base_ + header_->colorOffset);
+}
+
+Mat FeatureView::descriptors() const
+{
+    if (!header_ || !header_->numFeatures)
+        return Mat();
+
+    return Mat(
+        static_cast<int>(header_->numFeatures),
+        static_cast<int>(header_->descriptorCols),
+        header_->descriptorType,
+        const_cast<char*>(base_ + header_->descriptorOffset),
+        header_->descriptorRowBytes
+    );
+}
+
+KeyPoint FeatureView::keypoint(size_t i) const
+{
+    return KeyPoint(x()[i], y()[i], sizes()[i], angles()[i]);
+}
+
+Scalar FeatureView::color(size_t i) const
+{
+    const auto c = colors() + 3 * i;
+    return Scalar(c[0], c[1], c[2]);
+}
+
+vector<KeyPoint> FeatureView::keypoints() const
+{
+    vector<KeyPoint> keypoints;
+    keypoints.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        keypoints.push_back(keypoint(i));
+    }
+    return keypoints;
+}
+
+vector<Scalar> FeatureView::colorList() const
+{
+    vector<Scalar> colors;
+    colors.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        colors.push_back(color(i));
+    }
+    return colors;
+}
+
+vector<char> FeatureStore::encode(
+    const vector<KeyPoint>& keypoints,
+    const Mat& descriptors,
+    const vector<Scalar>& colors
+)
+{
+    const uint64_t n = keypoints.size();
+    CV_Assert(descriptors.empty() || static_cast<uint64_t>(descriptors.rows) == n);
+    CV_Assert(colors.empty() || colors.size() == n);
+
+    FeatureFileHeader header{};
+    header.magic = FEATURE_FILE_MAGIC;
+    header.version = FEATURE_FILE_VERSION;
+    header.numFeatures = static_cast<uint32_t>(n);
+    header.descriptorCols = descriptors.empty() ? 0 : descriptors.cols;
+    header.descriptorType = descriptors.empty() ? CV_8U : descriptors.type();
+    header.descriptorRowBytes = descriptors.empty() ? 0 : static_cast<uint32_t>(descriptors.cols * descriptors.elemSize());
+    header.xOffset = alignOffset(sizeof(FeatureFileHeader));
+    header.yOffset = alignOffset(header.xOffset + n * sizeof(float));
+    header.sizeOffset = alignOffset(header.yOffset + n * sizeof(float));
+    header.angleOffset = alignOffset(header.sizeOffset + n * sizeof(float));
+    header.descriptorOffset = alignOffset(header.angleOffset + n * sizeof(float));
+    header.colorOffset = alignOffset(header.descriptorOffset + n * header.descriptorRowBytes);
+    header.fileSize = header.colorOffset + n * 3;
+
+    vector<char> buffer(header.fileSize, 0);
+    std::memcpy(buffer.data(), &header, sizeof(header));
+    auto x = reinterpret_cast<float*>(buffer.data() + header.xOffset);
+    auto y = reinterpret_cast<float*>(buffer.data() + header.yOffset);
+    auto size = reinterpret_cast<float*>(buffer.data() + header.sizeOffset);
+    auto angle = reinterpret_cast<float*>(buffer.data() + header.angleOffset);
+    auto color = reinterpret_cast<uint8_t*>(buffer.data() + header.colorOffset);
+    for (uint64_t i = 0; i < n; ++i) {
+        x[i] = keypoints[i].pt.x;
+        y[i] = keypoints[i].pt.y;
+        size[i] = keypoints[i].size;
+        angle[i] = keypoints[i].angle;
+        if (!colors.empty()) {
+            color[3 * i] = toByte(colors[i][0]);
+            color[3 * i + 1] = toByte(colors[i][1]);
+            color[3 * i + 2] = toByte(colors[i][2]);
+        }
+    }
+    for (uint64_t i = 0; i < n && header.descriptorRowBytes; ++i) {
+        std::memcpy(
+            buffer.data() + header.descriptorOffset + i * header.descriptorRowBytes,
+            descriptors.ptr(static_cast<int>(i)),
+            header.descriptorRowBytes
+        );
+    }
+    return buffer;
+}
+
+bool FeatureStore::write(
+    const string& featureFile,
+    const vector<KeyPoint>& keypoints,
+    const Mat& descriptors,
+    const vector<Scalar>& colors
+)
+{
+    const auto buffer = encode(keypoints, descriptors, colors);
+    const auto temporaryFile = featureFile + ".tmp";
+    {
+        std::ofstream out(temporaryFile, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write(buffer.data(), buffer.size());
+        if (!out)
+            return false;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(temporaryFile, featureFile, ec);
+    return !ec;
+}
+
+FeatureView FeatureStore::map(const string& featureFile)
+{
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(featureFile, ec) || boost::filesystem::file_size(featureFile, ec) == 0)
+        return FeatureView();
+
+    try {
+        auto mapped = make_shared<MappedFeatureFile>();
+        mapped->file = file_mapping(featureFile.c_str(), read_only);
+        mapped->region = mapped_region(mapped->file, read_only);
+        const auto base = static_cast<const char*>(mapped->region.get_address());
+        if (!isValidHeader(base, mapped->region.get_size())) {
+            cerr << featureFile << " is not a valid feature file \n";
+            return FeatureView();
+        }
+        return FeatureView(std::static_pointer_cast<const void>(mapped), base);
+    }
+    catch (const boost::interprocess::interprocess_exception& e) {
+        cerr << "Could not map " << featureFile << " : " << e.what() << "\n";
+        return FeatureView();
+    }
+}
+
+FeatureView FeatureStore::fromBuffer(vector<char> buffer)
+{
+    if (!isValidHeader(buffer.data(), buffer.size()))
+        return FeatureView();
+
+    auto owned = make_shared<const vector<char>>(std::move(buffer));
+    return FeatureView(std::static_pointer_cast<const void>(owned), owned->data());
+}
+
+FeatureView FeatureStore::fromYaml(const string& yamlFile)
+{
+    if (!boost::filesystem::exists(yamlFile))
+        return FeatureView();
+
+    cv::FileStorage fs(yamlFile, cv::FileStorage::READ);
+    vector<KeyPoint> keypoints;
+    Mat descriptors;
+    vector<Scalar> colors;
+    fs["Keypoints"] >> keypoints;
+    fs["Descriptors"] >> descriptors;
+    fs["Colors"] >> colors;
+    return fromBuffer(encode(keypoints, descriptors, colors));
+}
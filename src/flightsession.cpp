@@ -25,13 +25,15 @@ using std::endl;
 using std::ios;
 
 FlightSession::FlightSession() : imageSet(), flightSessionDirectory_(), imageDirectoryPath_(), imageFeaturesPath_(),
-imageTracksPath_(), camera_(), referenceLLA_()
+imageTracksPath_(), camera_(), referenceLLA_(), matchWriter_(std::make_shared<LazyMatchWriter>()),
+imageLoader_(std::make_shared<ImageLoader>())
 {
 
 }
 
 FlightSession::FlightSession(string flightSessionDirectory, string calibrationFile) : imageSet(), flightSessionDirectory_(flightSessionDirectory), imageDirectoryPath_(), imageFeaturesPath_(),
-imageTracksPath_(), camera_(), referenceLLA_()
+imageTracksPath_(), camera_(), referenceLLA_(), matchWriter_(std::make_shared<LazyMatchWriter>()),
+imageLoader_(std::make_shared<ImageLoader>())
 {
     //Remove trailing slash if present at the end to avoid unexpected bugs with boost file system paths
     auto lastChar = flightSessionDirectory.at(flightSessionDirectory.size() - 1);
@@ -99,7 +101,7 @@ std::string FlightSession::_extractProjectionTypeFromExif(Exiv2::ExifData exifDa
     return std::string("perspective");
 }
 
-vector<Img> FlightSession::getImageSet() const
+const vector<Img>& FlightSession::getImageSet() const
 {
     return this->imageSet;
 }
@@ -162,17 +164,24 @@ int FlightSession::getImageIndex(string imageName) const
     }
     return -1;
 }
+const path FlightSession::getImageFeaturesFile(string imageName) const
+{
+    return getImageFeaturesPath() / (imageName + FEATURE_FILE_EXTENSION);
+}
+
+bool FlightSession::hasImageFeatures(string imageName) const
+{
+    return exists(getImageFeaturesFile(imageName)) ||
+        exists(getImageFeaturesPath() / (imageName + LEGACY_FEATURE_FILE_EXTENSION));
+}
+
 bool FlightSession::saveImageFeaturesFile(string imageName, const std::vector<cv::KeyPoint> &keypoints, const cv::Mat &descriptors,
     const std::vector<cv::Scalar> &colors)
 {
-    auto imageFeaturePath = getImageFeaturesPath() / (imageName + ".yaml");
+    auto imageFeaturePath = getImageFeaturesFile(imageName);
     if (!boost::filesystem::exists(imageFeaturePath))
     {
-        cv::FileStorage file(imageFeaturePath.string(), cv::FileStorage::WRITE);
-        file << "Keypoints" << keypoints;
-        file << "Descriptors" << descriptors;
-        file << "Colors" << colors;
-        file.release();
+        FeatureStore::write(imageFeaturePath.string(), keypoints, descriptors, colors);
     }
     return boost::filesystem::exists(imageFeaturePath);
 }
@@ -188,26 +197,51 @@ bool FlightSession::saveImageExifFile(std::string imageName, ImageMetadata image
 
 bool FlightSession::saveMatches(string fileName, const std::map<string, vector<cv::DMatch>>& matches)
 {
-    auto imageMatchesPath = getImageMatchesPath() / (fileName + ".yaml");
-    cout << "Writing file " << imageMatchesPath.string() << endl;
-    cv::FileStorage fs(imageMatchesPath.string(), cv::FileStorage::WRITE);
-    fs << "MatchCount" << (int)matches.size();
-    fs << "candidateImageMatches" << "[";
-    for (auto it = matches.begin(); it != matches.end(); ++it)
+    cout << "Writing matches for " << fileName << endl;
+    auto saved = true;
+    for (const auto&[trainImage, pairMatches] : matches) {
+        saved = savePairMatches(fileName, trainImage, pairMatches) && saved;
+    }
+    return saved;
+}
+
+bool FlightSession::savePairMatches(string queryImage, string trainImage, const vector<DMatch>& matches)
+{
+    if (imageMatchesPath_.empty())
+        return false;
+
+    MatchStoreWriter* writer;
     {
-        fs << "{" << "imageName" << it->first;
-        fs << "matches" << it->second << "}";
+        std::lock_guard<std::mutex> lock(matchWriter_->mutex);
+        if (!matchWriter_->writer)
+            matchWriter_->writer = std::make_unique<MatchStoreWriter>(imageMatchesPath_.string());
+        writer = matchWriter_->writer.get();
     }
-    fs << "]";
-    fs.release();
-    return boost::filesystem::exists(imageMatchesPath);
+    return writer->append(queryImage, trainImage, matches);
+}
+
+MatchStore FlightSession::openMatchStore() const
+{
+    return MatchStore::open(imageMatchesPath_.string());
 }
 
 map<string, vector<DMatch>> FlightSession::loadMatches(string fileName) const
 {
     map<string, vector<DMatch>> allPairMatches;
 
+    const auto store = openMatchStore();
+    for (const auto& pairMatches : store.pairsForQuery(fileName)) {
+        const auto& trainImage = store.imageName(pairMatches.trainImage);
+        allPairMatches[trainImage] = pairMatches.toDMatches(getImageIndex(trainImage));
+    }
+    if (!allPairMatches.empty())
+        return allPairMatches;
+
+    //Sessions matched before the match store only have one YAML file per query image
     auto imageMatchesPath = getImageMatchesPath() / (fileName + ".yaml");
+    if (!exists(imageMatchesPath))
+        return allPairMatches;
+
     cv::FileStorage fs(imageMatchesPath.string(), cv::FileStorage::READ);
     FileNode cMatches = fs["candidateImageMatches"];
     FileNodeIterator it = cMatches.begin(), it_end = cMatches.end();
@@ -221,18 +255,36 @@ map<string, vector<DMatch>> FlightSession::loadMatches(string fileName) const
     return allPairMatches;
 }
 
+FeatureView FlightSession::loadFeatureView(string imageName) const
+{
+    const auto featureFile = getImageFeaturesFile(imageName);
+    auto view = FeatureStore::map(featureFile.string());
+    if (!view.empty())
+        return view;
+
+    //Sessions created before the binary store only have the YAML files, they are converted on the first load
+    const auto legacyFile = getImageFeaturesPath() / (imageName + LEGACY_FEATURE_FILE_EXTENSION);
+    view = FeatureStore::fromYaml(legacyFile.string());
+    if (view.empty())
+        return view;
+
+    if (!FeatureStore::write(featureFile.string(), view.keypoints(), view.descriptors(), view.colorList())) {
+        cerr << "Could not convert " << legacyFile.string() << "\n";
+        return view;
+    }
+    cout << "Converted " << legacyFile.string() << " to " << featureFile.string() << endl;
+    return FeatureStore::map(featureFile.string());
+}
+
 ImageFeatures FlightSession::loadFeatures(string imageName) const
 {
-    auto imageFeaturePath = getImageFeaturesPath() / (imageName + ".yaml");
-    cv::FileStorage fs(imageFeaturePath.string(), cv::FileStorage::READ);
-    vector<KeyPoint> keypoints;
-    Mat descriptors;
-    vector<Scalar> colors;
-    fs["Keypoints"] >> keypoints;
-    fs["Descriptors"] >> descriptors;
-    fs["Colors"] >> colors;
-
-    return { keypoints, descriptors, colors };
+    const auto view = loadFeatureView(imageName);
+    return { view.keypoints(), view.descriptors(), view.colorList(), view };
+}
+
+ImageLoader& FlightSession::getImageLoader() const
+{
+    return *imageLoader_;
 }
 
 const Camera& FlightSession::getCamera() const {
@@ -294,13 +346,11 @@ void FlightSession::undistort()
 {
     for (auto img : imageSet) {
         auto imagePath = imageDirectoryPath_ / img.getFileName();
-        Mat distortedImage = cv::imread(imagePath.string(),
-            SHO_LOAD_COLOR_IMAGE_OPENCV_ENUM |
-            SHO_LOAD_ANYDEPTH_IMAGE_OPENCV_ENUM);
-        if (!distortedImage.data)
+        const auto distortedImage = imageLoader_->load(imagePath.string());
+        if (!distortedImage)
             continue;
         Mat undistortedImage;
-        cv::undistort(distortedImage, 
+        cv::undistort(*distortedImage, 
             undistortedImage, 
             camera_.getKMatrix(), 
             camera_.getDistortionMatrix());
@@ -0,0 +1,75 @@
+#include "imageloader.h"
+#include "bootstrap.h"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+using cv::Mat;
+using cv::Size;
+using std::lock_guard;
+using std::make_shared;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+
+ImageLoader::ImageLoader(size_t capacity)
+    : capacity_(capacity)
+    , mutex_()
+    , frames_()
+    , index_()
+{
+}
+
+shared_ptr<const Mat> ImageLoader::load(const string& imagePath)
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        const auto cached = index_.find(imagePath);
+        if (cached != index_.end()) {
+            frames_.splice(frames_.begin(), frames_, cached->second);
+            return cached->second->second;
+        }
+    }
+
+    //Decode outside of the lock so several images can be decoded at the same time
+    auto frame = make_shared<Mat>(cv::imread(imagePath, SHO_LOAD_COLOR_IMAGE_OPENCV_ENUM | SHO_LOAD_ANYDEPTH_IMAGE_OPENCV_ENUM));
+    if (frame->empty())
+        return nullptr;
+
+    lock_guard<mutex> lock(mutex_);
+    if (index_.find(imagePath) == index_.end() && capacity_ > 0) {
+        frames_.emplace_front(imagePath, frame);
+        index_[imagePath] = frames_.begin();
+        if (frames_.size() > capacity_) {
+            index_.erase(frames_.back().first);
+            frames_.pop_back();
+        }
+    }
+    return frame;
+}
+
+bool ImageLoader::loadWorkingImages(const string& imagePath, Size workingSize, Mat& color, Mat& gray)
+{
+    const auto frame = load(imagePath);
+    if (!frame)
+        return false;
+
+    Mat working = *frame;
+    if (!workingSize.empty() && working.cols > workingSize.width) {
+        cv::resize(working, working, workingSize, 0, 0, cv::INTER_AREA);
+    }
+    if (working.channels() == 1) {
+        color = working.clone();
+        gray = color;
+        return true;
+    }
+    cv::cvtColor(working, gray, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(working, color, SHO_BGR2RGB);
+    return true;
+}
+
+void ImageLoader::clear()
+{
+    lock_guard<mutex> lock(mutex_);
+    index_.clear();
+    frames_.clear();
+}
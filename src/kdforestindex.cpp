@@ -0,0 +1,71 @@
+#include "kdforestindex.h"
+#include "vl/kdtree.h"
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::vector;
+
+KdForestIndex::KdForestIndex(const cv::Mat& descriptors, int numTrees, int maxComparisons)
+    : descriptors_(descriptors.u ? descriptors : descriptors.clone())
+    , forest_(vl_kdforest_new(VL_TYPE_FLOAT, descriptors.cols, numTrees, VlDistanceL2))
+    , searcherMutex_()
+{
+    //The forest keeps a pointer to the descriptors, descriptors_ keeps them alive. A matrix that does not
+    //own its data (a FeatureView over a mapped file) is copied, the forest can outlive the mapping.
+    vl_kdforest_build(forest_, descriptors_.rows, descriptors_.ptr<float>());
+    vl_kdforest_set_max_num_comparisons(forest_, maxComparisons);
+}
+
+KdForestIndex::~KdForestIndex()
+{
+    vl_kdforest_delete(forest_);
+}
+
+shared_ptr<const KdForestIndex> KdForestIndex::build(const cv::Mat& descriptors, int numTrees, int maxComparisons)
+{
+    if (descriptors.empty() || descriptors.type() != CV_32F || !descriptors.isContinuous())
+        return nullptr;
+
+    return shared_ptr<const KdForestIndex>(new KdForestIndex(descriptors, numTrees, maxComparisons));
+}
+
+size_t KdForestIndex::getMemoryBytes() const
+{
+    size_t bytes = 0;
+    for (vl_uindex tree = 0; tree < vl_kdforest_get_num_trees(forest_); ++tree) {
+        bytes += vl_kdforest_get_num_nodes_of_tree(forest_, tree) * sizeof(VlKDTreeNode) +
+            descriptors_.rows * sizeof(VlKDTreeDataIndexEntry);
+    }
+    return bytes;
+}
+
+void KdForestIndex::searchTwoNearest(const cv::Mat& queries, vector<ForestNeighbours>& neighbours) const
+{
+    neighbours.assign(queries.rows, ForestNeighbours{ -1, 0.0f, 0.0f });
+    if (descriptors_.rows < 2 || queries.empty() || queries.type() != CV_32F || queries.cols != descriptors_.cols)
+        return;
+
+    VlKDForestSearcher* searcher;
+    {
+        lock_guard<mutex> lock(searcherMutex_);
+        searcher = vl_kdforest_new_searcher(forest_);
+    }
+    VlKDForestNeighbor found[2];
+    for (auto i = 0; i < queries.rows; ++i) {
+        vl_kdforestsearcher_query(searcher, found, 2, queries.ptr<float>(i));
+        //With a low comparison budget the search can stop before a second neighbour is seen
+        if (found[1].index == static_cast<vl_uindex>(-1))
+            continue;
+
+        neighbours[i] = {
+            static_cast<int>(found[0].index),
+            static_cast<float>(found[0].distance),
+            static_cast<float>(found[1].distance)
+        };
+    }
+    {
+        lock_guard<mutex> lock(searcherMutex_);
+        vl_kdforestsearcher_delete(searcher);
+    }
+}
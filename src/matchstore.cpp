@@ -0,0 +1,296 @@
+#include "matchstore.h"
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <fstream>
+#include <iostream>
+
+using boost::filesystem::exists;
+using boost::filesystem::file_size;
+using boost::filesystem::path;
+using boost::filesystem::resize_file;
+using boost::interprocess::file_mapping;
+using boost::interprocess::mapped_region;
+using boost::interprocess::read_only;
+using cv::DMatch;
+using std::cerr;
+using std::ifstream;
+using std::lock_guard;
+using std::make_shared;
+using std::mutex;
+using std::ofstream;
+using std::shared_ptr;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace
+{
+    struct MappedMatchFile {
+        file_mapping file;
+        mapped_region region;
+    };
+
+    uint64_t alignOffset(uint64_t offset)
+    {
+        return (offset + MATCH_FILE_ALIGNMENT - 1) / MATCH_FILE_ALIGNMENT * MATCH_FILE_ALIGNMENT;
+    }
+
+    uint64_t pairKey(uint32_t queryImage, uint32_t trainImage)
+    {
+        return (static_cast<uint64_t>(queryImage) << 32) | trainImage;
+    }
+
+    // Offsets of the three columns of a pair relative to the start of the data file
+    void columnOffsets(uint64_t offset, uint32_t count, uint64_t& trainOffset, uint64_t& distanceOffset, uint64_t& end)
+    {
+        trainOffset = alignOffset(offset + count * sizeof(int32_t));
+        distanceOffset = alignOffset(trainOffset + count * sizeof(int32_t));
+        end = distanceOffset + count * sizeof(float);
+    }
+
+    shared_ptr<MappedMatchFile> mapFile(const path& file, const char*& base, uint64_t& size)
+    {
+        base = nullptr;
+        size = 0;
+        boost::system::error_code ec;
+        if (!exists(file, ec) || file_size(file, ec) == 0)
+            return nullptr;
+
+        try {
+            auto mapped = make_shared<MappedMatchFile>();
+            mapped->file = file_mapping(file.string().c_str(), read_only);
+            mapped->region = mapped_region(mapped->file, read_only);
+            base = static_cast<const char*>(mapped->region.get_address());
+            size = mapped->region.get_size();
+            return mapped;
+        }
+        catch (const boost::interprocess::interprocess_exception& e) {
+            cerr << "Could not map " << file.string() << " : " << e.what() << "\n";
+            return nullptr;
+        }
+    }
+
+    // Only names terminated by a new line are complete, anything after the last one was cut short
+    vector<string> readImageNames(const path& file, uint64_t& validSize)
+    {
+        vector<string> names;
+        validSize = 0;
+        ifstream in(file.string(), std::ios::binary);
+        string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        size_t start = 0;
+        for (auto end = contents.find('\n'); end != string::npos; end = contents.find('\n', start)) {
+            names.push_back(contents.substr(start, end - start));
+            start = end + 1;
+        }
+        validSize = start;
+        return names;
+    }
+} //namespace
+
+vector<DMatch> PairMatches::toDMatches(int imgIdx) const
+{
+    vector<DMatch> matches;
+    matches.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        matches.emplace_back(queryIdx[i], trainIdx[i], imgIdx, distance[i]);
+    }
+    return matches;
+}
+
+MatchStore::MatchStore()
+    : indexStorage_()
+    , dataStorage_()
+    , data_(nullptr)
+    , imageNames_()
+    , imageIds_()
+    , entries_()
+    , pairIndex_()
+    , queryIndex_()
+{
+}
+
+MatchStore MatchStore::open(const string& matchesDirectory)
+{
+    MatchStore store;
+    const auto directory = path(matchesDirectory);
+    const char* index;
+    uint64_t indexSize, dataSize, namesSize;
+    store.indexStorage_ = mapFile(directory / MATCH_INDEX_FILE, index, indexSize);
+    if (!store.indexStorage_ || indexSize < sizeof(MatchFileHeader))
+        return MatchStore();
+
+    const auto header = reinterpret_cast<const MatchFileHeader*>(index);
+    if (header->magic != MATCH_FILE_MAGIC || header->version != MATCH_FILE_VERSION ||
+        header->entrySize != sizeof(MatchPairEntry)) {
+        cerr << (directory / MATCH_INDEX_FILE).string() << " is not a valid match index \n";
+        return MatchStore();
+    }
+
+    store.dataStorage_ = mapFile(directory / MATCH_DATA_FILE, store.data_, dataSize);
+    store.imageNames_ = readImageNames(directory / MATCH_IMAGES_FILE, namesSize);
+    for (uint32_t i = 0; i < store.imageNames_.size(); ++i) {
+        store.imageIds_[store.imageNames_[i]] = i;
+    }
+
+    const auto numEntries = (indexSize - sizeof(MatchFileHeader)) / sizeof(MatchPairEntry);
+    const auto entries = reinterpret_cast<const MatchPairEntry*>(index + sizeof(MatchFileHeader));
+    store.entries_.reserve(numEntries);
+    for (size_t i = 0; i < numEntries; ++i) {
+        const auto& entry = entries[i];
+        uint64_t trainOffset, distanceOffset, end;
+        columnOffsets(entry.offset, entry.count, trainOffset, distanceOffset, end);
+        if (entry.queryImage >= store.imageNames_.size() || entry.trainImage >= store.imageNames_.size() ||
+            (entry.count && end > dataSize)) {
+            //An interrupted run can leave an entry behind without its data
+            continue;
+        }
+        const auto key = pairKey(entry.queryImage, entry.trainImage);
+        const auto existing = store.pairIndex_.find(key);
+        if (existing != store.pairIndex_.end()) {
+            store.entries_[existing->second] = entry;
+            continue;
+        }
+        store.pairIndex_[key] = store.entries_.size();
+        store.queryIndex_[entry.queryImage].push_back(store.entries_.size());
+        store.entries_.push_back(entry);
+    }
+    return store;
+}
+
+PairMatches MatchStore::_makePair(const MatchPairEntry& entry) const
+{
+    uint64_t trainOffset, distanceOffset, end;
+    columnOffsets(entry.offset, entry.count, trainOffset, distanceOffset, end);
+    PairMatches matches{ entry.queryImage, entry.trainImage, entry.count, nullptr, nullptr, nullptr };
+    if (entry.count) {
+        matches.queryIdx = reinterpret_cast<const int32_t*>(data_ + entry.offset);
+        matches.trainIdx = reinterpret_cast<const int32_t*>(data_ + trainOffset);
+        matches.distance = reinterpret_cast<const float*>(data_ + distanceOffset);
+    }
+    return matches;
+}
+
+PairMatches MatchStore::pair(size_t i) const
+{
+    return _makePair(entries_[i]);
+}
+
+bool MatchStore::find(const string& queryImage, const string& trainImage, PairMatches& matches) const
+{
+    const auto queryId = imageIds_.find(queryImage);
+    const auto trainId = imageIds_.find(trainImage);
+    if (queryId == imageIds_.end() || trainId == imageIds_.end())
+        return false;
+
+    const auto entry = pairIndex_.find(pairKey(queryId->second, trainId->second));
+    if (entry == pairIndex_.end())
+        return false;
+
+    matches = pair(entry->second);
+    return true;
+}
+
+bool MatchStore::hasPair(const string& queryImage, const string& trainImage) const
+{
+    PairMatches matches;
+    return find(queryImage, trainImage, matches);
+}
+
+vector<PairMatches> MatchStore::pairsForQuery(const string& queryImage) const
+{
+    vector<PairMatches> pairs;
+    const auto queryId = imageIds_.find(queryImage);
+    if (queryId == imageIds_.end())
+        return pairs;
+
+    const auto entries = queryIndex_.find(queryId->second);
+    if (entries == queryIndex_.end())
+        return pairs;
+
+    for (const auto i : entries->second) {
+        pairs.push_back(pair(i));
+    }
+    return pairs;
+}
+
+MatchStoreWriter::MatchStoreWriter(const string& matchesDirectory)
+    : directory_(matchesDirectory)
+    , imageIds_()
+    , numImages_(0)
+    , dataSize_(0)
+    , mutex_()
+{
+    const auto directory = path(directory_);
+    const auto imagesFile = directory / MATCH_IMAGES_FILE;
+    const auto indexFile = directory / MATCH_INDEX_FILE;
+    const auto dataFile = directory / MATCH_DATA_FILE;
+
+    if (exists(imagesFile)) {
+        uint64_t validSize;
+        const auto names = readImageNames(imagesFile, validSize);
+        resize_file(imagesFile, validSize);
+        for (const auto& name : names) {
+            imageIds_[name] = numImages_++;
+        }
+    }
+
+    const auto indexSize = exists(indexFile) ? file_size(indexFile) : 0;
+    if (indexSize < sizeof(MatchFileHeader)) {
+        MatchFileHeader header{ MATCH_FILE_MAGIC, MATCH_FILE_VERSION, sizeof(MatchPairEntry), 0 };
+        ofstream out(indexFile.string(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    else {
+        //Drop a partially written entry so new entries stay aligned
+        const auto numEntries = (indexSize - sizeof(MatchFileHeader)) / sizeof(MatchPairEntry);
+        resize_file(indexFile, sizeof(MatchFileHeader) + numEntries * sizeof(MatchPairEntry));
+    }
+
+    dataSize_ = exists(dataFile) ? file_size(dataFile) : 0;
+}
+
+uint32_t MatchStoreWriter::_imageId(const string& imageName)
+{
+    const auto it = imageIds_.find(imageName);
+    if (it != imageIds_.end())
+        return it->second;
+
+    ofstream out((path(directory_) / MATCH_IMAGES_FILE).string(), std::ios::binary | std::ios::app);
+    out << imageName << '\n';
+    imageIds_[imageName] = numImages_;
+    return numImages_++;
+}
+
+bool MatchStoreWriter::append(const string& queryImage, const string& trainImage, const vector<DMatch>& matches)
+{
+    lock_guard<mutex> lock(mutex_);
+    const auto count = static_cast<uint32_t>(matches.size());
+    MatchPairEntry entry{ _imageId(queryImage), _imageId(trainImage), alignOffset(dataSize_), count, 0 };
+    uint64_t trainOffset, distanceOffset, end;
+    columnOffsets(entry.offset, count, trainOffset, distanceOffset, end);
+
+    vector<char> block(end - dataSize_, 0);
+    auto queryIdx = reinterpret_cast<int32_t*>(block.data() + (entry.offset - dataSize_));
+    auto trainIdx = reinterpret_cast<int32_t*>(block.data() + (trainOffset - dataSize_));
+    auto distance = reinterpret_cast<float*>(block.data() + (distanceOffset - dataSize_));
+    for (uint32_t i = 0; i < count; ++i) {
+        queryIdx[i] = matches[i].queryIdx;
+        trainIdx[i] = matches[i].trainIdx;
+        distance[i] = matches[i].distance;
+    }
+
+    {
+        ofstream data((path(directory_) / MATCH_DATA_FILE).string(), std::ios::binary | std::ios::app);
+        data.write(block.data(), block.size());
+        if (!data) {
+            dataSize_ = file_size(path(directory_) / MATCH_DATA_FILE);
+            return false;
+        }
+    }
+    dataSize_ = end;
+
+    ofstream index((path(directory_) / MATCH_INDEX_FILE).string(), std::ios::binary | std::ios::app);
+    index.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    return static_cast<bool>(index);
+}
@@ -82,70 +82,88 @@ bool TriangulateBearingsMidpoint(
     Radians min_angle
 )
 {
-  int n = os_list.size();
+  assert(os_list.size() == bs_list.size());
+  return TriangulateBearingsMidpoint(os_list.data(), bs_list.data(), static_cast<int>(os_list.size()),
+                                     result, threshold, min_angle);
+}
 
-  // Build Eigen matrices
-  Eigen::Matrix<double, 3, Eigen::Dynamic> os(3, n);
-  Eigen::Matrix<double, 3, Eigen::Dynamic> bs(3, n);
-  for (int i = 0; i < n; ++i)
-  {
-    auto o = os_list[i];
-    auto b = bs_list[i];
-    os.col(i) << o(0), o(1), o(2);
-    bs.col(i) << b(0), b(1), b(2);
-  }
-  //std::cout << "Triangulating bearings midpoint for os " << os << std::endl;
-  //std::cout << "Triangulating bearings midpoint for bs " << bs << std::endl;
+bool TriangulateBearingsMidpoint(
+    const Eigen::Vector3d *os,
+    const Eigen::Vector3d *bs,
+    int n,
+    Eigen::Vector3d &result,
+    double threshold,
+    Radians min_angle
+)
+{
+  if (n < 2)
+    return false;
 
-  // Check angle between rays
+  // Check angle between rays, comparing cosines saves an acos per pair
+  const double max_cos = cos(min_angle);
   bool angle_ok = false;
-  for (int i = 0; i < n; ++i)
+  for (int i = 1; i < n && !angle_ok; ++i)
   {
-    if (!angle_ok)
+    for (int j = 0; j < i && !angle_ok; ++j)
     {
-      for (int j = 0; j < i; ++j)
-      {
-        Eigen::Vector3d a, b;
-        a << bs(0, i), bs(1, i), bs(2, i);
-        b << bs(0, j), bs(1, j), bs(2, j);
-        double angle = AngleBetweenVectors(a, b);
-        if (angle >= min_angle)
-        {
-          angle_ok = true;
-        }
-      }
+      const double c = bs[i].dot(bs[j]) / sqrt(bs[i].squaredNorm() * bs[j].squaredNorm());
+      angle_ok = c < 1.0 && c <= max_cos;
     }
   }
   if (!angle_ok)
-  {
-    //std::cout << "Angle is not OK at all" << std::endl;
     return false;
-  }
 
-  //std::cout << "Angle was Ok" << std::endl;
-
-  // Triangulate
-  result = TriangulateBearingsMidpointSolve(os, bs);
-  //std::cout << "X is " << result << std::endl;
+  // Triangulate, same closed form as TriangulateBearingsMidpointSolve with fixed size matrices
+  Eigen::Matrix3d BBt = Eigen::Matrix3d::Zero();
+  Eigen::Vector3d BBtA = Eigen::Vector3d::Zero();
+  Eigen::Vector3d A = Eigen::Vector3d::Zero();
+  for (int i = 0; i < n; ++i)
+  {
+    const Eigen::Matrix3d bbt = bs[i] * bs[i].transpose();
+    BBt += bbt;
+    BBtA += bbt * os[i];
+    A += os[i];
+  }
+  const Eigen::Matrix3d Cinv = (n * Eigen::Matrix3d::Identity() - BBt).inverse();
+  result = (Eigen::Matrix3d::Identity() + BBt * Cinv) * A / n - Cinv * BBtA;
 
   // Check reprojection error
+  const double min_cos = cos(threshold);
   for (int i = 0; i < n; ++i)
   {
-    Eigen::Vector3d x_reproj = result - os.col(i);
-    Eigen::Vector3d b = bs.col(i);
-
-    double error = AngleBetweenVectors(x_reproj, b);
-    //std::cout << "Error was " << error << std::endl;
-    if (error > threshold)
-    {
-    //  std::cout << "Error was greater than treshhold" << std::endl;
+    const Eigen::Vector3d x_reproj = result - os[i];
+    const double c = x_reproj.dot(bs[i]) / sqrt(x_reproj.squaredNorm() * bs[i].squaredNorm());
+    if (c < 1.0 && c < min_cos)
       return false;
-    }
   }
 
   return true;
 }
 
+void TriangulateBearingsMidpointBatch(
+    const std::vector<Eigen::Vector3d> &os,
+    const std::vector<Eigen::Vector3d> &bs,
+    const std::vector<uint32_t> &offsets,
+    std::vector<Eigen::Vector3d> &results,
+    std::vector<uint8_t> &triangulated,
+    double threshold,
+    Radians min_angle
+)
+{
+  assert(os.size() == bs.size() && !offsets.empty() && offsets.back() == os.size());
+  const int num_points = static_cast<int>(offsets.size()) - 1;
+  results.resize(num_points);
+  triangulated.assign(num_points, 0);
+
+#pragma omp parallel for schedule(dynamic, 256)
+  for (int i = 0; i < num_points; ++i)
+  {
+    triangulated[i] = TriangulateBearingsMidpoint(os.data() + offsets[i], bs.data() + offsets[i],
+                                                  static_cast<int>(offsets[i + 1] - offsets[i]),
+                                                  results[i], threshold, min_angle);
+  }
+}
+
 } // namespace csfm
 
 /*
@@ -62,6 +62,28 @@ bool TriangulateBearingsMidpoint(
     Radians min_angle = 1.0 * CV_PI / 180
 );
 
+// Same as above over the n rays starting at os and bs
+bool TriangulateBearingsMidpoint(
+    const Eigen::Vector3d* os,
+    const Eigen::Vector3d* bs,
+    int n,
+    Eigen::Vector3d& result,
+    double treshold = 0.006,
+    Radians min_angle = 1.0 * CV_PI / 180
+);
+
+// Triangulates many points in parallel. The rays of point i are [offsets[i], offsets[i + 1])
+// of os and bs, results[i] is only valid where triangulated[i] is set
+void TriangulateBearingsMidpointBatch(
+    const std::vector<Eigen::Vector3d>& os,
+    const std::vector<Eigen::Vector3d>& bs,
+    const std::vector<uint32_t>& offsets,
+    std::vector<Eigen::Vector3d>& results,
+    std::vector<uint8_t>& triangulated,
+    double treshold = 0.006,
+    Radians min_angle = 1.0 * CV_PI / 180
+);
+
 } //namespace csfm
 
 ShoRowVector4d fitPlane(cv::Mat points, cv::Mat vectors, cv::Mat verticals);
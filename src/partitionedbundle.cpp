@@ -0,0 +1,473 @@
+#include "partitionedbundle.h"
+#include "shotracking.h"
+#include "bundle/bundle_adjuster.h"
+#include "bundle/src/absolute_motion_terms.h"
+#include "bundle/src/analytic_projection_errors.h"
+#include "bundle/src/projection_errors.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+using std::cout;
+using std::endl;
+using std::map;
+using std::string;
+using std::unique_ptr;
+using std::unordered_map;
+using std::vector;
+
+namespace
+{
+    static_assert(BA_CAMERA_NUM_PARAMS == 3, "the camera copies share the proximal term of the points");
+
+    //Pulls a separator copy towards its consensus position minus its scaled dual
+    class ProximalError : public ceres::SizedCostFunction<3, 3> {
+    public:
+        ProximalError(const double* target, double weight)
+            : target_(target)
+            , weight_(weight)
+        {}
+
+        bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override
+        {
+            for (auto i = 0; i < 3; ++i) {
+                residuals[i] = weight_ * (parameters[0][i] - target_[i]);
+            }
+            if (jacobians && jacobians[0]) {
+                for (auto i = 0; i < 9; ++i) {
+                    jacobians[0][i] = i % 4 == 0 ? weight_ : 0.0;
+                }
+            }
+            return true;
+        }
+
+    private:
+        const double* target_;
+        double weight_;
+    };
+
+    struct Cluster {
+        vector<int> images;
+        double camera[BA_CAMERA_NUM_PARAMS];
+        //Rotation and translation of every image, and its gps position
+        vector<double> shots;
+        vector<double> gps;
+        vector<int> tracks;
+        vector<double> points;
+        size_t numObservations = 0;
+        //Local index of the separators, their index in the consensus, consensus minus dual and dual
+        vector<int> separators;
+        vector<int> separatorIds;
+        vector<double> targets;
+        vector<double> duals;
+        //The same for the camera copy when the camera is optimized
+        double cameraTarget[BA_CAMERA_NUM_PARAMS];
+        double cameraDual[BA_CAMERA_NUM_PARAMS];
+        unique_ptr<ceres::Problem> problem;
+    };
+
+    //Reprojection error of an observation with the pose and the point stored in the reconstruction
+    Eigen::Vector2d reprojectionError(const Reconstruction& rec, const TrackStore& tracks, const double* camera,
+        uint32_t observation)
+    {
+        const auto& pose = rec.getShot(tracks.imageName(tracks.image(observation))).getPose();
+        const auto& rotation = pose.getRotationVector();
+        const auto& translation = pose.getTranslation();
+        const auto& position = rec.getCloudPoints().at(tracks.track(observation)).getPosition();
+        const double point[3] = { position.x, position.y, position.z };
+        const auto coordinates = tracks.point(observation);
+        Eigen::Vector2d error;
+        EvaluateAnalyticReprojection<PerspectiveCameraModel>(camera, rotation.val, translation.val, point,
+            coordinates.x, coordinates.y, 1.0, error.data(), nullptr, nullptr, nullptr, nullptr);
+        return error;
+    }
+
+    void cameraParameters(const Camera& camera, double* parameters)
+    {
+        parameters[BA_CAMERA_FOCAL] = camera.getPhysicalFocalLength();
+        parameters[BA_CAMERA_K1] = camera.getK1();
+        parameters[BA_CAMERA_K2] = camera.getK2();
+    }
+} //namespace
+
+PartitionedBundle::PartitionedBundle(Reconstruction& rec, const TrackStore& tracks, bool useGps, bool fixCamera,
+    double focalSD, double k1SD, double k2SD)
+    : rec_(rec)
+    , tracks_(tracks)
+    , useGps_(useGps)
+    , fixCamera_(fixCamera)
+    , focalSD_(focalSD)
+    , k1SD_(k1SD)
+    , k2SD_(k2SD)
+    , maxClusterShots_(500)
+    , maxOuterIterations_(20)
+    , maxInnerIterations_(10)
+    , penalty_(1.0)
+    , tolerance_(1e-4)
+    , report_()
+{}
+
+vector<vector<int>> PartitionedBundle::_partition() const
+{
+    //Union find over the images of the reconstruction, -1 for the images that are not in it
+    vector<int> parent(tracks_.numImages(), -1);
+    vector<int> size(tracks_.numImages(), 1);
+    for (const auto& [shotId, shot] : rec_.getReconstructionShots()) {
+        const auto image = tracks_.imageId(shotId);
+        if (image >= 0)
+            parent[image] = image;
+    }
+    const auto find = [&parent](int image) {
+        while (parent[image] != image) {
+            parent[image] = parent[parent[image]];
+            image = parent[image];
+        }
+        return image;
+    };
+
+    //Only the reconstructed shots and the tracks with a cloud point weigh the edges
+    vector<bool> reconstructed(parent.size());
+    for (size_t image = 0; image < parent.size(); ++image) {
+        reconstructed[image] = parent[image] >= 0;
+    }
+    vector<int> trackIds;
+    trackIds.reserve(rec_.getCloudPoints().size());
+    for (const auto& [track, cloudPoint] : rec_.getCloudPoints()) {
+        if (track >= 0 && track < static_cast<int>(tracks_.numTracks()))
+            trackIds.push_back(track);
+    }
+
+    //Strongest edges first, a merge that would make a cluster too big is refused
+    for (const auto& pair : ShoTracker::countCommonTracks(tracks_, trackIds, reconstructed)) {
+        const auto root1 = find(pair.image1);
+        const auto root2 = find(pair.image2);
+        if (root1 == root2 || size[root1] + size[root2] > maxClusterShots_)
+            continue;
+
+        parent[root2] = root1;
+        size[root1] += size[root2];
+    }
+
+    vector<vector<int>> clusters;
+    unordered_map<int, size_t> clusterOfRoot;
+    for (auto image = 0; image < static_cast<int>(parent.size()); ++image) {
+        if (parent[image] < 0)
+            continue;
+
+        const auto root = find(image);
+        if (!clusterOfRoot.count(root)) {
+            clusterOfRoot[root] = clusters.size();
+            clusters.emplace_back();
+        }
+        clusters[clusterOfRoot[root]].push_back(image);
+    }
+    return clusters;
+}
+
+void PartitionedBundle::run()
+{
+    const Reconstruction& rec = rec_;
+    ceres::CauchyLoss loss(1.0);
+    const auto partition = _partition();
+    vector<Cluster> clusters(partition.size());
+
+    //A track seen from more than one cluster is a separator with one copy per cluster
+    vector<int> owner(tracks_.numTracks(), -1);
+    vector<int> separatorId(tracks_.numTracks(), -1);
+    vector<int> numCopies;
+    vector<unordered_map<int, int>> localPoints(partition.size());
+    for (size_t c = 0; c < partition.size(); ++c) {
+        auto& cluster = clusters[c];
+        cluster.images = partition[c];
+        for (const auto image : cluster.images) {
+            for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+                const auto track = tracks_.track(*observation);
+                if (!tracks_.isAlive(*observation) || !rec.hasTrack(track))
+                    continue;
+
+                cluster.numObservations++;
+                if (localPoints[c].emplace(track, static_cast<int>(cluster.tracks.size())).second)
+                    cluster.tracks.push_back(track);
+            }
+        }
+        for (const auto track : cluster.tracks) {
+            if (owner[track] < 0) {
+                owner[track] = static_cast<int>(c);
+            }
+            else if (separatorId[track] < 0) {
+                separatorId[track] = static_cast<int>(numCopies.size());
+                numCopies.push_back(2);
+            }
+            else {
+                numCopies[separatorId[track]]++;
+            }
+        }
+    }
+    const auto numSeparators = static_cast<int>(numCopies.size());
+    vector<double> consensus(3 * numSeparators);
+    double cameraConsensus[BA_CAMERA_NUM_PARAMS];
+    cameraParameters(rec.getCamera(), cameraConsensus);
+    //Every cluster carries 1 / n of the camera prior, which scales its deviations by sqrt(n)
+    const auto priorScale = sqrt(static_cast<double>(clusters.size()));
+
+    ceres::Problem::Options problemOptions;
+    problemOptions.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    const auto weight = sqrt(penalty_);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int c = 0; c < static_cast<int>(clusters.size()); ++c) {
+        auto& cluster = clusters[c];
+        cameraParameters(rec.getCamera(), cluster.camera);
+        std::fill(cluster.cameraTarget, cluster.cameraTarget + BA_CAMERA_NUM_PARAMS, 0.0);
+        std::fill(cluster.cameraDual, cluster.cameraDual + BA_CAMERA_NUM_PARAMS, 0.0);
+        cluster.shots.resize(BA_SHOT_NUM_PARAMS * cluster.images.size());
+        cluster.gps.resize(3 * cluster.images.size());
+        for (size_t i = 0; i < cluster.images.size(); ++i) {
+            const auto& shot = rec.getShot(tracks_.imageName(cluster.images[i]));
+            const auto rotation = shot.getPose().getRotationVector();
+            const auto translation = shot.getPose().getTranslation();
+            const auto gps = shot.getMetadata().gpsPosition;
+            std::copy(rotation.val, rotation.val + 3, &cluster.shots[BA_SHOT_NUM_PARAMS * i + BA_SHOT_RX]);
+            std::copy(translation.val, translation.val + 3, &cluster.shots[BA_SHOT_NUM_PARAMS * i + BA_SHOT_TX]);
+            cluster.gps[3 * i] = gps.x;
+            cluster.gps[3 * i + 1] = gps.y;
+            cluster.gps[3 * i + 2] = gps.z;
+        }
+        cluster.points.resize(3 * cluster.tracks.size());
+        for (size_t p = 0; p < cluster.tracks.size(); ++p) {
+            const auto& position = rec.getCloudPoints().at(cluster.tracks[p]).getPosition();
+            cluster.points[3 * p] = position.x;
+            cluster.points[3 * p + 1] = position.y;
+            cluster.points[3 * p + 2] = position.z;
+            if (separatorId[cluster.tracks[p]] >= 0) {
+                cluster.separators.push_back(static_cast<int>(p));
+                cluster.separatorIds.push_back(separatorId[cluster.tracks[p]]);
+            }
+        }
+        cluster.targets.assign(3 * cluster.separators.size(), 0.0);
+        cluster.duals.assign(3 * cluster.separators.size(), 0.0);
+
+        cluster.problem.reset(new ceres::Problem(problemOptions));
+        auto& problem = *cluster.problem;
+        problem.AddParameterBlock(cluster.camera, BA_CAMERA_NUM_PARAMS);
+        if (fixCamera_) {
+            problem.SetParameterBlockConstant(cluster.camera);
+        }
+        else {
+            const auto& camera = rec.getCamera();
+            problem.AddResidualBlock(
+                new ceres::AutoDiffCostFunction<BasicRadialInternalParametersPriorError, 3, 3>(
+                    new BasicRadialInternalParametersPriorError(camera.getInitialPhysicalFocal(), focalSD_ * priorScale,
+                        camera.getInitialK1(), k1SD_ * priorScale, camera.getInitialK2(), k2SD_ * priorScale)),
+                nullptr,
+                cluster.camera);
+            problem.AddResidualBlock(new ProximalError(cluster.cameraTarget, weight), nullptr, cluster.camera);
+        }
+        for (size_t i = 0; i < cluster.images.size(); ++i) {
+            auto shot = &cluster.shots[BA_SHOT_NUM_PARAMS * i];
+            problem.AddParameterBlock(shot, BA_SHOT_NUM_PARAMS);
+            if (useGps_) {
+                const auto dop = rec.getShot(tracks_.imageName(cluster.images[i])).getMetadata().gpsDop;
+                problem.AddResidualBlock(
+                    new ceres::AutoDiffCostFunction<PositionPriorError, 3, 6>(
+                        new PositionPriorError(&cluster.gps[3 * i], dop)),
+                    nullptr,
+                    shot);
+            }
+            const auto image = cluster.images[i];
+            for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+                const auto point = localPoints[c].find(tracks_.track(*observation));
+                if (!tracks_.isAlive(*observation) || point == localPoints[c].end())
+                    continue;
+
+                const auto coordinates = tracks_.point(*observation);
+                problem.AddResidualBlock(
+                    new AnalyticReprojectionError<PerspectiveCameraModel>(coordinates.x, coordinates.y,
+                        tracks_.scale(*observation)),
+                    &loss,
+                    cluster.camera,
+                    shot,
+                    &cluster.points[3 * point->second]);
+            }
+        }
+        for (size_t s = 0; s < cluster.separators.size(); ++s) {
+            problem.AddResidualBlock(new ProximalError(&cluster.targets[3 * s], weight), nullptr,
+                &cluster.points[3 * cluster.separators[s]]);
+        }
+    }
+
+    //The first consensus is where the reconstruction has the separators
+    for (auto track = 0; track < static_cast<int>(separatorId.size()); ++track) {
+        if (separatorId[track] < 0)
+            continue;
+
+        const auto& position = rec.getCloudPoints().at(track).getPosition();
+        consensus[3 * separatorId[track]] = position.x;
+        consensus[3 * separatorId[track] + 1] = position.y;
+        consensus[3 * separatorId[track] + 2] = position.z;
+    }
+
+    report_ = PartitionedBundleReport();
+    report_.numClusters = static_cast<int>(clusters.size());
+    report_.numSeparators = numSeparators;
+    cout << "Partitioned bundle with " << clusters.size() << " clusters and " << numSeparators << " separators" << endl;
+    for (auto iteration = 0; iteration < maxOuterIterations_; ++iteration) {
+        for (auto& cluster : clusters) {
+            for (size_t s = 0; s < cluster.separators.size(); ++s) {
+                for (auto k = 0; k < 3; ++k) {
+                    cluster.targets[3 * s + k] = consensus[3 * cluster.separatorIds[s] + k] - cluster.duals[3 * s + k];
+                }
+            }
+            for (auto k = 0; k < BA_CAMERA_NUM_PARAMS; ++k) {
+                cluster.cameraTarget[k] = cameraConsensus[k] - cluster.cameraDual[k];
+            }
+        }
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int c = 0; c < static_cast<int>(clusters.size()); ++c) {
+            auto& cluster = clusters[c];
+            const auto choice = ChooseSolver({ static_cast<int>(cluster.images.size()), static_cast<int>(cluster.tracks.size()),
+                static_cast<long long>(cluster.numObservations), 0 }, 1);
+            ceres::Solver::Options options;
+            options.linear_solver_type = choice.linear_solver_type;
+            options.preconditioner_type = choice.preconditioner_type;
+            options.num_threads = 1;
+            options.max_num_iterations = maxInnerIterations_;
+            options.logging_type = ceres::SILENT;
+            ceres::Solver::Summary summary;
+            ceres::Solve(options, cluster.problem.get(), &summary);
+        }
+
+        //The new consensus is the mean of the copies shifted by their duals
+        vector<double> next(3 * numSeparators, 0.0);
+        for (const auto& cluster : clusters) {
+            for (size_t s = 0; s < cluster.separators.size(); ++s) {
+                for (auto k = 0; k < 3; ++k) {
+                    next[3 * cluster.separatorIds[s] + k] +=
+                        cluster.points[3 * cluster.separators[s] + k] + cluster.duals[3 * s + k];
+                }
+            }
+        }
+        for (auto i = 0; i < 3 * numSeparators; ++i) {
+            next[i] /= numCopies[i / 3];
+        }
+
+        auto primal = 0.0;
+        auto numCopiesTotal = 0;
+        for (auto& cluster : clusters) {
+            for (size_t s = 0; s < cluster.separators.size(); ++s) {
+                for (auto k = 0; k < 3; ++k) {
+                    const auto r = cluster.points[3 * cluster.separators[s] + k] - next[3 * cluster.separatorIds[s] + k];
+                    cluster.duals[3 * s + k] += r;
+                    primal += r * r;
+                }
+                numCopiesTotal++;
+            }
+        }
+        auto dual = 0.0;
+        for (auto i = 0; i < 3 * numSeparators; ++i) {
+            dual += (next[i] - consensus[i]) * (next[i] - consensus[i]);
+        }
+        consensus.swap(next);
+
+        //The camera is one more separator, with a copy in every cluster
+        auto cameraPrimal = 0.0;
+        auto cameraDual = 0.0;
+        if (!fixCamera_) {
+            double nextCamera[BA_CAMERA_NUM_PARAMS] = {};
+            for (const auto& cluster : clusters) {
+                for (auto k = 0; k < BA_CAMERA_NUM_PARAMS; ++k) {
+                    nextCamera[k] += (cluster.camera[k] + cluster.cameraDual[k]) / clusters.size();
+                }
+            }
+            for (auto& cluster : clusters) {
+                for (auto k = 0; k < BA_CAMERA_NUM_PARAMS; ++k) {
+                    const auto r = cluster.camera[k] - nextCamera[k];
+                    cluster.cameraDual[k] += r;
+                    cameraPrimal += r * r;
+                }
+            }
+            for (auto k = 0; k < BA_CAMERA_NUM_PARAMS; ++k) {
+                cameraDual += (nextCamera[k] - cameraConsensus[k]) * (nextCamera[k] - cameraConsensus[k]);
+                cameraConsensus[k] = nextCamera[k];
+            }
+        }
+
+        report_.outerIterations = iteration + 1;
+        report_.primalResidual = numCopiesTotal ? sqrt(primal / numCopiesTotal) : 0.0;
+        report_.cameraResidual = clusters.empty() ? 0.0 : sqrt(cameraPrimal / clusters.size());
+        const auto dualResidual = numSeparators ? penalty_ * sqrt(dual / numSeparators) : 0.0;
+        const auto cameraDualResidual = penalty_ * sqrt(cameraDual);
+        cout << "Partitioned bundle iteration " << iteration << ": primal residual " << report_.primalResidual
+            << ", dual residual " << dualResidual << ", camera residual " << report_.cameraResidual << endl;
+        if (report_.primalResidual < tolerance_ && dualResidual < tolerance_ &&
+            report_.cameraResidual < tolerance_ && cameraDualResidual < tolerance_)
+            break;
+    }
+
+    for (const auto& cluster : clusters) {
+        for (size_t i = 0; i < cluster.images.size(); ++i) {
+            auto& pose = rec_.getShot(tracks_.imageName(cluster.images[i])).getPose();
+            std::copy(&cluster.shots[BA_SHOT_NUM_PARAMS * i + BA_SHOT_RX], &cluster.shots[BA_SHOT_NUM_PARAMS * i + BA_SHOT_RX] + 3,
+                pose.rotationData());
+            std::copy(&cluster.shots[BA_SHOT_NUM_PARAMS * i + BA_SHOT_TX], &cluster.shots[BA_SHOT_NUM_PARAMS * i + BA_SHOT_TX] + 3,
+                pose.translationData());
+            pose.updateCache();
+        }
+        for (size_t p = 0; p < cluster.tracks.size(); ++p) {
+            const auto track = cluster.tracks[p];
+            const auto point = separatorId[track] < 0 ? &cluster.points[3 * p] : &consensus[3 * separatorId[track]];
+            rec_.getCloudPoints().at(track).setPosition({ point[0], point[1], point[2] });
+        }
+    }
+
+    if (!fixCamera_) {
+        auto& camera = rec_.getCamera();
+        camera.setFocalWithPhysical(cameraConsensus[BA_CAMERA_FOCAL]);
+        camera.setK1(cameraConsensus[BA_CAMERA_K1]);
+        camera.setK2(cameraConsensus[BA_CAMERA_K2]);
+    }
+
+    double camera[BA_CAMERA_NUM_PARAMS];
+    cameraParameters(rec.getCamera(), camera);
+    auto sum = 0.0;
+    size_t count = 0;
+    for (auto& [track, cloudPoint] : rec_.getCloudPoints()) {
+        map<string, Eigen::VectorXd> errors;
+        for (auto observation = tracks_.trackBegin(track); observation < tracks_.trackEnd(track); ++observation) {
+            const auto& imageName = tracks_.imageName(tracks_.image(observation));
+            if (!tracks_.isAlive(observation) || !rec.hasShot(imageName))
+                continue;
+
+            const auto error = reprojectionError(rec, tracks_, camera, observation);
+            errors[imageName] = error;
+            sum += error.squaredNorm();
+            count++;
+        }
+        cloudPoint.setError(errors);
+    }
+    report_.rmsReprojectionError = count ? sqrt(sum / count) : 0.0;
+    cout << "Partitioned bundle finished after " << report_.outerIterations << " iterations with a reprojection error of "
+        << report_.rmsReprojectionError << endl;
+}
+
+double PartitionedBundle::rmsReprojectionError(const Reconstruction& rec, const TrackStore& tracks)
+{
+    double camera[BA_CAMERA_NUM_PARAMS];
+    cameraParameters(rec.getCamera(), camera);
+    auto sum = 0.0;
+    size_t count = 0;
+    for (const auto& [track, cloudPoint] : rec.getCloudPoints()) {
+        for (auto observation = tracks.trackBegin(track); observation < tracks.trackEnd(track); ++observation) {
+            if (tracks.isAlive(observation) && rec.hasShot(tracks.imageName(tracks.image(observation)))) {
+                sum += reprojectionError(rec, tracks, camera, observation).squaredNorm();
+                count++;
+            }
+        }
+    }
+    return count ? sqrt(sum / count) : 0.0;
+}
@@ -25,12 +25,13 @@ using cv::Mat3d;
 using cv::Vec2d;
 using cv::Point3d;
 
-Reconstruction::Reconstruction() : shots(), cloudPoints(), camera(), lastPointCount(), lastShotCount() {}
+Reconstruction::Reconstruction() : shots(), cloudPoints(), cameras(1), lastPointCount(), lastShotCount() {}
 
-Reconstruction::Reconstruction(Camera camera) :camera(camera), lastPointCount(), lastShotCount() {}
+Reconstruction::Reconstruction(Camera camera) :cameras{ camera }, lastPointCount(), lastShotCount() {}
 
-void Reconstruction::addShot(std::string shotId, Shot shot)
+void Reconstruction::addShot(const std::string& shotId, const Shot& shot)
 {
+    CV_Assert(shot.getCameraId() >= 0 && shot.getCameraId() < static_cast<int>(cameras.size()));
     shots[shotId] = shot;
 }
 
@@ -55,27 +56,89 @@ std::map<int, CloudPoint>& Reconstruction::getCloudPoints()
     return cloudPoints;
 }
 
-bool Reconstruction::hasShot(string shotId) const
+bool Reconstruction::hasShot(const string& shotId) const
 {
     return this->shots.find(shotId) != this->shots.end();
 }
 
 void Reconstruction::addCloudPoint(CloudPoint cp) {
+    const auto isNew = !hasTrack(cp.getId());
     cloudPoints[cp.getId()] = cp;
+    if (isNew)
+        _countTrack(cp.getId(), 1);
 }
 
-bool Reconstruction::hasTrack(std::string trackId) const
+bool Reconstruction::hasTrack(int trackId) const
 {
-    return cloudPoints.find(stoi(trackId)) != cloudPoints.end();
+    return cloudPoints.find(trackId) != cloudPoints.end();
 }
 
-const Camera& Reconstruction::getCamera() const
+void Reconstruction::removeCloudPoint(int trackId)
 {
-    return camera;
+    if (cloudPoints.erase(trackId))
+        _countTrack(trackId, -1);
 }
 
-Camera& Reconstruction::getCamera() {
-    return camera;
+void Reconstruction::setTrackStore(const TrackStore& tracks)
+{
+    trackStore = &tracks;
+    imageTrackCounts.assign(tracks.numImages(), 0);
+    imageChanged.assign(tracks.numImages(), 0);
+    changedImages.clear();
+    for (const auto&[trackId, cp] : cloudPoints) {
+        _countTrack(trackId, 1);
+    }
+}
+
+void Reconstruction::removeObservation(int trackId, int image)
+{
+    if (!trackStore || image < 0 || !hasTrack(trackId))
+        return;
+
+    imageTrackCounts[image]--;
+    _markChanged(image);
+}
+
+vector<int> Reconstruction::takeChangedImages()
+{
+    for (const auto image : changedImages) {
+        imageChanged[image] = 0;
+    }
+    vector<int> images;
+    images.swap(changedImages);
+    return images;
+}
+
+void Reconstruction::_markChanged(int image)
+{
+    if (!imageChanged[image]) {
+        imageChanged[image] = 1;
+        changedImages.push_back(image);
+    }
+}
+
+void Reconstruction::_countTrack(int trackId, int delta)
+{
+    if (!trackStore)
+        return;
+
+    for (auto observation = trackStore->trackBegin(trackId); observation < trackStore->trackEnd(trackId); ++observation) {
+        if (!trackStore->isAlive(observation))
+            continue;
+
+        const auto image = trackStore->image(observation);
+        imageTrackCounts[image] += delta;
+        _markChanged(image);
+    }
+}
+
+const Camera& Reconstruction::getCamera(int cameraId) const
+{
+    return cameras[cameraId];
+}
+
+Camera& Reconstruction::getCamera(int cameraId) {
+    return cameras[cameraId];
 }
 
 void Reconstruction::updateLastCounts()
@@ -200,12 +263,12 @@ void Reconstruction::setGPS(bool useGps)
     usesGPS = useGps;
 }
 
-const Shot& Reconstruction::getShot(std::string shotId) const
+const Shot& Reconstruction::getShot(const std::string& shotId) const
 {
     return shots.at(shotId);
 }
 
-Shot& Reconstruction::getShot(std::string shotId)
+Shot& Reconstruction::getShot(const std::string& shotId)
 {
     return shots.at(shotId);
 }
@@ -227,13 +290,13 @@ tuple<double, cv::Matx33d, ShoColumnVector3d> Reconstruction::getGPSTransform()
     Mat plane(0, 3, CV_64FC1);
     Mat verticals(0, 3, CV_64FC1);
 
-    for (const auto[imageName, shot] : shots) {
+    for (const auto&[imageName, shot] : shots) {
         auto shotOrigin = Mat(shot.getPose().getOrigin());
         shotOrigin = shotOrigin.reshape(1, 1);
         shotOrigins.push_back(shotOrigin);
         Vec2d shotOrigin2D((double*)shotOrigin.colRange(0, 2).data);
         shotOrigins2D.push_back(shotOrigin2D);
-        const auto gpsPosition = shot.getMetadata().gpsPosition;
+        const auto& gpsPosition = shot.getMetadata().gpsPosition;
         gpsPositions.push_back({ gpsPosition.x, gpsPosition.y, gpsPosition.z });
         gpsPositions2D.push_back(Vec2d{ gpsPosition.x, gpsPosition.y });
         const auto[x, y, z] = shot.getOrientationVectors();
@@ -313,7 +376,7 @@ void Reconstruction::saveReconstruction(const string recFileName) const
     recFile << "property uchar diffuse_green\n";
     recFile << "property uchar diffuse_blue\n";
     recFile << "end_header\n";
-    for (const auto [trackId, cp] : cloudPoints) {
+    for (const auto& [trackId, cp] : cloudPoints) {
         recFile << cp.getPosition().x << " " << cp.getPosition().y << " " << cp.getPosition().z << " " << 
             cp.getColor()[0] << " " <<cp.getColor()[1]<< " " 
             << cp.getColor()[2] << "\n";
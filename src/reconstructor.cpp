@@ -1,11 +1,15 @@
 #include "reconstructor.h"
-#include <boost/graph/adjacency_iterator.hpp>
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d.hpp>
 #include <opencv2/cudalegacy.hpp>
 #include <vector>
 #include <future>
+#include <atomic>
+#include <thread>
 #include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <queue>
 #include "multiview.h"
 #include "transformations.h"
 #include <opengv/relative_pose/CentralRelativeAdapter.hpp>  
@@ -19,7 +23,6 @@
 #include "utilities.h"
 
 
-using csfm::TriangulateBearingsMidpoint;
 using std::cerr;
 using std::cout;
 using std::map;
@@ -27,6 +30,7 @@ using std::pair;
 using std::set;
 using std::sort;
 using std::tuple;
+using std::unordered_map;
 using std::vector;
 using std::cerr;
 using std::string;
@@ -64,99 +68,60 @@ using opengv::rotation_t;
 using opengv::translation_t;
 
 Reconstructor::Reconstructor(
-    FlightSession flight, TrackGraph tg)
+    FlightSession flight, TrackStore tracks)
     : flight_(flight),
-    tg_(tg),
-    shotOrigins(),
-    rInverses() {
-    std::pair<vertex_iterator, vertex_iterator> allVertices =
-        boost::vertices(tg_);
-    for (; allVertices.first != allVertices.second; ++allVertices.first) {
-        if (tg_[*allVertices.first].is_image) {
-            imageNodes_[tg_[*allVertices.first].name] = *allVertices.first;
-        }
-        else {
-            trackNodes_[tg_[*allVertices.first].name] = *allVertices.first;
-        }
-    }
+    tracks_(std::move(tracks)) {
+    //Every observation is undistorted once here, triangulation only reads the bearings
+    Bearings bearings;
+    flight_.getCamera().normalizedPointsToBearings<BrownModel>(tracks_.observationPoints(), bearings);
+    tracks_.setBearings(std::move(bearings));
 }
 
 void Reconstructor::_alignMatchingPoints(const CommonTrack track,
     vector<Point2f>& points1,
     vector<Point2f>& points2) const {
-    const auto im1 = getImageNode(track.imagePair.first);
-    const auto im2 = getImageNode(track.imagePair.second);
-
-    const auto tracks = track.commonTracks;
-    map<string, Point2d> aPoints1, aPoints2;
-    const auto[edges1Begin, edges1End] = boost::out_edges(im1, tg_);
-    const auto[edges2Begin, edges2End] = boost::out_edges(im2, tg_);
-
-    for (auto edgeIt = edges1Begin; edgeIt != edges1End; ++edgeIt) {
-        if (tracks.find(this->tg_[*edgeIt].trackName) != tracks.end()) {
-            aPoints1[this->tg_[*edgeIt].trackName] =
-                this->tg_[*edgeIt].fProp.coordinates;
-        }
-    }
+    const auto im1 = tracks_.imageId(track.imagePair.first);
+    const auto im2 = tracks_.imageId(track.imagePair.second);
 
-    for (auto edgeIt = edges2Begin; edgeIt != edges2End; ++edgeIt) {
-        if (tracks.find(this->tg_[*edgeIt].trackName) != tracks.end()) {
-            aPoints2[this->tg_[*edgeIt].trackName] =
-                this->tg_[*edgeIt].fProp.coordinates;
-        }
-    }
-
-    for (auto track : tracks) {
-        points1.push_back(aPoints1[track]);
-        points2.push_back(aPoints2[track]);
+    //A track whose observation was removed as an outlier keeps its place with a zero point
+    for (const auto trackId : track.commonTracks) {
+        const auto observation1 = tracks_.findObservation(trackId, im1);
+        const auto observation2 = tracks_.findObservation(trackId, im2);
+        points1.push_back(observation1 >= 0 ? Point2f(tracks_.point(observation1)) : Point2f());
+        points2.push_back(observation2 >= 0 ? Point2f(tracks_.point(observation2)) : Point2f());
     }
 
-    assert(points1.size() == tracks.size() && points2.size() == tracks.size());
+    assert(points1.size() == track.commonTracks.size() && points2.size() == track.commonTracks.size());
 }
 
 vector<DMatch> Reconstructor::_getTrackDMatchesForImagePair(
     const CommonTrack track) const {
-    const auto im1 = getImageNode(track.imagePair.first);
-    const auto im2 = getImageNode(track.imagePair.second);
-
-    const auto tracks = track.commonTracks;
-    map<string, ImageFeatureNode> aPoints1, aPoints2;
-    pair<out_edge_iterator, out_edge_iterator> im1Edges =
-        boost::out_edges(im1, this->tg_);
-    pair<out_edge_iterator, out_edge_iterator> im2Edges =
-        boost::out_edges(im2, this->tg_);
-    for (; im1Edges.first != im1Edges.second; ++im1Edges.first) {
-        if (tracks.find(tg_[*im1Edges.first].trackName) != tracks.end()) {
-            aPoints1[tg_[*im1Edges.first].trackName] =
-                tg_[*im1Edges.first].fProp.featureNode;
-        }
-    }
-    for (; im2Edges.first != im2Edges.second; ++im2Edges.first) {
-        if (tracks.find(this->tg_[*im2Edges.first].trackName) != tracks.end()) {
-            aPoints2[this->tg_[*im2Edges.first].trackName] =
-                this->tg_[*im2Edges.first].fProp.featureNode;
-        }
-    }
+    const auto im1 = tracks_.imageId(track.imagePair.first);
+    const auto im2 = tracks_.imageId(track.imagePair.second);
 
     vector<DMatch> imageTrackMatches;
-    for (auto track : tracks) {
-        imageTrackMatches.push_back(
-            { aPoints1[track].second, aPoints2[track].second, 1.0 });
+    for (const auto trackId : track.commonTracks) {
+        const auto observation1 = tracks_.findObservation(trackId, im1);
+        const auto observation2 = tracks_.findObservation(trackId, im2);
+        imageTrackMatches.push_back({
+            observation1 >= 0 ? tracks_.feature(observation1) : 0,
+            observation2 >= 0 ? tracks_.feature(observation2) : 0,
+            1.0 });
     }
-    assert(imageTrackMatches.size() == tracks.size());
+    assert(imageTrackMatches.size() == track.commonTracks.size());
 
     return imageTrackMatches;
 }
 
-void Reconstructor::_addCameraToBundle(BundleAdjuster &ba,
-    const Camera camera, bool fixCameras) {
-    ba.AddPerspectiveCamera("1", camera.getPhysicalFocalLength(), camera.getK1(),
+int Reconstructor::_addCameraToBundle(BundleAdjuster &ba,
+    const Camera& camera, bool fixCameras) {
+    return ba.AddIndexedPerspectiveCamera(camera.getPhysicalFocalLength(), camera.getK1(),
         camera.getK2(), camera.getInitialPhysicalFocal(),
         camera.getInitialK1(), camera.getInitialK2(), fixCameras);
 }
 
-void Reconstructor::_getCameraFromBundle(BundleAdjuster &ba, Camera &cam) {
-    auto c = ba.GetPerspectiveCamera("1");
+void Reconstructor::_getCameraFromBundle(BundleAdjuster &ba, int camera, Camera &cam) {
+    auto c = ba.GetIndexedPerspectiveCamera(camera);
     cam.setFocalWithPhysical(c.GetFocal());
     cam.setK1(c.GetK1());
     cam.setK2(c.GetK2());
@@ -183,7 +148,7 @@ TwoViewPose Reconstructor::recoverTwoCameraViewPose(CommonTrack track, Mat &mask
     return std::make_tuple(true, essentialMatrix, r, t);
 }
 
-TwoViewPose Reconstructor::twoViewReconstructionRotationOnly(CommonTrack track, cv::Mat & mask)
+TwoViewPose Reconstructor::twoViewReconstructionRotationOnly(const CommonTrack& track, cv::Mat & mask) const
 {
     vector<Point2f> points1;
     vector<Point2f> points2;
@@ -193,11 +158,7 @@ TwoViewPose Reconstructor::twoViewReconstructionRotationOnly(CommonTrack track,
     auto bearings2 = flight_.getCamera().normalizedPointsToBearingVec(points2);
 
     CentralRelativeAdapter adapter(bearings1, bearings2);
-    size_t iterations = 100;
-    rotation_t relativeRotation;
-    for (auto i = 0; i < iterations; ++i) {
-        relativeRotation = opengv::relative_pose::rotationOnly(adapter);
-    }
+    const auto relativeRotation = opengv::relative_pose::rotationOnly(adapter);
     return  _computeRotationInliers(bearings1, bearings2, relativeRotation, mask);
 }
 
@@ -301,7 +262,7 @@ TwoViewPose Reconstructor::_computeRotationInliers(opengv::bearingVectors_t& b1,
 }
 
 float Reconstructor::computeReconstructabilityScore(int tracks, Mat mask,
-    int tresh) {
+    int tresh) const {
     //We use rotation only corrspondence to compute the reconstruction score
     auto inliers = countNonZero(mask);
     auto outliers = tracks - inliers;
@@ -314,23 +275,51 @@ float Reconstructor::computeReconstructabilityScore(int tracks, Mat mask,
 
 void Reconstructor::computeReconstructability(
     const ShoTracker &tracker, vector<CommonTrack>& commonTracks) {
-    auto imageNodes = tracker.getImageNodes();
+    //The score of a pair is a count of outliers so it can not exceed the number of shared tracks.
+    //Pairs are scored from the most shared tracks down and the workers stop as soon as that bound
+    //can not beat the best score found so far.
+    std::stable_sort(std::begin(commonTracks), std::end(commonTracks),
+        [](const CommonTrack& a, const CommonTrack& b) { return a.commonTracks.size() > b.commonTracks.size(); });
     for (auto &track : commonTracks) {
-        Mat mask;
-        bool success{};
-        Mat essentialMat, rotation, translation;
-        std::tie(success, essentialMat, rotation, translation) = twoViewReconstructionRotationOnly(track, mask);
-        if (success) {
-            track.rScore = computeReconstructabilityScore(track.commonTracks.size(), mask);
-        }
-        else {
-            track.rScore = 0.0;
-        }
+        track.rScore = -1.0;
+    }
+
+    const auto numWorkers = std::min(std::max(1u, std::thread::hardware_concurrency()),
+        static_cast<unsigned>(commonTracks.size()));
+    std::atomic<size_t> nextPair{ 0 };
+    std::atomic<size_t> numScored{ 0 };
+    std::atomic<int> bestScore{ -1 };
+    vector<std::thread> workers;
+    for (auto i = 0u; i < numWorkers; ++i) {
+        workers.emplace_back([&]() {
+            for (auto index = nextPair++; index < commonTracks.size(); index = nextPair++) {
+                auto &track = commonTracks[index];
+                if (bestScore.load() >= static_cast<int>(track.commonTracks.size()))
+                    break;
+
+                Mat mask;
+                bool success{};
+                Mat essentialMat, rotation, translation;
+                std::tie(success, essentialMat, rotation, translation) = twoViewReconstructionRotationOnly(track, mask);
+                track.rScore = success ? computeReconstructabilityScore(track.commonTracks.size(), mask) : 0.0f;
+                numScored++;
+
+                const auto score = static_cast<int>(track.rScore);
+                auto best = bestScore.load();
+                while (score > best && !bestScore.compare_exchange_weak(best, score)) {
+                }
+            }
+        });
     }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    cout << "Scored " << numScored << " of " << commonTracks.size() << " candidate pairs, best score is "
+        << bestScore << endl;
 
-    sort(std::begin(commonTracks), std::end(commonTracks),
+    //Pairs that were not scored stay behind the scored ones in shared track order
+    std::stable_sort(std::begin(commonTracks), std::end(commonTracks),
         [](const CommonTrack& a, const CommonTrack& b) { return a.rScore > b.rScore; });
-
 }
 
 //“Motion and Structure from Motion in a Piecewise Planar Environment. See paper
@@ -356,10 +345,8 @@ void Reconstructor::runIncrementalReconstruction(const ShoTracker& tracker) {
     
     vector<Reconstruction> reconstructions;
     set<string> reconstructionImages;
-    for (const auto it : this->imageNodes_) {
-        reconstructionImages.insert(it.first);
-    }
-    auto commonTracks = tracker.commonTracks(this->tg_);
+    reconstructionImages.insert(tracks_.imageNames().begin(), tracks_.imageNames().end());
+    auto commonTracks = tracker.commonTracks(tracks_, RECONSTRUCTABILITY_MAX_PAIRS);
     computeReconstructability(tracker, commonTracks);
     for (auto track : commonTracks) {
         if (reconstructionImages.find(track.imagePair.first) !=
@@ -411,6 +398,7 @@ void Reconstructor::runIncrementalReconstruction(const ShoTracker& tracker) {
 Reconstructor::OptionalReconstruction Reconstructor::beginReconstruction(CommonTrack track, const ShoTracker &tracker)
 {
     Reconstruction rec(flight_.getCamera());
+    rec.setTrackStore(tracks_);
 
     //Disable gps alignment. Alignment is broken
     rec.setGPS(flight_.hasGps());
@@ -441,12 +429,12 @@ Reconstructor::OptionalReconstruction Reconstructor::beginReconstruction(CommonT
     Rodrigues(r, rVec);
     Mat distortion;
 
-    const auto shot1Image = flight_.getImageSet()[flight_.getImageIndex(track.imagePair.first)];
-    const auto shot2Image = flight_.getImageSet()[flight_.getImageIndex(track.imagePair.second)];
+    const auto& shot1Image = flight_.getImageSet()[flight_.getImageIndex(track.imagePair.first)];
+    const auto& shot2Image = flight_.getImageSet()[flight_.getImageIndex(track.imagePair.second)];
     ShotMetadata shot1Metadata(shot1Image.getMetadata(), flight_);
     ShotMetadata shot2Metadata(shot2Image.getMetadata(), flight_);
-    Shot shot1(track.imagePair.first, flight_.getCamera(), Pose(), shot1Metadata);
-    Shot shot2(track.imagePair.second, flight_.getCamera(), Pose(rVec, t), shot2Metadata);
+    Shot shot1(track.imagePair.first, DEFAULT_CAMERA_ID, Pose(), shot1Metadata);
+    Shot shot2(track.imagePair.second, DEFAULT_CAMERA_ID, Pose(rVec, t), shot2Metadata);
 
     rec.addShot(shot1.getId(), shot1);
     rec.addShot(shot2.getId(), shot2);
@@ -467,7 +455,10 @@ Reconstructor::OptionalReconstruction Reconstructor::beginReconstruction(CommonT
 }
 
 void Reconstructor::continueReconstruction(Reconstruction& rec, set<string>& images) {
-    bundle(rec);
+    //One bundle problem for the whole reconstruction, each bundle only adds what changed since the last one
+    BundleSession session(rec, tracks_, flight_.hasGps() && rec.usesGps(), !OPTIMIZE_CAMERA_PARAEMETERS,
+        EXIF_FOCAL_SD, RADIAL_DISTORTION_K1_SD, RADIAL_DISTORTION_K2_SD);
+    bundle(session);
     removeOutliers(rec);
     rec.alignToGps();
     colorReconstruction(rec);
@@ -476,204 +467,295 @@ void Reconstructor::continueReconstruction(Reconstruction& rec, set<string>& ima
     rec.saveReconstruction(partialRecFileName);
     exportToMvs(rec, partialMVSFileName);
     rec.updateLastCounts();
+    //Candidates are a max-heap on their reconstructed tracks. An entry goes stale when the count of its
+    //image changes, a fresh one is pushed then and the stale one is dropped when it reaches the top.
+    using Candidate = pair<int, int>;
+    std::priority_queue<Candidate> candidates;
+    vector<uint8_t> remaining(tracks_.numImages(), 0);
+    vector<int> queuedCount(tracks_.numImages(), -1);
+    for (const auto& imageName : images) {
+        const auto image = tracks_.imageId(imageName);
+        if (image >= 0 && !rec.hasShot(imageName))
+            remaining[image] = 1;
+    }
+    const auto queueCandidate = [&](int image) {
+        const auto count = rec.reconstructedTrackCount(image);
+        if (remaining[image] && count >= RESECTION_MIN_POINTS && count != queuedCount[image]) {
+            candidates.emplace(count, image);
+            queuedCount[image] = count;
+        }
+    };
+    rec.takeChangedImages();
+    for (auto image = 0; image < static_cast<int>(remaining.size()); ++image) {
+        queueCandidate(image);
+    }
+
+    vector<uint8_t> usedTracks(tracks_.numTracks(), 0);
     while (1) {
-        auto candidates = reconstructedPointForImages(rec, images);
-        if (candidates.empty())
-            break;
+        for (const auto image : rec.takeChangedImages()) {
+            queueCandidate(image);
+        }
 
-        for (auto[imageName, numTracks] : candidates) {
-            auto before = rec.getCloudPoints().size();
-            auto imageVertex = getImageNode(imageName);
-            auto[status, report] = resect(rec, imageVertex);
-            if (!status)
+        //The best candidates are resected together and ranked by inliers. Several are added in one step
+        //only while the points they were resected against are untouched: the tracks of the shots added
+        //before them and the points moved by a local bundle are marked, a global bundle moves them all.
+        auto added = 0;
+        vector<int> deferred;
+        while (!added && !candidates.empty()) {
+            vector<int> batchImages;
+            while (batchImages.size() < RESECTION_BATCH_SIZE && !candidates.empty()) {
+                const auto[count, image] = candidates.top();
+                candidates.pop();
+                if (!remaining[image] || count != queuedCount[image])
+                    continue;
+
+                queuedCount[image] = -1;
+                batchImages.push_back(image);
+            }
+            if (batchImages.empty())
                 continue;
 
-            singleViewBundleAdjustment(imageName, rec);
-            rec.saveReconstruction("partialgreen.ply");
-            cerr << "Adding " << imageName << " to the reconstruction \n";
-            images.erase(imageName);
-            triangulateShotTracks(imageName, rec);
-
-            if (rec.needsRetriangulation()) {
-                cerr << "Retriangulating reconstruction \n";
-                bundle(rec);
-                retriangulate(rec);
-                bundle(rec);
-                removeOutliers(rec);
-                rec.alignToGps();
-                rec.updateLastCounts();
-            }
-            else if (rec.needsBundling()) {
-                bundle(rec);
-                removeOutliers(rec);
-                rec.alignToGps();
-                rec.updateLastCounts();
-            }
-            else {
-                //TODO implement local neighbourhood shot bundling
-                localBundleAdjustment(imageName, rec);
+            const auto observations = _reconstructedObservations(rec, batchImages);
+
+            const auto batchSize = static_cast<int>(batchImages.size());
+            vector<Resection> resections(batchSize);
+#pragma omp parallel for schedule(dynamic)
+            for (auto i = 0; i < batchSize; ++i) {
+                resections[i] = _solveResection(rec, batchImages[i], observations[i], 1000, 0.999);
             }
-            auto after = rec.getCloudPoints().size();
-            if (after - before > 0 && before > 0)
-            {
-                cerr << "Added " << after - before << " points to the reconstruction \n";
+            std::stable_sort(resections.begin(), resections.end(), [](const Resection& a, const Resection& b) {
+                return a.status && (!b.status || a.report.numInliers > b.report.numInliers);
+            });
+
+            auto modelMoved = false;
+            for (const auto& resection : resections) {
+                const auto overlaps = std::any_of(resection.inlierTracks.begin(), resection.inlierTracks.end(),
+                    [&usedTracks](int track) { return usedTracks[track] != 0; });
+                if (!resection.status || overlaps || modelMoved) {
+                    deferred.push_back(resection.image);
+                    continue;
+                }
+
+                const auto imageName = tracks_.imageName(resection.image);
+                auto before = rec.getCloudPoints().size();
+                _addResectedShot(rec, resection);
+                for (const auto track : resection.inlierTracks) {
+                    usedTracks[track] = 1;
+                }
+                remaining[resection.image] = 0;
+                added++;
+
+                singleViewBundleAdjustment(imageName, rec);
+                rec.saveReconstruction("partialgreen.ply");
+                cerr << "Adding " << imageName << " to the reconstruction \n";
+                images.erase(imageName);
+                triangulateShotTracks(imageName, rec);
+
+                modelMoved = true;
+                if (rec.needsRetriangulation()) {
+                    cerr << "Retriangulating reconstruction \n";
+                    bundle(session);
+                    retriangulate(rec);
+                    bundle(session);
+                    removeOutliers(rec);
+                    rec.alignToGps();
+                    rec.updateLastCounts();
+                }
+                else if (rec.needsBundling()) {
+                    bundle(session);
+                    removeOutliers(rec);
+                    rec.alignToGps();
+                    rec.updateLastCounts();
+                }
+                else {
+                    //Only the points of the local bundle moved, resections against other points still hold
+                    for (const auto track : localBundleAdjustment(imageName, rec)) {
+                        usedTracks[track] = 1;
+                    }
+                    modelMoved = false;
+                }
+                auto after = rec.getCloudPoints().size();
+                if (after - before > 0 && before > 0)
+                {
+                    cerr << "Added " << after - before << " points to the reconstruction \n";
+                }
             }
         }
-        bundle(rec);
-        removeOutliers(rec);
-        rec.alignToGps();
-        return;
+        std::fill(usedTracks.begin(), usedTracks.end(), 0);
+        if (!added)
+            break;
+
+        //Candidates that did not make it are queued again, the new points may let them resect now
+        for (const auto image : deferred) {
+            queueCandidate(image);
+        }
     }
+    bundle(session);
+    removeOutliers(rec);
+    rec.alignToGps();
 }
 
 void Reconstructor::triangulateShotTracks(string image1, Reconstruction &rec) {
     cout << "Triangulating tracks for " << image1 << '\n';
-    auto im1 = imageNodes_[image1];
+    const auto image = tracks_.imageId(image1);
+    if (image < 0)
+        return;
 
-    const auto[edgesBegin, edgesEnd] = boost::out_edges(im1, this->tg_);
+    vector<int> tracks;
+    for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+        if (!tracks_.isAlive(*observation))
+            continue;
 
-    for (auto tracksIter = edgesBegin; tracksIter != edgesEnd; ++tracksIter) {
-        auto track = tg_[*tracksIter].trackName;
-        if (rec.getCloudPoints().find(stoi(track)) == rec.getCloudPoints().end())
-            triangulateTrack(track, rec);
+        const auto track = tracks_.track(*observation);
+        if (rec.getCloudPoints().find(track) == rec.getCloudPoints().end())
+            tracks.push_back(track);
     }
+    triangulateTracks(tracks, rec);
 }
 
-void Reconstructor::triangulateTrack(string trackId, Reconstruction& rec) {
-    rInverses.clear();
-    shotOrigins.clear();
-    Eigen::Vector3d x;
-    vector<Eigen::Vector3d> originList, bearingList;
-
-    try {
-        auto track = trackNodes_.at(trackId);
-        std::pair<adjacency_iterator, adjacency_iterator> neighbors =
-            boost::adjacent_vertices(track, tg_);
-        for (; neighbors.first != neighbors.second; ++neighbors.first) {
-            auto shotId = tg_[*neighbors.first].name;
-            if (rec.hasShot(shotId)) {
-                auto shot = rec.getShot(shotId);
-                auto edgePair = boost::edge(track, this->imageNodes_[shotId], this->tg_);
-                auto edgeDescriptor = edgePair.first;
-                auto fCol = tg_[edgeDescriptor].fProp.color;
-                auto fPoint = tg_[edgeDescriptor].fProp.coordinates;
-                auto fBearing = flight_.getCamera().normalizedPointToBearingVec(fPoint);
-                auto origin = getShotOrigin(shot);
-                Eigen::Vector3d eOrigin;
-                Eigen::Matrix3d eigenRotationInverse;
-                cv2eigen(Mat(origin), eOrigin);
-                auto rotationInverse = getRotationInverse(shot);
-                cv2eigen(rotationInverse, eigenRotationInverse);
-                auto eigenRotationBearingProduct = eigenRotationInverse * fBearing;
-                bearingList.push_back(eigenRotationBearingProduct);
-                originList.push_back(eOrigin);
-            }
+void Reconstructor::triangulateTracks(const vector<int>& trackIds, Reconstruction& rec) {
+    //Poses of the shots by image, null for the images that are not in the reconstruction
+    const auto numImages = static_cast<int>(tracks_.numImages());
+    vector<const Pose*> poses(numImages, nullptr);
+    for (const auto&[shotId, shot] : rec.getReconstructionShots()) {
+        const auto image = tracks_.imageId(shotId);
+        if (image >= 0)
+            poses[image] = &shot.getPose();
+    }
+
+    //Rays of the tracks are gathered into contiguous arrays, the rays of track i start at rayOffsets[i]
+    const auto numTracks = static_cast<int>(trackIds.size());
+    vector<uint32_t> rayOffsets(numTracks + 1, 0);
+#pragma omp parallel for
+    for (auto i = 0; i < numTracks; ++i) {
+        for (auto observation = tracks_.trackBegin(trackIds[i]); observation < tracks_.trackEnd(trackIds[i]); ++observation) {
+            if (tracks_.isAlive(observation) && poses[tracks_.image(observation)])
+                rayOffsets[i + 1]++;
         }
     }
-    catch (std::out_of_range &e) {
-        //Pass
-    }
+    std::partial_sum(rayOffsets.begin(), rayOffsets.end(), rayOffsets.begin());
 
-    if (bearingList.size() >= 2) {
-        if (TriangulateBearingsMidpoint(originList, bearingList, x)) {
-            CloudPoint cp;
-            cp.setId(stoi(trackId));
-            cp.setPosition(Point3d{ x(0), x(1), x(2) });
-            rec.addCloudPoint(cp);
+    //Slot of every observation that casts a ray, -1 for the others
+    vector<int> raySlots(tracks_.numObservations(), -1);
+#pragma omp parallel for schedule(dynamic, 64)
+    for (auto i = 0; i < numTracks; ++i) {
+        auto ray = rayOffsets[i];
+        for (auto observation = tracks_.trackBegin(trackIds[i]); observation < tracks_.trackEnd(trackIds[i]); ++observation) {
+            if (tracks_.isAlive(observation) && poses[tracks_.image(observation)])
+                raySlots[observation] = static_cast<int>(ray++);
         }
     }
-}
 
-void Reconstructor::retriangulate(Reconstruction& rec) {
-    rInverses.clear();
-    shotOrigins.clear();
-    set<string> tracks;
-    for (const auto[imageName, shot] : rec.getReconstructionShots()) {
-        try {
-            const auto imageVertex = imageNodes_.at(imageName);
-            const auto[edgesBegin, edgesEnd] =
-                boost::out_edges(imageVertex, this->tg_);
-
-            for (auto edgesIter = edgesBegin; edgesIter != edgesEnd; ++edgesIter) {
-                const auto trackName = this->tg_[*edgesIter].trackName;
-                tracks.insert(trackName);
-            }
+    //The bearings of each shot are rotated to the world in one product
+    const auto& bearings = tracks_.bearings();
+    vector<Vector3d> rayOrigins(rayOffsets.back());
+    vector<Vector3d> rayBearings(rayOffsets.back());
+#pragma omp parallel for schedule(dynamic)
+    for (auto image = 0; image < numImages; ++image) {
+        if (!poses[image])
+            continue;
+
+        vector<uint32_t> observations;
+        for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+            if (raySlots[*observation] >= 0)
+                observations.push_back(*observation);
         }
-        catch (std::out_of_range &e) {
-            std::cerr << imageName << "is not valid for this reconstrucion \n";
+        Eigen::Matrix3Xd shotBearings(3, observations.size());
+        for (size_t k = 0; k < observations.size(); ++k) {
+            shotBearings.col(k) << bearings.x[observations[k]], bearings.y[observations[k]], bearings.z[observations[k]];
+        }
+        Eigen::Matrix3Xd worldBearings;
+        poses[image]->rotateBearingsToWorld(shotBearings, worldBearings);
+
+        const auto& origin = poses[image]->getOrigin();
+        for (size_t k = 0; k < observations.size(); ++k) {
+            const auto ray = raySlots[observations[k]];
+            rayOrigins[ray] = { origin(0), origin(1), origin(2) };
+            rayBearings[ray] = worldBearings.col(k);
         }
     }
 
-    for (const auto track : tracks) {
-        triangulateTrack(track, rec);
+    vector<Vector3d> points;
+    vector<uint8_t> triangulated;
+    csfm::TriangulateBearingsMidpointBatch(rayOrigins, rayBearings, rayOffsets, points, triangulated);
+
+    for (auto i = 0; i < numTracks; ++i) {
+        if (!triangulated[i])
+            continue;
+
+        CloudPoint cp;
+        cp.setId(trackIds[i]);
+        cp.setPosition(Point3d{ points[i](0), points[i](1), points[i](2) });
+        rec.addCloudPoint(cp);
     }
 }
 
-ShoColumnVector3d Reconstructor::getShotOrigin(const Shot& shot) {
-    auto shotId = shot.getId();
-    if (shotOrigins.find(shotId) == shotOrigins.end()) {
-        shotOrigins[shotId] = shot.getPose().getOrigin();
+void Reconstructor::retriangulate(Reconstruction& rec) {
+    vector<uint8_t> seen(tracks_.numTracks(), 0);
+    for (const auto&[imageName, shot] : rec.getReconstructionShots()) {
+        const auto image = tracks_.imageId(imageName);
+        if (image < 0) {
+            std::cerr << imageName << "is not valid for this reconstrucion \n";
+            continue;
+        }
+
+        for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+            if (tracks_.isAlive(*observation))
+                seen[tracks_.track(*observation)] = 1;
+        }
     }
-    return shotOrigins[shotId];
-}
 
-Mat Reconstructor::getRotationInverse(const Shot& shot) {
-    auto shotId = shot.getId();
-    if (rInverses.find(shotId) == rInverses.end()) {
-        auto rotationInverse = shot.getPose().getRotationMatrixInverse();
-        rInverses[shotId] = rotationInverse;
+    vector<int> tracks;
+    for (size_t track = 0; track < seen.size(); ++track) {
+        if (seen[track])
+            tracks.push_back(static_cast<int>(track));
     }
-    return rInverses[shotId];
+    triangulateTracks(tracks, rec);
 }
 
 void Reconstructor::singleViewBundleAdjustment(std::string shotId,
     Reconstruction &rec) {
     BundleAdjuster bundleAdjuster;
-    auto shot = rec.getShot(shotId);
-    auto camera = shot.getCamera();
-
-    _addCameraToBundle(bundleAdjuster, camera, OPTIMIZE_CAMERA_PARAEMETERS);
+    auto& shot = rec.getShot(shotId);
+    const auto camera = _addCameraToBundle(bundleAdjuster, rec.getCamera(shot.getCameraId()), OPTIMIZE_CAMERA_PARAEMETERS);
 
     const auto r = shot.getPose().getRotationVector();
     const auto t = shot.getPose().getTranslation();
-
-    bundleAdjuster.AddShot(
-        shot.getId(), "1",
+    const auto bundleShot = bundleAdjuster.AddIndexedShot(
+        camera,
         { r(0), r(1),r(2) },
         { t(0), t(1),t(2) },
         false
     );
 
+    const auto image = tracks_.imageId(shotId);
+    bundleAdjuster.ReserveIndexed(1, tracks_.imageEnd(image) - tracks_.imageBegin(image),
+        tracks_.imageEnd(image) - tracks_.imageBegin(image));
+    for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+        if (!tracks_.isAlive(*observation))
+            continue;
 
-    auto im1 = imageNodes_[shotId];
-
-    const auto[edgesBegin, edgesEnd] = boost::out_edges(im1, tg_);
+        const auto cloudPoint = rec.getCloudPoints().find(tracks_.track(*observation));
+        if (cloudPoint == rec.getCloudPoints().end())
+            continue;
 
-    for (auto tracksIter = edgesBegin; tracksIter != edgesEnd; ++tracksIter) {
-        auto trackId = tg_[*tracksIter].trackName;
-        try {
-            const auto track = rec.getCloudPoints().at(stoi(trackId));
-            const auto p = track.getPosition();
-            const auto featureCoords = tg_[*tracksIter].fProp.coordinates;
-            bundleAdjuster.AddPoint(trackId, { p.x, p.y, p.z }, true);
-            bundleAdjuster.AddPointProjectionObservation(
-                shotId,
-                trackId,
-                featureCoords.x,
-                featureCoords.y,
-                tg_[*tracksIter].fProp.scale
-            );
-        }
-        catch (std::out_of_range &e) {
-            // Pass
-        }
+        const auto p = cloudPoint->second.getPosition();
+        const auto featureCoords = tracks_.point(*observation);
+        const auto bundlePoint = bundleAdjuster.AddIndexedPoint({ p.x, p.y, p.z }, true);
+        bundleAdjuster.AddIndexedPointProjectionObservation(
+            bundleShot,
+            bundlePoint,
+            featureCoords.x,
+            featureCoords.y,
+            tracks_.scale(*observation)
+        );
     }
 
 #if 1
     if (flight_.hasGps() && rec.usesGps()) {
         cout << "Using gps prior \n";
-        const auto g = shot.getMetadata().gpsPosition;
-        bundleAdjuster.AddPositionPrior(shotId, g.x, g.y, g.z, shot.getMetadata().gpsDop);
+        const auto& g = shot.getMetadata().gpsPosition;
+        bundleAdjuster.AddIndexedPositionPrior(bundleShot, { g.x, g.y, g.z }, shot.getMetadata().gpsDop);
     }
 #endif
     bundleAdjuster.SetPointProjectionLossFunction(LOSS_FUNCTION, LOSS_FUNCTION_TRESHOLD);
@@ -688,17 +770,13 @@ void Reconstructor::singleViewBundleAdjustment(std::string shotId,
 
     cerr << bundleAdjuster.FullReport() << "\n";
 
-    auto s = bundleAdjuster.GetShot(shotId);
-    Mat rotation = (Mat_<double>(3, 1) << s.GetRotation().x(), s.GetRotation().y(), s.GetRotation().z());
-    auto translation = s.GetTranslation();
-
-    shot.getPose().setRotationVector(rotation);
+    const auto rotation = bundleAdjuster.GetIndexedShotRotation(bundleShot);
+    const auto translation = bundleAdjuster.GetIndexedShotTranslation(bundleShot);
+    shot.getPose().setRotationVector((Mat_<double>(3, 1) << rotation.x(), rotation.y(), rotation.z()));
     shot.getPose().setTranslation({ translation.x(), translation.y(), translation.z() });
-
-    rec.addShot(shotId, shot);
 }
 
-void Reconstructor::localBundleAdjustment(std::string centralShotId, Reconstruction & rec)
+vector<int> Reconstructor::localBundleAdjustment(std::string centralShotId, Reconstruction & rec)
 {
     auto maxBoundary = 1000000;
     set<string> interior{ centralShotId };
@@ -712,21 +790,17 @@ void Reconstructor::localBundleAdjustment(std::string centralShotId, Reconstruct
     }
 
     set<string> boundary = directShotNeighbors(interior, rec, maxBoundary, 1);
-    set<string> pointIds;
-    for (const auto shotId : interior) {
-        if (imageNodes_.find(shotId) != imageNodes_.end()) {
-            const auto imageVertex = imageNodes_[shotId];
-            const auto[edgesBegin, edgesEnd] = boost::out_edges(imageVertex, tg_);
-            for (auto tracksIter = edgesBegin; tracksIter != edgesEnd; ++tracksIter) {
-                auto trackId = tg_[*tracksIter].trackName;
-                if (rec.hasTrack(trackId)) {
-                    pointIds.insert(trackId);
-                }
+    set<int> pointIds;
+    for (const auto& shotId : interior) {
+        const auto image = tracks_.imageId(shotId);
+        for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+            if (tracks_.isAlive(*observation) && rec.hasTrack(tracks_.track(*observation))) {
+                pointIds.insert(tracks_.track(*observation));
             }
         }
     }
     BundleAdjuster bundleAdjuster;
-    _addCameraToBundle(bundleAdjuster, rec.getCamera(), true);
+    const auto camera = _addCameraToBundle(bundleAdjuster, rec.getCamera(), true);
     set<string> interiorBoundary;
     std::set_union(
         interior.begin(),
@@ -736,50 +810,57 @@ void Reconstructor::localBundleAdjustment(std::string centralShotId, Reconstruct
         std::inserter(interiorBoundary, interiorBoundary.end())
     );
 
-    for (const auto shotId : interiorBoundary) {
-        const auto shot = rec.getShot(shotId);
+    //Shots and points are numbered in the bundle in the order they are added
+    vector<string> bundleShotIds(interiorBoundary.begin(), interiorBoundary.end());
+    vector<int> bundlePointIds(pointIds.begin(), pointIds.end());
+    unordered_map<int, int> bundlePoints;
+    bundleAdjuster.ReserveIndexed(bundleShotIds.size(), bundlePointIds.size(), 0);
+
+    for (const auto& shotId : bundleShotIds) {
+        const auto& shot = rec.getShot(shotId);
         const auto r = shot.getPose().getRotationVector();
         const auto t = shot.getPose().getTranslation();
-        bundleAdjuster.AddShot(
-            shot.getId(), "1",
+        bundleAdjuster.AddIndexedShot(
+            camera,
             { r(0), r(1),r(2) },
             { t(0), t(1),t(2) },
             (boundary.find(shotId) != boundary.end())
         );
     }
 
-    for (const auto pointId : pointIds) {
-        const auto cloudPoint = rec.getCloudPoints().at(stoi(pointId));
-        const auto p = cloudPoint.getPosition();
-        bundleAdjuster.AddPoint(pointId, { p.x, p.y, p.z }, false);
+    for (const auto pointId : bundlePointIds) {
+        const auto p = rec.getCloudPoints().at(pointId).getPosition();
+        bundlePoints[pointId] = bundleAdjuster.AddIndexedPoint({ p.x, p.y, p.z }, false);
     }
 
-    for (const auto shotId : interiorBoundary) {
-        if (imageNodes_.find(shotId) != imageNodes_.end()) {
-            if (imageNodes_.find(shotId) != imageNodes_.end()) {
-                const auto imageVertex = imageNodes_[shotId];
-                const auto[edgesBegin, edgesEnd] = boost::out_edges(imageVertex, tg_);
-                for (auto tracksIter = edgesBegin; tracksIter != edgesEnd; ++tracksIter) {
-                    const auto trackId = tg_[*tracksIter].trackName;
-                    const auto point = tg_[*tracksIter].fProp.coordinates;
-                    const auto scale = tg_[*tracksIter].fProp.scale;
-                    bundleAdjuster.AddPointProjectionObservation(
-                        shotId,
-                        trackId,
-                        point.x,
-                        point.y,
-                        scale
-                    );
-                }
-            }
+    //Only observations of the points in the bundle, any other point would be added without a position
+    for (size_t bundleShot = 0; bundleShot < bundleShotIds.size(); ++bundleShot) {
+        const auto image = tracks_.imageId(bundleShotIds[bundleShot]);
+        for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+            if (!tracks_.isAlive(*observation))
+                continue;
+
+            const auto bundlePoint = bundlePoints.find(tracks_.track(*observation));
+            if (bundlePoint == bundlePoints.end())
+                continue;
+
+            const auto point = tracks_.point(*observation);
+            bundleAdjuster.AddIndexedPointProjectionObservation(
+                bundleShot,
+                bundlePoint->second,
+                point.x,
+                point.y,
+                tracks_.scale(*observation)
+            );
         }
     }
 #if 1
     if (flight_.hasGps() && rec.usesGps()) {
         cout << "Using gps prior \n";
-        for (const auto[shotId, shot] : rec.getReconstructionShots()) {
-            const auto g = shot.getMetadata().gpsPosition;
-            bundleAdjuster.AddPositionPrior(shotId, g.x, g.y, g.z, shot.getMetadata().gpsDop);
+        for (size_t bundleShot = 0; bundleShot < bundleShotIds.size(); ++bundleShot) {
+            const auto& metadata = rec.getShot(bundleShotIds[bundleShot]).getMetadata();
+            const auto g = metadata.gpsPosition;
+            bundleAdjuster.AddIndexedPositionPrior(bundleShot, { g.x, g.y, g.z }, metadata.gpsDop);
         }
     }
 #endif
@@ -789,37 +870,38 @@ void Reconstructor::localBundleAdjustment(std::string centralShotId, Reconstruct
         RADIAL_DISTORTION_K3_SD);
     bundleAdjuster.SetNumThreads(NUM_PROCESESS);
     bundleAdjuster.SetMaxNumIterations(50);
-    bundleAdjuster.SetLinearSolverType("DENSE_SCHUR");
+    bundleAdjuster.SetLinearSolverType(LINEAR_SOLVER_TYPE);
     bundleAdjuster.Run();
 
-    _getCameraFromBundle(bundleAdjuster, rec.getCamera());
+    _getCameraFromBundle(bundleAdjuster, camera, rec.getCamera());
+
+    //Boundary shots are constant, only the interior ones have moved
+    for (size_t bundleShot = 0; bundleShot < bundleShotIds.size(); ++bundleShot) {
+        if (boundary.count(bundleShotIds[bundleShot]))
+            continue;
 
-    for (const auto shotId : boundary) {
-        auto s = bundleAdjuster.GetShot(shotId);
-        Mat rotation = (Mat_<double>(3, 1) << s.GetRotation().x(), s.GetRotation().y(), s.GetRotation().z());
-        auto translation = s.GetTranslation();
-        auto& shot = rec.getShot(shotId);
-        shot.getPose().setRotationVector(rotation);
+        const auto rotation = bundleAdjuster.GetIndexedShotRotation(bundleShot);
+        const auto translation = bundleAdjuster.GetIndexedShotTranslation(bundleShot);
+        auto& shot = rec.getShot(bundleShotIds[bundleShot]);
+        shot.getPose().setRotationVector((Mat_<double>(3, 1) << rotation.x(), rotation.y(), rotation.z()));
         shot.getPose().setTranslation({ translation.x(), translation.y(), translation.z() });
     }
 
-    for (const auto pointId : pointIds) {
-        auto point = bundleAdjuster.GetPoint((pointId));
-        auto & cloudPoint = rec.getCloudPoints().at(stoi(pointId));
-        auto triangulatedPosition = point.GetPoint();
-        cloudPoint.getPosition().x = triangulatedPosition.x();
-        cloudPoint.getPosition().y = triangulatedPosition.y();
-        cloudPoint.getPosition().z = triangulatedPosition.z();
-        cloudPoint.setError(point.reprojection_errors);
+    vector<map<string, Eigen::VectorXd>> errors(bundlePointIds.size());
+    for (auto observation = 0; observation < bundleAdjuster.NumIndexedObservations(); ++observation) {
+        const auto bundleShot = bundleAdjuster.GetIndexedObservationShot(observation);
+        const auto bundlePoint = bundleAdjuster.GetIndexedObservationPoint(observation);
+        errors[bundlePoint][bundleShotIds[bundleShot]] = bundleAdjuster.GetIndexedReprojectionError(observation);
     }
-}
-
-const vertex_descriptor Reconstructor::getImageNode(string imageName) const {
-    return imageNodes_.at(imageName);
-}
-
-const vertex_descriptor Reconstructor::getTrackNode(string trackId) const {
-    return trackNodes_.at(trackId);
+    for (size_t bundlePoint = 0; bundlePoint < bundlePointIds.size(); ++bundlePoint) {
+        auto& cloudPoint = rec.getCloudPoints().at(bundlePointIds[bundlePoint]);
+        const auto position = bundleAdjuster.GetIndexedPoint(bundlePoint);
+        cloudPoint.getPosition().x = position.x();
+        cloudPoint.getPosition().y = position.y();
+        cloudPoint.getPosition().z = position.z();
+        cloudPoint.setError(errors[bundlePoint]);
+    }
+    return bundlePointIds;
 }
 
 void Reconstructor::plotTracks(CommonTrack track) const {
@@ -827,8 +909,6 @@ void Reconstructor::plotTracks(CommonTrack track) const {
     Mat image1 = imread((flight_.getImageDirectoryPath() / track.imagePair.first).string(), IMREAD_GRAYSCALE);
     Mat image2 = imread((flight_.getImageDirectoryPath() / track.imagePair.second).string(), IMREAD_GRAYSCALE);
 
-    const vertex_descriptor im1 = getImageNode(track.imagePair.first);
-    const vertex_descriptor im2 = getImageNode(track.imagePair.second);
     const auto im1Feats = flight_.loadFeatures(track.imagePair.first);
     const auto im2Feats = flight_.loadFeatures(track.imagePair.second);
 
@@ -859,145 +939,55 @@ void Reconstructor::exportToMvs(const Reconstruction & rec, const std::string mv
     csfm::OpenMVSExporter exporter;
     exporter.AddCamera("1", rec.getCamera().getNormalizedKMatrix());
 
-    for (const auto[shotId, shot] : rec.getReconstructionShots()) {
+    for (const auto&[shotId, shot] : rec.getReconstructionShots()) {
         auto imagePath = flight_.getUndistortedImagesDirectoryPath() / shotId;
         imagePath.replace_extension("png");
-        auto origin = Mat(shot.getPose().getOrigin()).data;
+        const auto origin = shot.getPose().getOrigin();
         exporter.AddShot(
             imagePath.string(),
             shotId,
             "1",
             shot.getPose().getRotationMatrix(),
-            { static_cast<double>(origin[0]), static_cast<double>(origin[1]), static_cast<double>(origin[2]) }
+            { origin(0), origin(1), origin(2) }
         );
     }
 
     for (const auto &[trackId, cloudPoint] : rec.getCloudPoints()) {
         vector<string> shots;
-        auto trackVertex = trackNodes_.at(std::to_string(trackId));
-
-        const auto[edgesBegin, edgesEnd] =
-            boost::out_edges(trackVertex, tg_);
-
-        for (auto edgesIter = edgesBegin; edgesIter != edgesEnd; ++edgesIter) {
-            const auto shotName = tg_[*edgesIter].imageName;
-            shots.push_back(shotName);
+        for (auto observation = tracks_.trackBegin(trackId); observation < tracks_.trackEnd(trackId); ++observation) {
+            if (tracks_.isAlive(observation))
+                shots.push_back(tracks_.imageName(tracks_.image(observation)));
         }
         exporter.AddPoint(cloudPoint.getPosition(), shots);
     }
     exporter.Export(mvsFileName);
 }
 
-void Reconstructor::bundle(Reconstruction& rec) {
-    auto fixCameras = !OPTIMIZE_CAMERA_PARAEMETERS;
-    BundleAdjuster bundleAdjuster;
-
-    _addCameraToBundle(bundleAdjuster, rec.getCamera(), fixCameras);
-
-    for (const auto[shotId, shot] : rec.getReconstructionShots()) {
-        const auto r = shot.getPose().getRotationVector();
-        const auto t = shot.getPose().getTranslation();
-
-
-        bundleAdjuster.AddShot(shot.getId(), "1", { r(0), r(1),
-            r(2) }, { t(0), t(1), t(2) }, false);
-    }
-
-    for (const auto[id, cloudPoint] : rec.getCloudPoints()) {
-        const auto coord = cloudPoint.getPosition();
-        bundleAdjuster.AddPoint(std::to_string(id), { coord.x, coord.y, coord.z },
-            false);
-    }
-
-    for (const auto[shotId, shot] : rec.getReconstructionShots()) {
-        try {
-            const auto imageVertex = imageNodes_.at(shotId);
-            const auto[edgesBegin, edgesEnd] =
-                boost::out_edges(imageVertex, this->tg_);
-
-            for (auto edgesIter = edgesBegin; edgesIter != edgesEnd; ++edgesIter) {
-                const auto trackName = this->tg_[*edgesIter].trackName;
-                if (rec.getCloudPoints().find(stoi(trackName)) !=
-                    rec.getCloudPoints().end()) {
-                    const auto featureCoords = this->tg_[*edgesIter].fProp.coordinates;
-                    bundleAdjuster.AddPointProjectionObservation(shotId, trackName, featureCoords.x,
-                        featureCoords.y, tg_[*edgesIter].fProp.scale);
-                }
-            }
-        }
-        catch (std::out_of_range &e) {
-            cerr << shotId << " Was not found in this reconstruction " << endl;
-        }
-    }
-
-#if 1
-    if (flight_.hasGps() && rec.usesGps()) {
-        cout << "Using gps prior \n";
-        for (const auto[shotId, shot] : rec.getReconstructionShots()) {
-            const auto g = shot.getMetadata().gpsPosition;
-            bundleAdjuster.AddPositionPrior(shotId, g.x, g.y, g.z, shot.getMetadata().gpsDop);
-        }
-    }
-#endif
-    bundleAdjuster.SetInternalParametersPriorSD(
-        EXIF_FOCAL_SD, PRINCIPAL_POINT_SD, RADIAL_DISTORTION_K1_SD,
-        RADIAL_DISTORTION_K2_SD, RADIAL_DISTORTION_P1_SD, RADIAL_DISTORTION_P2_SD,
-        RADIAL_DISTORTION_K3_SD);
-    bundleAdjuster.SetNumThreads(NUM_PROCESESS);
-    bundleAdjuster.SetMaxNumIterations(50);
-    bundleAdjuster.SetLinearSolverType("SPARSE_SCHUR");
-    bundleAdjuster.Run();
-
-    _getCameraFromBundle(bundleAdjuster, rec.getCamera());
-
-    for (auto&[shotId, shot] : rec.getReconstructionShots()) {
-        auto s = bundleAdjuster.GetShot(shotId);
-        Mat rotation = (Mat_<double>(3, 1) << s.GetRotation().x(), s.GetRotation().y(), s.GetRotation().z());
-        auto translation = s.GetTranslation();
-
-        shot.getPose().setRotationVector(rotation);
-        shot.getPose().setTranslation({ translation.x(), translation.y(), translation.z() });
-    }
-
-    for (auto &[pointId, cloudPoint] : rec.getCloudPoints()) {
-        auto point = bundleAdjuster.GetPoint(std::to_string(pointId));
-        auto triangulatedPosition = point.GetPoint();
-        cloudPoint.getPosition().x = triangulatedPosition.x();
-        cloudPoint.getPosition().y = triangulatedPosition.y();
-        cloudPoint.getPosition().z = triangulatedPosition.z();
-        cloudPoint.setError(point.reprojection_errors);
+void Reconstructor::bundle(BundleSession& session) {
+    auto& rec = session.getReconstruction();
+    if (rec.getReconstructionShots().size() >= PARTITIONED_BUNDLE_MIN_SHOTS) {
+        PartitionedBundle partitioned(rec, tracks_, session.usesGps(), !OPTIMIZE_CAMERA_PARAEMETERS,
+            EXIF_FOCAL_SD, RADIAL_DISTORTION_K1_SD, RADIAL_DISTORTION_K2_SD);
+        partitioned.setMaxClusterShots(PARTITIONED_BUNDLE_CLUSTER_SHOTS);
+        partitioned.run();
+        return;
     }
-}
 
-vector<pair<string, int>> Reconstructor::reconstructedPointForImages(const Reconstruction & rec, set<string> & images)
-{
-    vector<pair <string, int>> res;
-    for (const auto imageName : images) {
-        if (!rec.hasShot(imageName)) {
-            auto commonTracks = 0;
-            const auto[edgesBegin, edgesEnd] = boost::out_edges(getImageNode(imageName), tg_);
-            for (auto tracksIter = edgesBegin; tracksIter != edgesEnd; ++tracksIter) {
-                const auto trackName = tg_[*tracksIter].trackName;
-                if (rec.hasTrack(trackName)) {
-                    commonTracks++;
-                }
-            }
-            res.push_back(std::make_pair(imageName, commonTracks));
-        }
-        std::sort(res.begin(), res.end(), [](const pair<string, int>& a, const pair<string, int>& b) {
-            return a.second > b.second;
-        });
-    }
-    return res;
+    session.setNumThreads(NUM_PROCESESS);
+    session.setMaxIterations(50);
+    session.setLinearSolverType(LINEAR_SOLVER_TYPE);
+    session.run();
 }
 
 void Reconstructor::colorReconstruction(Reconstruction & rec)
 {
     for (auto&[trackId, cp] : rec.getCloudPoints()) {
-        const auto trackNode = getTrackNode(to_string(trackId));
-        auto[edgesBegin, _] = boost::out_edges(trackNode, tg_);
-        edgesBegin++;
-        cp.setColor(tg_[*edgesBegin].fProp.color);
+        for (auto observation = tracks_.trackBegin(trackId); observation < tracks_.trackEnd(trackId); ++observation) {
+            if (tracks_.isAlive(observation)) {
+                cp.setColor(tracks_.color(observation));
+                break;
+            }
+        }
     }
 }
 
@@ -1015,14 +1005,12 @@ set<string> Reconstructor::directShotNeighbors(
         std::inserter(reconstructionShots, reconstructionShots.end()),
         [](pair<string, Shot> aShot) -> string { return aShot.first; }
     );
-    set<string> points;
-    for (const auto shot : shotIds) {
-        auto shotVertex = imageNodes_.at(shot);
-        const auto[edgesBegin, edgesEnd] = boost::out_edges(shotVertex, tg_);
-        for (auto tracksIter = edgesBegin; tracksIter != edgesEnd; ++tracksIter) {
-            const auto trackName = tg_[*tracksIter].trackName;
-            if (rec.hasTrack(trackName)) {
-                points.insert(trackName);
+    set<int> points;
+    for (const auto& shot : shotIds) {
+        const auto image = tracks_.imageId(shot);
+        for (auto observation = tracks_.imageBegin(image); observation != tracks_.imageEnd(image); ++observation) {
+            if (tracks_.isAlive(*observation) && rec.hasTrack(tracks_.track(*observation))) {
+                points.insert(tracks_.track(*observation));
             }
         }
     }
@@ -1038,12 +1026,11 @@ set<string> Reconstructor::directShotNeighbors(
     map<string, int> commonPoints;
 
     for (const auto trackId : points) {
-        const auto trackVertex = trackNodes_.at(trackId);
-        const auto[edgesBegin, edgesEnd] =
-            boost::out_edges(trackVertex, tg_);
+        for (auto observation = tracks_.trackBegin(trackId); observation < tracks_.trackEnd(trackId); ++observation) {
+            if (!tracks_.isAlive(observation))
+                continue;
 
-        for (auto edgesIter = edgesBegin; edgesIter != edgesEnd; ++edgesIter) {
-            const auto neighbor = tg_[*edgesIter].imageName;
+            const auto& neighbor = tracks_.imageName(tracks_.image(observation));
             if (candidateShots.find(neighbor) != candidateShots.end()) {
                 commonPoints[neighbor]++;
             }
@@ -1068,12 +1055,12 @@ set<string> Reconstructor::directShotNeighbors(
 
 void Reconstructor::removeOutliers(Reconstruction& rec) {
     const auto before = rec.getCloudPoints().size();
-    vector<pair<string, string>>  outliers;
+    vector<pair<int, string>>  outliers;
 
     for (const auto &[track, cloudPoint] : rec.getCloudPoints()) {
         for (const auto&[shotId, errors] : cloudPoint.getError()) {
             if (errors.norm() > BUNDLE_OUTLIER_THRESHOLD) {
-                outliers.push_back(make_pair(to_string(track), shotId));
+                outliers.push_back(make_pair(track, shotId));
             }
         }
     }
@@ -1081,20 +1068,19 @@ void Reconstructor::removeOutliers(Reconstruction& rec) {
     for (const auto &[track, shotId] : outliers) {
         if (!rec.hasTrack(track))
             continue;
-        rec.getCloudPoints().at(stoi(track)).getError().erase(shotId);
-        auto iter = tg_.out_edge_list(trackNodes_.at(track)).begin();
-        boost::remove_edge(trackNodes_.at(track), imageNodes_.at(shotId), tg_);
+        rec.getCloudPoints().at(track).getError().erase(shotId);
+        const auto image = tracks_.imageId(shotId);
+        const auto observation = tracks_.findObservation(track, image);
+        if (observation >= 0) {
+            rec.removeObservation(track, image);
+            tracks_.removeObservation(static_cast<uint32_t>(observation));
+        }
     }
 
-
     for (const auto &[track, _] : outliers) {
-        if (trackNodes_.find(track) != trackNodes_.end()) {
-            int numEdges = boost::out_degree(trackNodes_[track], tg_);
-            if (numEdges < 2) {
-                rec.getCloudPoints().erase(stoi(track));
-                boost::remove_vertex(trackNodes_[track], tg_);
-                trackNodes_.erase(track);
-            }
+        if (tracks_.trackDegree(track) < 2) {
+            rec.removeCloudPoint(track);
+            tracks_.removeTrack(track);
         }
     }
 #if 0
@@ -1109,28 +1095,39 @@ void Reconstructor::removeOutliers(Reconstruction& rec) {
     cerr << "Removed " << outliers.size() << " outliers from reconstruction \n";
             }
 
-tuple<bool, ReconstructionReport> Reconstructor::resect(Reconstruction & rec, const vertex_descriptor imageVertex, double threshold,
-    int iterations, double probability, int resectionInliers) {
-    ReconstructionReport report;
-    vector<Point2d> fPoints;
-    vector<Point3d> realWorldPoints;
-    const auto[edgesBegin, edgesEnd] = boost::out_edges(imageVertex, tg_);
-    for (auto tracksIter = edgesBegin; tracksIter != edgesEnd; ++tracksIter) {
-        const auto trackName = tg_[*tracksIter].trackName;
-        if (rec.hasTrack(trackName)) {
-            auto fPoint = tg_[*tracksIter].fProp.coordinates;
-            fPoints.push_back(fPoint);
-            auto position = rec.getCloudPoints().at(stoi(trackName)).getPosition();
-            realWorldPoints.push_back(position);
+vector<vector<uint32_t>> Reconstructor::_reconstructedObservations(const Reconstruction& rec, const vector<int>& images) const
+{
+    //Only the observations of the images themselves are visited, the cost is their degree
+    vector<vector<uint32_t>> observations(images.size());
+#pragma omp parallel for schedule(dynamic)
+    for (auto i = 0; i < static_cast<int>(images.size()); ++i) {
+        for (auto observation = tracks_.imageBegin(images[i]); observation != tracks_.imageEnd(images[i]); ++observation) {
+            if (tracks_.isAlive(*observation) && rec.hasTrack(tracks_.track(*observation)))
+                observations[i].push_back(*observation);
         }
     }
+    return observations;
+}
 
-    if (realWorldPoints.size() < 5) {
-        report.numCommonPoints = realWorldPoints.size();
-        return make_tuple(false, report);
-    }
+Resection Reconstructor::_solveResection(const Reconstruction& rec, int image, const vector<uint32_t>& observations,
+    int iterations, double probability) const
+{
+    Resection resection;
+    resection.image = image;
+    resection.status = false;
+    resection.report.numCommonPoints = static_cast<int>(observations.size());
+    resection.report.numInliers = 0;
+    if (static_cast<int>(observations.size()) < RESECTION_MIN_POINTS)
+        return resection;
 
-    Mat pnpRot, pnpTrans, inliers;
+    vector<Point2d> fPoints;
+    vector<Point3d> realWorldPoints;
+    fPoints.reserve(observations.size());
+    realWorldPoints.reserve(observations.size());
+    for (const auto observation : observations) {
+        fPoints.push_back(tracks_.point(observation));
+        realWorldPoints.push_back(rec.getCloudPoints().at(tracks_.track(observation)).getPosition());
+    }
 
     /*
     if (checkIfCudaEnabled()) {
@@ -1144,16 +1141,24 @@ tuple<bool, ReconstructionReport> Reconstructor::resect(Reconstruction & rec, co
     }
     */
 
+    vector<int> inliers;
     if (cv::solvePnPRansac(realWorldPoints, fPoints, flight_.getCamera().getNormalizedKMatrix(),
-        flight_.getCamera().getDistortionMatrix(), pnpRot, pnpTrans, false, iterations, 8.0, probability, inliers)) {
-        const auto shotName = tg_[imageVertex].name;
-        const auto shot = flight_.getImageSet()[flight_.getImageIndex(shotName)];
-        ShotMetadata shotMetadata(shot.getMetadata(), flight_);
-        report.numCommonPoints = realWorldPoints.size();
-        report.numInliers = cv::countNonZero(inliers);
-        Shot recShot(shotName, flight_.getCamera(), Pose(pnpRot, pnpTrans), shotMetadata);
-        rec.addShot(recShot.getId(), recShot);
-        return { true, report };
+        flight_.getCamera().getDistortionMatrix(), resection.rotation, resection.translation, false, iterations, 8.0,
+        probability, inliers)) {
+        resection.status = true;
+        resection.report.numInliers = static_cast<int>(inliers.size());
+        for (const auto inlier : inliers) {
+            resection.inlierTracks.push_back(tracks_.track(observations[inlier]));
+        }
     }
-    return make_tuple(false, report);
-}
\ No newline at end of file
+    return resection;
+}
+
+void Reconstructor::_addResectedShot(Reconstruction& rec, const Resection& resection)
+{
+    const auto shotName = tracks_.imageName(resection.image);
+    const auto& shot = flight_.getImageSet()[flight_.getImageIndex(shotName)];
+    ShotMetadata shotMetadata(shot.getMetadata(), flight_);
+    Shot recShot(shotName, DEFAULT_CAMERA_ID, Pose(resection.rotation, resection.translation), shotMetadata);
+    rec.addShot(recShot.getId(), recShot);
+}
@@ -1,16 +1,24 @@
 #include "shomatcher.hpp"
-#include "kdtree.h"
 #include "camera.h"
 #include "RobustMatcher.h"
 #include <fstream>
 #include "bootstrap.h"
 #include <opencv2/imgproc/imgproc.hpp>
 #include "json.hpp"
+#include "boundedqueue.h"
+#include "featurecache.h"
+#include "spatialindex.h"
+#include "vladindex.h"
+#include "vocabularytree.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
 #include <set>
+#include <thread>
 
 using cv::DMatch;
 using cv::FeatureDetector;
-using cv::imread;
 using cv::Mat;
 using cv::Vec3b;
 using cv::Scalar;
@@ -25,53 +33,235 @@ using std::pair;
 using std::cerr;
 using std::set;
 using std::max;
+using std::min;
 using std::vector;
 using std::string;
 using json = nlohmann::json;
 
-ShoMatcher::ShoMatcher(FlightSession flight, bool runCuda)
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Time spent working in one pipeline stage, summed over the workers of the stage
+    struct StageTimer {
+        std::atomic<int64_t> nanoseconds{ 0 };
+
+        void add(Clock::time_point start)
+        {
+            nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        }
+
+        double seconds() const { return nanoseconds * 1e-9; }
+    };
+} //namespace
+
+ShoMatcher::ShoMatcher(FlightSession flight, bool runCuda, RobustMatcher::Feature feature)
     : flight_(flight)
     , runCuda_(runCuda)
-    , kd_(nullptr)
     , candidateImages()
-    , rMatcher_(RobustMatcher::create(RobustMatcher::Feature::orb))
+    , feature_(feature)
+{
+
+}
+vector<cv::Point3d> ShoMatcher::_getTopocentricPositions() const
+{
+    //The transform to the flight's topocentric frame is the same for every image
+    const cv::Matx44d toTopocentric = cv::Matx44d(Location::topcentricTransformFromReferenceLLA(flight_.getReferenceLLA())).inv();
+    vector<cv::Point3d> positions;
+    for (const auto& img : flight_.getImageSet()) {
+        auto location = img.getMetadata().location;
+        const auto ecef = location.ecef();
+        const auto topocentric = toTopocentric * cv::Vec4d(ecef.x, ecef.y, ecef.z, 1.0);
+        positions.emplace_back(topocentric[0], topocentric[1], topocentric[2]);
+    }
+    return positions;
+}
+
+void ShoMatcher::getCandidateMatchesUsingSpatialSearch(double range, int maxNeighbours)
 {
+    const auto& imageSet = flight_.getImageSet();
+    const auto positions = _getTopocentricPositions();
+    const SpatialIndex index(positions);
+
+    //All queries run in one parallel batch, each neighbour list is sorted by image index
+    vector<vector<int>> neighbours;
+    if (maxNeighbours > 0) {
+        //The image itself is its own nearest neighbour
+        const auto nearest = index.nearest(positions, maxNeighbours + 1, range);
+        neighbours.resize(nearest.size());
+        for (size_t i = 0; i < nearest.size(); ++i) {
+            for (const auto& [other, distance] : nearest[i]) {
+                neighbours[i].push_back(other);
+            }
+        }
+    }
+    else {
+        neighbours = index.radius(positions, range);
+    }
+    for (auto& imageNeighbours : neighbours) {
+        std::sort(imageNeighbours.begin(), imageNeighbours.end());
+    }
+
+    for (size_t i = 0; i < imageSet.size(); ++i) {
+        vector<string> matchSet;
+        const auto& currentImageName = imageSet[i].getFileName();
+        for (const auto other : neighbours[i]) {
+            //Every unordered pair is matched once, under the lower image when both found each other
+            if (static_cast<size_t>(other) == i)
+                continue;
+            if (static_cast<size_t>(other) < i && std::binary_search(neighbours[other].begin(), neighbours[other].end(), static_cast<int>(i)))
+                continue;
+
+            matchSet.push_back(imageSet[other].getFileName());
+        }
+        cout << "Found " << matchSet.size() << " candidate matches for " << currentImageName << endl;
+        if (matchSet.size())
+        {
+            this->candidateImages[currentImageName] = matchSet;
+        }
+    }
+}
 
+cv::Mat ShoMatcher::_sampleRetrievalDescriptors(const vector<string>& images, vector<FeatureView>& featureViews,
+    vector<cv::Mat>& imageDescriptors) const
+{
+    //Evenly strided sample of every image's descriptors for training the vocabulary
+    featureViews.resize(images.size());
+    imageDescriptors.resize(images.size());
+    cv::Mat samples;
+    for (size_t i = 0; i < images.size(); ++i) {
+        //The views own the mapped memory the descriptors point into
+        featureViews[i] = flight_.loadFeatureView(images[i]);
+        imageDescriptors[i] = featureViews[i].descriptors();
+        const auto stride = max(1, imageDescriptors[i].rows / RETRIEVAL_SAMPLES_PER_IMAGE);
+        for (auto row = 0; row < imageDescriptors[i].rows; row += stride) {
+            samples.push_back(imageDescriptors[i].row(row));
+        }
+    }
+    return samples;
 }
-void ShoMatcher::getCandidateMatchesUsingSpatialSearch(double range)
+
+void ShoMatcher::getCandidateMatchesUsingRetrieval(int k, bool resize)
 {
+    vector<string> images;
+    for (const auto& img : flight_.getImageSet()) {
+        images.push_back(img.getFileName());
+    }
+    _extractFeatures(images, resize);
+
+    vector<FeatureView> featureViews;
+    vector<cv::Mat> imageDescriptors;
+    const auto samples = _sampleRetrievalDescriptors(images, featureViews, imageDescriptors);
+    if (samples.rows < VladIndex::DEFAULT_NUM_WORDS) {
+        cerr << "Not enough features to build a retrieval index \n";
+        return;
+    }
+
+    VladIndex index;
+    index.train(samples);
+    for (size_t i = 0; i < images.size(); ++i) {
+        index.add(images[i], imageDescriptors[i]);
+    }
+
+    //Every unordered pair is matched once, under the image that retrieved it first
     set<pair<string, string>> alreadyPaired;
-    this->buildKdTree();
-    auto imageSet = flight_.getImageSet();
-    for (const auto img : imageSet) {
+    const auto retrieved = index.queryAll(k);
+    for (auto i = 0; i < static_cast<int>(index.size()); ++i) {
+        const auto& currentImageName = index.getImageName(i);
         vector<string> matchSet;
-        auto currentImageName = img.getFileName();
-        void *result_set;
-
-        double pt[] = { img.getMetadata().location.longitude, img.getMetadata().location.latitude };
-        result_set = kd_nearest_range(static_cast<kdtree *>(kd_), pt, range);
-        vector<double> pos(this->dimensions_);
-        int count = 0;
-        while (!kd_res_end(static_cast<kdres *>(result_set)))
+        for (const auto&[other, similarity] : retrieved[i]) {
+            const auto& otherImageName = index.getImageName(other);
+            if (alreadyPaired.count(make_pair(otherImageName, currentImageName)))
+                continue;
+
+            alreadyPaired.insert(make_pair(currentImageName, otherImageName));
+            matchSet.push_back(otherImageName);
+        }
+        cout << "Found " << matchSet.size() << " candidate matches for " << currentImageName << endl;
+        if (matchSet.size())
         {
-            auto current = kd_res_item(static_cast<kdres *>(result_set), pos.data());
-            if (current == nullptr)
-                continue;   
-            auto img = static_cast<Img *>(current);
-            if (currentImageName != img->getFileName())
-            {
-                count++;
-                //Make sure we are matching pairs already matched in reverse order
-                if (alreadyPaired.find(make_pair(currentImageName, img->getFileName())) == alreadyPaired.end()
-                    || alreadyPaired.find(make_pair(img->getFileName(), currentImageName)) == alreadyPaired.end()) {
-                    alreadyPaired.insert(make_pair(currentImageName, img->getFileName()));
-                    matchSet.push_back(img->getFileName());
-                }
+            this->candidateImages[currentImageName] = matchSet;
+        }
+    }
+}
+
+void ShoMatcher::getCandidateMatchesUsingVocabularyTree(int k, string indexFile, bool resize)
+{
+    const auto flightDirectory = boost::filesystem::canonical(flight_.getImageDirectoryPath().parent_path());
+    if (indexFile.empty())
+        indexFile = (flightDirectory.parent_path() / VOCABULARY_TREE_FILE).string();
+
+    vector<string> images;
+    vector<string> imageKeys;
+    for (const auto& img : flight_.getImageSet()) {
+        images.push_back(img.getFileName());
+        imageKeys.push_back(VocabularyTree::imageKey(flightDirectory.string(), img.getFileName()));
+    }
+    _extractFeatures(images, resize);
+
+    vector<FeatureView> featureViews;
+    vector<cv::Mat> imageDescriptors;
+    VocabularyTree tree;
+    if (tree.load(indexFile)) {
+        cout << "Adding to vocabulary tree " << indexFile << " with " << tree.size() << " images \n";
+        featureViews.resize(images.size());
+        imageDescriptors.resize(images.size());
+        for (size_t i = 0; i < images.size(); ++i) {
+            if (tree.find(imageKeys[i]) >= 0)
+                continue;
+
+            featureViews[i] = flight_.loadFeatureView(images[i]);
+            imageDescriptors[i] = featureViews[i].descriptors();
+        }
 
+        //A tree trained on another descriptor can not rank these images, it is not retrained over the
+        //flights it already indexes
+        for (const auto& descriptors : imageDescriptors) {
+            if (descriptors.empty())
+                continue;
+
+            const auto dimension = VocabularyTree::toByteDescriptors(descriptors.row(0)).cols;
+            if (dimension != tree.dimension()) {
+                cerr << "The vocabulary tree " << indexFile << " was trained on descriptors of length " << tree.dimension()
+                    << ", the features of this flight have length " << dimension << ". Use another index file \n";
+                return;
             }
-            kd_res_next(static_cast<kdres *>(result_set));
+            break;
+        }
+    }
+    else {
+        const auto samples = _sampleRetrievalDescriptors(images, featureViews, imageDescriptors);
+        if (samples.rows < VocabularyTree::DEFAULT_BRANCHING) {
+            cerr << "Not enough features to build a vocabulary tree \n";
+            return;
+        }
+        tree.train(samples);
+    }
+
+    //Images of this flight are only paired with each other, earlier flights are indexed for ranking only
+    vector<int> flightImage(tree.size(), -1);
+    for (size_t i = 0; i < images.size(); ++i) {
+        const auto existing = tree.find(imageKeys[i]);
+        const auto imageIndex = existing >= 0 ? existing : tree.add(imageKeys[i], imageDescriptors[i]);
+        flightImage.resize(tree.size(), -1);
+        flightImage[imageIndex] = static_cast<int>(i);
+    }
+    tree.save(indexFile);
+
+    set<pair<string, string>> alreadyPaired;
+    for (size_t i = 0; i < images.size(); ++i) {
+        const auto& currentImageName = images[i];
+        vector<string> matchSet;
+        const auto matches = tree.query(tree.find(imageKeys[i]), k, [&flightImage](int other) { return flightImage[other] >= 0; });
+        for (const auto&[other, similarity] : matches) {
+            const auto& otherImageName = images[flightImage[other]];
+            if (alreadyPaired.count(make_pair(otherImageName, currentImageName)))
+                continue;
+
+            alreadyPaired.insert(make_pair(currentImageName, otherImageName));
+            matchSet.push_back(otherImageName);
         }
-        cout << "Found " << count << " candidate matches for " << currentImageName << endl;
+        cout << "Found " << matchSet.size() << " candidate matches for " << currentImageName << endl;
         if (matchSet.size())
         {
             this->candidateImages[currentImageName] = matchSet;
@@ -91,6 +281,14 @@ void ShoMatcher::getCandidateMatchesFromFile(string candidatesFile) {
 }
 
 int ShoMatcher::extractFeatures(bool resize)
+{
+    if (!this->candidateImages.size())
+        return 0;
+
+    return _extractFeatures(_getImagesToExtract(), resize);
+}
+
+int ShoMatcher::_extractFeatures(const vector<string>& allImages, bool resize)
 {
     //set feature process size to -1 to avoid resizing
     if (FEATURE_PROCESS_SIZE != -1 && resize) {
@@ -101,149 +299,213 @@ int ShoMatcher::extractFeatures(bool resize)
         flight_.getCamera().setScaledWidth(fx);
     }
 
-    set<string> detected;
-    if (!this->candidateImages.size())
-        return 0;
-
-#pragma omp parallel shared(detected)
-    {
-#pragma omp for
-        for (auto i = 0; i < candidateImages.size(); ++i)
-            //for (auto it = candidateImages.begin(); it != candidateImages.end(); it++)
-        {
-            auto it = candidateImages.begin();
-            advance(it, i);
-#pragma omp critical 
-            {
-                if (detected.find(it->first) == detected.end() && _extractFeature(it->first, resize))
-                {
-                    detected.insert(it->first);
+    vector<string> images;
+    int detected = 0;
+    for (const auto& image : allImages) {
+        if (flight_.hasImageFeatures(image)) {
+            cerr << "Using existing features for " << image << "\n";
+            detected++;
+        }
+        else {
+            images.push_back(image);
+        }
+    }
+    if (images.empty())
+        return detected;
+
+    //Decode, detect and serialize run concurrently. Each detect worker owns its matcher since
+    //detectors such as HahogFeatureDetector keep per image state.
+    const int numWorkers = max(1u, std::thread::hardware_concurrency());
+    const int numDecoders = max(1, numWorkers / 2);
+    const int numDetectors = min(numWorkers, static_cast<int>(images.size()));
+    BoundedQueue<DecodedImage> decodedImages(2 * numDetectors);
+    BoundedQueue<ExtractedFeatures> extractedFeatures(2 * numDetectors);
+    std::atomic<size_t> nextImage{ 0 };
+    std::atomic<int> decodersRunning{ numDecoders };
+    std::atomic<int> detectorsRunning{ numDetectors };
+    StageTimer decodeTimer, detectTimer, serializeTimer;
+    std::mutex logMutex;
+    const auto pipelineStart = Clock::now();
+
+    vector<std::thread> workers;
+    for (auto i = 0; i < numDecoders; ++i) {
+        workers.emplace_back([&]() {
+            for (auto index = nextImage++; index < images.size(); index = nextImage++) {
+                const auto start = Clock::now();
+                DecodedImage decoded;
+                const auto decodedOk = _decodeImage(images[index], resize, decoded);
+                decodeTimer.add(start);
+                if (decodedOk) {
+                    decodedImages.push(std::move(decoded));
                 }
-            }
-
-
-            for (auto j = 0; j < it->second.size(); ++j)
-                //for (auto _it = it->second.begin(); _it != it->second.end(); ++_it)
-            {
-                auto _it = it->second.begin();
-                advance(_it, j);
-#pragma omp critical
-                {
-                    if (detected.find(*_it) == detected.end())
-                    {
-                        if (_extractFeature(*_it, resize))
-                        {
-                            detected.insert(*_it);
-                        }
-                    }
+                else {
+                    std::lock_guard<std::mutex> lock(logMutex);
+                    cerr << "Could not read " << images[index] << "\n";
                 }
-
             }
+            if (--decodersRunning == 0)
+                decodedImages.close();
+        });
+    }
+    for (auto i = 0; i < numDetectors; ++i) {
+        workers.emplace_back([&]() {
+            auto matcher = RobustMatcher::create(feature_);
+            DecodedImage decoded;
+            while (decodedImages.pop(decoded)) {
+                const auto start = Clock::now();
+                ExtractedFeatures features;
+                _detectFeatures(*matcher, decoded, features);
+                detectTimer.add(start);
+                extractedFeatures.push(std::move(features));
+            }
+            if (--detectorsRunning == 0)
+                extractedFeatures.close();
+        });
+    }
+
+    //Saves are reported from this thread, one line each, and only the files that were written are counted
+    auto saved = 0;
+    ExtractedFeatures features;
+    while (extractedFeatures.pop(features)) {
+        const auto start = Clock::now();
+        const auto savedOk = flight_.saveImageFeaturesFile(features.fileName, features.keypoints, features.descriptors,
+            features.colors);
+        serializeTimer.add(start);
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (savedOk) {
+            saved++;
+            cout << "Extracted " << features.descriptors.rows << " points for " << features.fileName << endl;
+        }
+        else {
+            cerr << "Could not save the features of " << features.fileName << "\n";
         }
     }
-    return detected.size();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    detected += saved;
+
+    const auto wallTime = std::chrono::duration<double>(Clock::now() - pipelineStart).count();
+    cout << "Extracted features for " << saved << " images in " << wallTime << " s with "
+        << numDecoders << " decode and " << numDetectors << " detect workers" << endl;
+    cout << "Busy time  decode: " << decodeTimer.seconds() << " s  detect: " << detectTimer.seconds()
+        << " s  serialize: " << serializeTimer.seconds() << " s" << endl;
+    return detected;
 }
 
-bool ShoMatcher::_extractFeature(string fileName, bool resize)
+vector<string> ShoMatcher::_getImagesToExtract() const
 {
-    auto imageFeaturePath = flight_.getImageFeaturesPath() / (fileName + ".yaml");
-    auto modelimageNamePath = flight_.getImageDirectoryPath() / (fileName);
-    if (boost::filesystem::exists(imageFeaturePath)) {
-        //Use existing file instead.
-        cerr << "Using " << imageFeaturePath.string() << " for features \n";
-        return true;
+    set<string> images;
+    for (const auto&[queryImage, trainImages] : candidateImages) {
+        images.insert(queryImage);
+        images.insert(trainImages.begin(), trainImages.end());
     }
+    return vector<string>(images.begin(), images.end());
+}
 
-    Mat modelImg = imread(modelimageNamePath.string(), SHO_LOAD_COLOR_IMAGE_OPENCV_ENUM | SHO_LOAD_ANYDEPTH_IMAGE_OPENCV_ENUM);
-    cv::cvtColor(modelImg, modelImg, SHO_BGR2RGB);
-    Mat featureImage = imread(modelimageNamePath.string(), SHO_GRAYSCALE);
-
-    auto channels = modelImg.channels();
-
-    if (modelImg.empty())
-        return false;
-
-    if (resize && featureImage.size().width > FEATURE_PROCESS_SIZE) {
-        cv::resize(modelImg, modelImg, { flight_.getCamera().getScaledWidth(), flight_.getCamera().getScaledHeight() }, 0, 0, cv::INTER_AREA);
-        cv::resize(featureImage, featureImage, { flight_.getCamera().getScaledWidth(), flight_.getCamera().getScaledHeight() }, 0, 0, cv::INTER_AREA);
-        cout << "Size of feature image is " << featureImage.size() << "\n";
-    }
-
-    std::vector<cv::KeyPoint> keypoints;
-    std::vector<cv::Scalar> colors;
-    cv::Mat descriptors;
-
-    rMatcher_->detectAndCompute(featureImage, keypoints, descriptors);
+bool ShoMatcher::_decodeImage(const string& fileName, bool resize, DecodedImage& decoded) const
+{
+    const auto& camera = flight_.getCamera();
+    auto modelimageNamePath = flight_.getImageDirectoryPath() / (fileName);
+    const auto workingSize = resize ? cv::Size(camera.getScaledWidth(), camera.getScaledHeight()) : cv::Size();
+    decoded.fileName = fileName;
+    return flight_.getImageLoader().loadWorkingImages(
+        modelimageNamePath.string(), workingSize, decoded.color, decoded.gray);
+}
 
-    cout << "Extracted " << descriptors.rows << " points for  " << fileName << endl;
+void ShoMatcher::_detectFeatures(RobustMatcher& matcher, const DecodedImage& decoded, ExtractedFeatures& features) const
+{
+    features.fileName = decoded.fileName;
+    matcher.detectAndCompute(decoded.gray, features.keypoints, features.descriptors);
 
-    for (auto &keypoint : keypoints) {
+    const auto channels = decoded.color.channels();
+    for (auto &keypoint : features.keypoints) {
         if (channels == 1)
-            colors.push_back(modelImg.at<uchar>(keypoint.pt));
+            features.colors.push_back(decoded.color.at<uchar>(keypoint.pt));
         else if (channels == 3)
-            colors.push_back(modelImg.at<Vec3b>(keypoint.pt));
+            features.colors.push_back(decoded.color.at<Vec3b>(keypoint.pt));
 
         keypoint.pt = flight_.getCamera().normalizeImageCoordinate(keypoint.pt);
         keypoint.size /= max(flight_.getCamera().getScaledHeight(), flight_.getCamera().getScaledWidth());
     }
-    return flight_.saveImageFeaturesFile(fileName, keypoints, descriptors, colors);
 }
 
-
-void ShoMatcher::runRobustFeatureMatching()
+void ShoMatcher::runRobustFeatureMatching(size_t featureCacheBytes)
 {
     if (!this->candidateImages.size())
         return;
 
-    map<string, ImageFeatures> loadedFeatures;
+    //Pairs already in the match store come from an earlier, interrupted run. The remaining
+    //pairs are grouped by query image and ordered by train image so that threads picking up
+    //neighbouring pairs work on the same images and mostly hit the feature cache.
+    const auto matchStore = flight_.openMatchStore();
+    vector<pair<string, string>> pairs;
     for (const auto&[queryImg, trainImages] : candidateImages) {
-        vector<string> trainImageSet;
-        auto queryImagePath = flight_.getImageDirectoryPath() / queryImg;
-        ImageFeatures queryFeaturesSet;
-        try {
-            queryFeaturesSet = loadedFeatures.at(queryImg);
+        auto orderedTrainImages = trainImages;
+        std::sort(orderedTrainImages.begin(), orderedTrainImages.end());
+        for (const auto& trainImg : orderedTrainImages) {
+            if (matchStore.hasPair(queryImg, trainImg)) {
+                cout << queryImg << " - " << trainImg << " already matched" << endl;
+                continue;
+            }
+            pairs.emplace_back(queryImg, trainImg);
         }
-        catch (std::out_of_range e) {
-            queryFeaturesSet = flight_.loadFeatures(queryImg);
-            loadedFeatures[queryImg] = queryFeaturesSet;
+    }
+    if (pairs.empty())
+        return;
+
+    struct PairResult {
+        string queryImg;
+        string trainImg;
+        vector<DMatch> matches;
+    };
+
+    FeatureCache featureCache(flight_, featureCacheBytes);
+    BoundedQueue<PairResult> results(4 * max(1u, std::thread::hardware_concurrency()));
+    std::thread writer([&]() {
+        PairResult result;
+        while (results.pop(result)) {
+            if (!flight_.savePairMatches(result.queryImg, result.trainImg, result.matches))
+                cerr << "Could not save matches for " << result.queryImg << " - " << result.trainImg << "\n";
         }
-        map<string, vector<DMatch>> matchSet;
-        for (const auto trainImg : trainImages)
-        {
-            trainImageSet.push_back(trainImg);
-            ImageFeatures trainFeaturesSet;
-            try {
-                trainFeaturesSet = loadedFeatures.at(trainImg);
-            }
-            catch (std::out_of_range e) {
-                trainFeaturesSet = flight_.loadFeatures(trainImg);
-                loadedFeatures[trainImg] = trainFeaturesSet;
+    });
+
+#pragma omp parallel
+    {
+        //RobustMatcher holds matcher state so every thread gets its own
+        auto matcher = RobustMatcher::create(feature_);
+        matcher->setMatchingMode(matchingMode_);
+        matcher->setMaxComparisons(maxComparisons_);
+#pragma omp for schedule(dynamic)
+        for (auto i = 0; i < static_cast<int>(pairs.size()); ++i) {
+            const auto&[queryImg, trainImg] = pairs[i];
+            const auto queryFeatures = featureCache.get(queryImg);
+            const auto trainFeatures = featureCache.get(trainImg);
+            std::shared_ptr<const KdForestIndex> queryForest, trainForest;
+            PairResult result{ queryImg, trainImg, {} };
+            if (matchingMode_ == RobustMatcher::MatchingMode::kdForest) {
+                //Forests are built once per image and shared by all of its pairs
+                queryForest = featureCache.getForest(queryImg, maxComparisons_);
+                trainForest = featureCache.getForest(trainImg, maxComparisons_);
             }
-            vector<DMatch> matches;
-            rMatcher_->robustMatch(queryFeaturesSet.descriptors, trainFeaturesSet.descriptors, matches);
-            int trainIndex = this->flight_.getImageIndex(trainImg);
-            for (size_t i = 0; i < matches.size(); i++)
-            {
+            if (queryForest && trainForest)
+                matcher->forestRobustMatch(*queryForest, *trainForest, result.matches);
+            else
+                matcher->robustMatch(queryFeatures->descriptors, trainFeatures->descriptors, result.matches);
+            const int trainIndex = this->flight_.getImageIndex(trainImg);
+            for (auto& match : result.matches) {
                 //Update train index so we know what image we matched against when we are running the tracking pipeline
-                matches[i].imgIdx = trainIndex;
+                match.imgIdx = trainIndex;
             }
-            matchSet[trainImg] = matches;
-            cout << queryImg << " - " << trainImg << " has " << matches.size() << "candidate matches" << endl;
+#pragma omp critical(matchlog)
+            cout << queryImg << " - " << trainImg << " has " << result.matches.size() << " candidate matches" << endl;
+            results.push(std::move(result));
         }
-        flight_.saveMatches(queryImg, matchSet);
     }
-}
-
-void ShoMatcher::buildKdTree()
-{
-    kd_ = kd_create(this->dimensions_);
-    for (auto &img : this->flight_.getImageSet())
-    {
-        auto pos = vector<double>{ img.getMetadata().location.longitude, img.getMetadata().location.latitude };
-        void *dt = &img;
-        assert(kd_insert(static_cast<kdtree *>(kd_), pos.data(), dt) == 0);
-    }
-
+    results.close();
+    writer.join();
+    cout << "Matched " << pairs.size() << " pairs. Feature cache hits: " << featureCache.getHits()
+        << " misses: " << featureCache.getMisses() << endl;
 }
 
 map<string, std::vector<string>> ShoMatcher::getCandidateImages() const
@@ -253,10 +515,13 @@ map<string, std::vector<string>> ShoMatcher::getCandidateImages() const
 
 void ShoMatcher::plotMatches(string img1, string img2) const {
     Mat imageMatches;
-    Mat image1 = imread((this->flight_.getImageDirectoryPath() / img1).string(),
-        cv::IMREAD_GRAYSCALE);
-    Mat image2 = imread((this->flight_.getImageDirectoryPath() / img2).string(),
-        cv::IMREAD_GRAYSCALE);
+    Mat image1, image2;
+    const auto frame1 = flight_.getImageLoader().load((this->flight_.getImageDirectoryPath() / img1).string());
+    const auto frame2 = flight_.getImageLoader().load((this->flight_.getImageDirectoryPath() / img2).string());
+    if (!frame1 || !frame2)
+        return;
+    cv::cvtColor(*frame1, image1, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(*frame2, image2, cv::COLOR_BGR2GRAY);
     auto img1Matches = this->flight_.loadMatches(img1);
     auto kp1 = flight_.loadFeatures(img1).getKeypoints();
     auto kp2 = flight_.loadFeatures(img2).getKeypoints();
@@ -11,7 +11,7 @@ ShotMetadata::ShotMetadata(
 ): gpsPosition(gpsPosition), gpsDop(dop), captureTime(captureTime),
 orientation(orientation){}
 
-ShotMetadata::ShotMetadata(ImageMetadata imageExif, const FlightSession & flight)
+ShotMetadata::ShotMetadata(const ImageMetadata& imageExif, const FlightSession & flight)
 {
     gpsPosition = imageExif.location.getTopcentricLocationCoordinates(flight.getReferenceLLA());
     gpsDop = imageExif.location.dop;
@@ -1,9 +1,13 @@
 #include "shotracking.h"
 #include "string"
+#include <algorithm>
+#include <numeric>
 #include <vector>
 #include <iostream>
 #include "utilities.h"
 #include <set>
+#include <tuple>
+#include <unordered_map>
 
 using cv::DMatch;
 using cv::Point2d;
@@ -18,6 +22,17 @@ using std::vector;
 using std::string;
 using std::endl;
 using std::cerr;
+using std::unordered_map;
+
+namespace
+{
+    uint64_t pairKey(int image1, int image2)
+    {
+        if (image2 < image1)
+            std::swap(image1, image2);
+        return (static_cast<uint64_t>(image1) << 32) | static_cast<uint32_t>(image2);
+    }
+} //namespace
 
 ShoTracker::ShoTracker(
     FlightSession flight,
@@ -26,221 +41,226 @@ ShoTracker::ShoTracker(
 )
     : flight(flight)
     , mapOfImageNamesToCandidateImages(candidateImages)
-    , imageFeatureNodes_()
-    , tracks_()
-    , uf()
-    , imageNodes_()
-    , trackNodes_()
-    , imageFeatures()
+    , imageNames_()
+    , imageIds_()
+    , featureViews_()
+    , trackBuilder_()
 {}
 
-void ShoTracker::createFeatureNodes(vector<pair<ImageFeatureNode, ImageFeatureNode>> &allFeatures,
-    vector<FeatureProperty> &props)
+void ShoTracker::createFeatureNodes()
 {
-    size_t featureIndex = 0;
     cout << "Creating feature nodes" << endl;
-    //Image name and corresponding keypoint index form a single node
+    for (const auto&[imageName, candidateImages] : mapOfImageNamesToCandidateImages) {
+        imageIds_.emplace(imageName, 0);
+        for (const auto& candidateImage : candidateImages) {
+            imageIds_.emplace(candidateImage, 0);
+        }
+    }
+
+    //Only the feature counts are needed to number the features, the views map the files lazily
+    vector<size_t> featureCounts;
+    for (auto& [imageName, imageId] : imageIds_) {
+        imageId = static_cast<int>(imageNames_.size());
+        imageNames_.push_back(imageName);
+        featureViews_.push_back(this->flight.loadFeatureView(imageName));
+        featureCounts.push_back(featureViews_.back().size());
+    }
+    trackBuilder_ = TrackBuilder(featureCounts);
+
+    //Each pair of images is a block of matches pointing into the mapped match store
+    struct PairMatchArrays {
+        int queryImage;
+        int trainImage;
+        const int32_t* queryIdx;
+        const int32_t* trainIdx;
+        size_t count;
+    };
+    vector<PairMatchArrays> pairs;
+    vector<vector<int32_t>> legacyMatches;
+    const auto matchStore = this->flight.openMatchStore();
     for (const auto&[imageName, candidateImages] : mapOfImageNamesToCandidateImages)
     {
-        auto allPairMatches = this->flight.loadMatches(imageName);
-        auto leftImageName = imageName;
-        auto leftImageFeatures = this->_loadImageFeatures(leftImageName);
-        for (const auto&[matchImageName, dMatches] : allPairMatches)
+        const auto queryImage = imageIds_.at(imageName);
+        const auto storedMatches = matchStore.pairsForQuery(imageName);
+        for (const auto& pairMatches : storedMatches)
         {
-            for (const auto& dMatch : dMatches)
-            {
-                //The left image is the query image and the right image is the train image
-                auto leftFeature = make_pair(leftImageName, dMatch.queryIdx);
-                auto rightFeature = make_pair(matchImageName, dMatch.trainIdx);
-                auto rightImageFeature = this->_loadImageFeatures(matchImageName);
-                allFeatures.push_back(make_pair(leftFeature, rightFeature));
-                if (addFeatureToIndex(leftFeature, featureIndex))
-                {
-                    featureIndex++;
-                    FeatureProperty leftProp = getFeatureProperty_(leftImageFeatures, leftFeature);
-                    props.push_back(leftProp);
-                }
-                if (addFeatureToIndex(rightFeature, featureIndex))
-                {
-                    featureIndex++;
-                    FeatureProperty rightProp = getFeatureProperty_(rightImageFeature, rightFeature);
-                    props.push_back(rightProp);
-                }
+            const auto trainImage = imageIds_.find(matchStore.imageName(pairMatches.trainImage));
+            if (trainImage == imageIds_.end())
+                continue;
+
+            pairs.push_back({ queryImage, trainImage->second, pairMatches.queryIdx, pairMatches.trainIdx, pairMatches.count });
+        }
+        if (!storedMatches.empty())
+            continue;
+
+        //Fall back to the YAML matches of older sessions
+        for (const auto&[matchImageName, dMatches] : this->flight.loadMatches(imageName))
+        {
+            const auto trainImage = imageIds_.find(matchImageName);
+            if (trainImage == imageIds_.end())
+                continue;
+
+            vector<int32_t> queryIdx, trainIdx;
+            for (const auto& dMatch : dMatches) {
+                queryIdx.push_back(dMatch.queryIdx);
+                trainIdx.push_back(dMatch.trainIdx);
             }
+            legacyMatches.push_back(std::move(queryIdx));
+            legacyMatches.push_back(std::move(trainIdx));
+            pairs.push_back({ queryImage, trainImage->second, legacyMatches[legacyMatches.size() - 2].data(),
+                legacyMatches.back().data(), dMatches.size() });
         }
     }
-    assert(props.size() == featureIndex);
-    assert(imageFeatureNodes_.size() == reverseImageFeatureNodes_.size());
-    uf = UnionFind(imageFeatureNodes_.size());
-    cout << "Created a total of " << imageFeatureNodes_.size() << " feature nodes " << endl;
-}
 
-ImageFeatures ShoTracker::_loadImageFeatures(const string fileName) {
-    if (imageFeatures.find(fileName) == this->imageFeatures.end()) {
-        imageFeatures[fileName] = this->flight.loadFeatures(fileName);
+    //A pair with an index out of its feature file is skipped whole, the other pairs are still merged
+    size_t numMatches = 0;
+    vector<uint8_t> skipped(pairs.size(), 0);
+#pragma omp parallel for schedule(dynamic) reduction(+:numMatches)
+    for (auto i = 0; i < static_cast<int>(pairs.size()); ++i) {
+        const auto& pairMatches = pairs[i];
+        if (trackBuilder_.addMatches(pairMatches.queryImage, pairMatches.trainImage,
+            pairMatches.queryIdx, pairMatches.trainIdx, pairMatches.count)) {
+            numMatches += pairMatches.count;
+        }
+        else {
+            skipped[i] = 1;
+        }
     }
-    return imageFeatures[fileName];
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (skipped[i]) {
+            cerr << "Skipping the matches of " << imageNames_[pairs[i].queryImage] << " and "
+                << imageNames_[pairs[i].trainImage] << ", they index features out of their files" << endl;
+        }
+    }
+    cout << "Merged " << numMatches << " matches between " << trackBuilder_.numFeatures() << " feature nodes " << endl;
 }
 
-void ShoTracker::createTracks(const vector<pair<ImageFeatureNode, ImageFeatureNode>> &features)
+void ShoTracker::createTracks()
 {
     cerr << "Creating tracks" << endl;
-    for (const auto&[leftFeature, rightFeature] : features)
-    {
-        const auto leftFeatureGlobalID = imageFeatureNodes_.at(leftFeature);
-        const auto rightFeatureGlobalID = imageFeatureNodes_.at(rightFeature);
-        mergeFeatureTracks(leftFeature, rightFeature);
-    }
-    cerr << "Created a total of " << uf.numDisjointSets() << " tracks" << endl;
+    trackBuilder_.buildTracks(this->minTrackLength);
+    cerr << "Found a total of " << trackBuilder_.numTracks() << " good tracks " << endl;
+}
 
-    //Filter out bad tracks
-    for (const auto& [imageFeatureNode, index] : imageFeatureNodes_)
+TrackStore ShoTracker::buildTrackStore() const
+{
+    TrackStore tracks;
+    for (size_t trackIndex = 0; trackIndex < trackBuilder_.numTracks(); ++trackIndex)
     {
-        int dSet = uf.findSet(index);
-        if (uf.sizeOfSet(dSet) >= this->minTrackLength)
+        for (auto feature = trackBuilder_.trackBegin(trackIndex); feature != trackBuilder_.trackEnd(trackIndex); ++feature)
         {
-            tracks_[dSet].push_back(index);
-        }
-    }
-   
-    set<int> badTracks;
-    for (const auto &[trackId, trackSet] : tracks_) {
-        std::set<string> images;
-        for (auto imFeature : trackSet) {
-            const auto featureNode = retrieveFeatureByIndexValue(imFeature);
-            auto[_, inserted] = images.insert(featureNode.first);
-            if (inserted == false) {
-                badTracks.insert(trackId);
-                break;
-            }
+            const auto image = trackBuilder_.imageOf(*feature);
+            const auto featureIndex = trackBuilder_.featureIndexOf(*feature);
+            const auto& view = featureViews_[image];
+            assert(static_cast<size_t>(featureIndex) < view.size());
+            tracks.addObservation(static_cast<int>(trackIndex), tracks.addImage(imageNames_[image]), featureIndex,
+                { view.x()[featureIndex], view.y()[featureIndex] }, view.sizes()[featureIndex], view.color(featureIndex));
         }
     }
-    for (auto badTrack : badTracks) {
-        tracks_.erase(badTrack);
-    }
+    tracks.buildIndex();
+    cout << "Stored " << tracks.numObservations() << " observations of " << tracks.numTracks() << " tracks in "
+        << tracks.numImages() << " images" << endl;
+    return tracks;
+}
 
-    cerr << "Found a total of " << tracks_.size() << " good tracks " << endl;
+vector<ImagePairCount> ShoTracker::countCommonTracks(const TrackStore& tracks)
+{
+    vector<int> trackIds(tracks.numTracks());
+    std::iota(trackIds.begin(), trackIds.end(), 0);
+    return countCommonTracks(tracks, trackIds, vector<bool>(tracks.numImages(), true));
 }
 
-TrackGraph ShoTracker::buildTracksGraph(const std::vector<FeatureProperty> &props)
+vector<ImagePairCount> ShoTracker::countCommonTracks(const TrackStore& tracks, const vector<int>& trackIds,
+    const vector<bool>& imageMask)
 {
-    TrackGraph tg;
-    for (auto it = tracks_.begin(); it != tracks_.end(); ++it)
+    //Each thread counts the pairs of its own tracks, the maps are merged once at the end
+    unordered_map<uint64_t, int> pairCounts;
+#pragma omp parallel
     {
-        TrackGraph::vertex_descriptor track;
-        auto trackSet = it->second;
-        auto trackId = to_string(it->first); //Track id is the parent set of this feature set
-        track = boost::add_vertex(tg);
-        tg[track].name = trackId;
-        tg[track].is_image = false;
-        trackNodes_[trackId] = track;
-        for (size_t i = 0; i < trackSet.size(); ++i)
+        unordered_map<uint64_t, int> threadCounts;
+        vector<int> trackImages;
+#pragma omp for schedule(dynamic, 1024) nowait
+        for (auto i = 0; i < static_cast<int>(trackIds.size()); ++i)
         {
-            TrackGraph::vertex_descriptor imageNode;
-            auto feature = retrieveFeatureByIndexValue(trackSet[i]);
-            auto prop = props[trackSet[i]];
-            auto imageName = feature.first;
-            if (imageNodes_.find(imageName) == imageNodes_.end())
-            {
-                imageNode = boost::add_vertex(tg);
-                imageNodes_[imageName] = imageNode;
-                tg[imageNode].is_image = true;
-                tg[imageNode].name = imageName;
+            const auto track = trackIds[i];
+            trackImages.clear();
+            for (auto observation = tracks.trackBegin(track); observation < tracks.trackEnd(track); ++observation) {
+                if (tracks.isAlive(observation) && imageMask[tracks.image(observation)])
+                    trackImages.push_back(tracks.image(observation));
             }
-            else
-            {
-                imageNode = imageNodes_[imageName];
+            for (size_t i = 0; i < trackImages.size(); ++i) {
+                for (size_t j = i + 1; j < trackImages.size(); ++j) {
+                    threadCounts[pairKey(trackImages[i], trackImages[j])]++;
+                }
             }
-            auto e = EdgeProperty(prop, trackId, feature.first);
-            boost::add_edge(imageNode, track, e, tg);
         }
-    }
-    return tg;
-}
-
-vector<CommonTrack> ShoTracker::commonTracks(const TrackGraph &tg) const
-{
-    vector<CommonTrack> commonTracks;
-    map<pair<string, string>, std::set<string>> _commonTracks;
-        for (auto& trackNode : trackNodes_)
+#pragma omp critical
         {
-            std::string vertexName;
-            TrackGraph::vertex_descriptor trackDescriptor;
-            std::tie(vertexName, trackDescriptor) = trackNode;
-            vector<string> imageNeighbours;
-
-            auto neighbours = boost::adjacent_vertices(trackDescriptor, tg);
-            for (auto vd : make_iterator_range(neighbours))
-            {
-                imageNeighbours.push_back(tg[vd].name);
+            if (pairCounts.empty()) {
+                pairCounts.swap(threadCounts);
             }
-            auto combinations = _getCombinations(imageNeighbours);
-
-            for (const auto &combination : combinations)
-            {
-                _commonTracks[combination].insert(vertexName);
+            else {
+                for (const auto& [key, count] : threadCounts) {
+                    pairCounts[key] += count;
+                }
             }
         }
-    for (auto pair : _commonTracks) {
-        CommonTrack cTrack(pair.first, 0, pair.second);
-        commonTracks.push_back(cTrack);
     }
-    return commonTracks;
-}
-
-FeatureProperty ShoTracker::getFeatureProperty_(const ImageFeatures &imageFeatures, ImageFeatureNode fNode) const
-{
-    assert(fNode.second < imageFeatures.keypoints.size());
-    return {
-        fNode, 
-        imageFeatures.keypoints[fNode.second].pt, 
-        imageFeatures.colors[fNode.second], 
-        imageFeatures.keypoints[fNode.second].size 
-    };
-}
 
-set<pair<string, string>> ShoTracker::_getCombinations(const vector<string> &images) const
-{
-    set<pair<string, string>> combinations;
-    for (size_t i = 0; i < images.size() -1; ++i) {
-        for (size_t j = i + 1; j < images.size(); ++j) {
-            auto pair = make_pair(images[i], images[j]);
-            combinations.insert(pair);
-        }
+    vector<ImagePairCount> counts;
+    counts.reserve(pairCounts.size());
+    for (const auto& [key, count] : pairCounts) {
+        counts.push_back({ static_cast<int>(key >> 32), static_cast<int>(key & 0xffffffff), count });
     }
-    return combinations;
+    std::sort(counts.begin(), counts.end(), [](const ImagePairCount& a, const ImagePairCount& b) {
+        return std::tie(b.numTracks, a.image1, a.image2) < std::tie(a.numTracks, b.image1, b.image2);
+    });
+    return counts;
 }
 
-void ShoTracker::mergeFeatureTracks(pair<string, int> feature1, pair<string, int> feature2)
+vector<CommonTrack> ShoTracker::commonTracks(const TrackStore& tracks, size_t maxPairs)
 {
-    uf.unionSet(imageFeatureNodes_.at(feature1), imageFeatureNodes_.at(feature2));
-}
+    auto counts = countCommonTracks(tracks);
+    if (maxPairs > 0 && counts.size() > maxPairs)
+        counts.resize(maxPairs);
 
-bool ShoTracker::addFeatureToIndex(pair<string, int> feature, int featureIndex)
-{
-    auto insert = imageFeatureNodes_.insert(make_pair(feature, featureIndex));
-    const auto wasAdded = insert.second;
-    if (wasAdded) {
-        reverseImageFeatureNodes_.insert(make_pair(featureIndex, feature));
+    //The observations of an image are in track order, so the shared tracks of a pair are a sorted merge
+    vector<CommonTrack> commonTracks(counts.size());
+#pragma omp parallel for schedule(dynamic)
+    for (auto i = 0; i < static_cast<int>(counts.size()); ++i)
+    {
+        const auto& count = counts[i];
+        vector<int> pairTracks;
+        pairTracks.reserve(count.numTracks);
+        auto first = tracks.imageBegin(count.image1);
+        auto second = tracks.imageBegin(count.image2);
+        while (first != tracks.imageEnd(count.image1) && second != tracks.imageEnd(count.image2)) {
+            if (!tracks.isAlive(*first)) {
+                ++first;
+            }
+            else if (!tracks.isAlive(*second)) {
+                ++second;
+            }
+            else if (tracks.track(*first) < tracks.track(*second)) {
+                ++first;
+            }
+            else if (tracks.track(*second) < tracks.track(*first)) {
+                ++second;
+            }
+            else {
+                pairTracks.push_back(tracks.track(*first));
+                ++first;
+                ++second;
+            }
+        }
+        commonTracks[i] = CommonTrack(make_pair(tracks.imageName(count.image1), tracks.imageName(count.image2)),
+            0.0f, std::move(pairTracks));
     }
-    return wasAdded;
-}
-
-map <int, vector <int>> ShoTracker::getTracks()
-{
-    return tracks_;
+    return commonTracks;
 }
 
-std::pair<string, int> ShoTracker::retrieveFeatureByIndexValue(int index)
+ImageFeatureNode ShoTracker::retrieveFeatureByIndexValue(GloballyUniqueImageFeatureId index) const
 {
-    CV_Assert(index < imageFeatureNodes_.size());
-    return reverseImageFeatureNodes_[index];
+    CV_Assert(index < trackBuilder_.numFeatures());
+    return make_pair(imageNames_[trackBuilder_.imageOf(index)], trackBuilder_.featureIndexOf(index));
 }
-
-const std::map<string, TrackGraph::vertex_descriptor> ShoTracker::getImageNodes() const {
-    return imageNodes_;
-}
-
-const std::map<string, TrackGraph::vertex_descriptor> ShoTracker::getTrackNodes() const {
-    return trackNodes_;
-}
\ No newline at end of file
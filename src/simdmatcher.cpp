@@ -0,0 +1,218 @@
+#include "simdmatcher.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+using std::numeric_limits;
+using std::vector;
+
+namespace
+{
+    // Tile sizes keep a block of query and train descriptors resident in L1/L2 while the block is visited
+    const int QUERY_TILE = 32;
+    const int TRAIN_TILE = 256;
+
+    template <typename D>
+    struct TopTwo {
+        D best;
+        D second;
+        int bestIndex;
+    };
+
+    template <typename D>
+    inline void updateTopTwo(TopTwo<D>& top, D distance, int index)
+    {
+        //Strict comparisons keep the lowest index on ties, like cv::BFMatcher
+        if (distance < top.best) {
+            top.second = top.best;
+            top.best = distance;
+            top.bestIndex = index;
+        }
+        else if (distance < top.second) {
+            top.second = distance;
+        }
+    }
+
+    inline uint32_t popcount64(uint64_t x)
+    {
+#ifdef _MSC_VER
+        return static_cast<uint32_t>(__popcnt64(x));
+#else
+        return static_cast<uint32_t>(__builtin_popcountll(x));
+#endif
+    }
+
+    template <typename D, typename DistanceFn, typename RatioFn, typename OutputFn>
+    void mutualRatioMatch(
+        int numQuery,
+        int numTrain,
+        DistanceFn distance,
+        RatioFn passesRatio,
+        OutputFn outputDistance,
+        vector<SimdMatch>& matches
+    )
+    {
+        if (numQuery < 2 || numTrain < 2)
+            return;
+
+        const TopTwo<D> empty{ numeric_limits<D>::max(), numeric_limits<D>::max(), -1 };
+        vector<TopTwo<D>> rows(numQuery, empty);
+        vector<TopTwo<D>> columns(numTrain, empty);
+        for (auto q0 = 0; q0 < numQuery; q0 += QUERY_TILE) {
+            const auto q1 = std::min(q0 + QUERY_TILE, numQuery);
+            for (auto t0 = 0; t0 < numTrain; t0 += TRAIN_TILE) {
+                const auto t1 = std::min(t0 + TRAIN_TILE, numTrain);
+                for (auto q = q0; q < q1; ++q) {
+                    auto& row = rows[q];
+                    for (auto t = t0; t < t1; ++t) {
+                        const D d = distance(q, t);
+                        updateTopTwo(row, d, t);
+                        updateTopTwo(columns[t], d, q);
+                    }
+                }
+            }
+        }
+
+        for (auto q = 0; q < numQuery; ++q) {
+            const auto& row = rows[q];
+            if (!passesRatio(row))
+                continue;
+
+            const auto& column = columns[row.bestIndex];
+            if (column.bestIndex == q && passesRatio(column)) {
+                matches.push_back({ q, row.bestIndex, outputDistance(row.best) });
+            }
+        }
+    }
+} //namespace
+
+uint32_t hammingDistance(const uint8_t* a, const uint8_t* b, int descriptorBytes)
+{
+    uint32_t distance = 0;
+    auto i = 0;
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512F__)
+    if (descriptorBytes >= 64) {
+        __m512i sum = _mm512_setzero_si512();
+        for (; i + 64 <= descriptorBytes; i += 64) {
+            const auto x = _mm512_xor_si512(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+            sum = _mm512_add_epi64(sum, _mm512_popcnt_epi64(x));
+        }
+        alignas(64) uint64_t lanes[8];
+        _mm512_store_si512(lanes, sum);
+        for (const auto lane : lanes) {
+            distance += static_cast<uint32_t>(lane);
+        }
+    }
+#endif
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    for (; i + 32 <= descriptorBytes; i += 32) {
+        const auto x = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        const auto counts = _mm256_popcnt_epi64(x);
+        distance += static_cast<uint32_t>(
+            _mm256_extract_epi64(counts, 0) + _mm256_extract_epi64(counts, 1) +
+            _mm256_extract_epi64(counts, 2) + _mm256_extract_epi64(counts, 3));
+    }
+#elif defined(__AVX2__)
+    //Per nibble lookup of the bit count, summed per 64 bit lane with sad
+    const auto lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const auto lowNibble = _mm256_set1_epi8(0x0f);
+    for (; i + 32 <= descriptorBytes; i += 32) {
+        const auto x = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        const auto low = _mm256_and_si256(x, lowNibble);
+        const auto high = _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibble);
+        const auto bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+        const auto counts = _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+        distance += static_cast<uint32_t>(
+            _mm256_extract_epi64(counts, 0) + _mm256_extract_epi64(counts, 1) +
+            _mm256_extract_epi64(counts, 2) + _mm256_extract_epi64(counts, 3));
+    }
+#endif
+    for (; i + 8 <= descriptorBytes; i += 8) {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, sizeof(x));
+        std::memcpy(&y, b + i, sizeof(y));
+        distance += popcount64(x ^ y);
+    }
+    for (; i < descriptorBytes; ++i) {
+        distance += popcount64(static_cast<uint64_t>(a[i] ^ b[i]));
+    }
+    return distance;
+}
+
+float squaredL2Distance(const float* a, const float* b, int dimension)
+{
+    auto distance = 0.0f;
+    auto i = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+    auto sum = _mm256_setzero_ps();
+    for (; i + 8 <= dimension; i += 8) {
+        const auto d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        sum = _mm256_fmadd_ps(d, d, sum);
+    }
+    auto half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_hadd_ps(half, half);
+    half = _mm_hadd_ps(half, half);
+    distance = _mm_cvtss_f32(half);
+#endif
+    for (; i < dimension; ++i) {
+        const auto d = a[i] - b[i];
+        distance += d * d;
+    }
+    return distance;
+}
+
+void simdMatchHamming(
+    const uint8_t* query, size_t queryStride, int numQuery,
+    const uint8_t* train, size_t trainStride, int numTrain,
+    int descriptorBytes, float ratio,
+    vector<SimdMatch>& matches
+)
+{
+    mutualRatioMatch<uint32_t>(
+        numQuery,
+        numTrain,
+        [&](int q, int t) {
+            return hammingDistance(query + q * queryStride, train + t * trainStride, descriptorBytes);
+        },
+        [ratio](const TopTwo<uint32_t>& top) {
+            return top.second != numeric_limits<uint32_t>::max() &&
+                static_cast<float>(top.best) <= ratio * static_cast<float>(top.second);
+        },
+        [](uint32_t d) { return static_cast<float>(d); },
+        matches
+    );
+}
+
+void simdMatchL2(
+    const float* query, size_t queryStride, int numQuery,
+    const float* train, size_t trainStride, int numTrain,
+    int dimension, float ratio,
+    vector<SimdMatch>& matches
+)
+{
+    //Distances stay squared inside the kernel, so the ratio is squared too
+    const auto squaredRatio = ratio * ratio;
+    mutualRatioMatch<float>(
+        numQuery,
+        numTrain,
+        [&](int q, int t) {
+            return squaredL2Distance(query + q * queryStride, train + t * trainStride, dimension);
+        },
+        [squaredRatio](const TopTwo<float>& top) {
+            return top.second != numeric_limits<float>::max() && top.best <= squaredRatio * top.second;
+        },
+        [](float d) { return std::sqrt(d); },
+        matches
+    );
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Brute force matcher that replaces the two kNN passes of RobustMatcher::robustMatch with a
+ * single pass over the query x train distance matrix.
+ *
+ * The matrix is visited in cache sized tiles and never stored. While it is visited the two
+ * nearest neighbours of every query row and of every train column are tracked, which is all
+ * the ratio and symmetry tests need. A match is returned when the best train descriptor of a
+ * query passes the ratio test and that query is in turn the best match of the train descriptor,
+ * also passing the ratio test. The matches are appended to the output vector.
+ *
+ * Hamming distances use AVX-512 VPOPCNTDQ or an AVX2 nibble lookup when the build targets
+ * them and the scalar popcount instruction otherwise. L2 distances use AVX2 FMA when
+ * available.
+ */
+struct SimdMatch {
+    int queryIdx;
+    int trainIdx;
+    float distance;
+};
+
+// Binary descriptors of descriptorBytes bytes with a row stride of queryStride/trainStride bytes
+void simdMatchHamming(
+    const uint8_t* query, size_t queryStride, int numQuery,
+    const uint8_t* train, size_t trainStride, int numTrain,
+    int descriptorBytes, float ratio,
+    std::vector<SimdMatch>& matches
+);
+
+// Float descriptors of dimension floats with a row stride of queryStride/trainStride floats
+void simdMatchL2(
+    const float* query, size_t queryStride, int numQuery,
+    const float* train, size_t trainStride, int numTrain,
+    int dimension, float ratio,
+    std::vector<SimdMatch>& matches
+);
+
+uint32_t hammingDistance(const uint8_t* a, const uint8_t* b, int descriptorBytes);
+float squaredL2Distance(const float* a, const float* b, int dimension);
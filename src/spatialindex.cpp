@@ -0,0 +1,183 @@
+#include "spatialindex.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using cv::Point3d;
+using std::pair;
+using std::vector;
+
+namespace
+{
+    // Ranges this small are scanned rather than split further
+    const size_t LEAF_SIZE = 8;
+
+    double coordinate(const Point3d& point, int axis)
+    {
+        return axis == 0 ? point.x : (axis == 1 ? point.y : point.z);
+    }
+
+    double squaredDistance(const Point3d& a, const Point3d& b)
+    {
+        const auto d = a - b;
+        return d.dot(d);
+    }
+
+    bool closer(const pair<double, int>& a, const pair<double, int>& b)
+    {
+        return a.first < b.first;
+    }
+} //namespace
+
+SpatialIndex::SpatialIndex()
+    : points_()
+    , ids_()
+    , axes_()
+{
+}
+
+SpatialIndex::SpatialIndex(const vector<Point3d>& points)
+    : points_(points)
+    , ids_(points.size())
+    , axes_(points.size(), 0)
+{
+    //The tree is built over the ids, the points are put in tree order once at the end
+    std::iota(ids_.begin(), ids_.end(), 0);
+    _build(0, points_.size());
+    for (size_t i = 0; i < ids_.size(); ++i) {
+        points_[i] = points[ids_[i]];
+    }
+}
+
+void SpatialIndex::_build(size_t begin, size_t end)
+{
+    if (end - begin <= LEAF_SIZE)
+        return;
+
+    //Split along the axis of largest extent
+    Point3d low = points_[ids_[begin]], high = low;
+    for (auto i = begin + 1; i < end; ++i) {
+        const auto& point = points_[ids_[i]];
+        low = { std::min(low.x, point.x), std::min(low.y, point.y), std::min(low.z, point.z) };
+        high = { std::max(high.x, point.x), std::max(high.y, point.y), std::max(high.z, point.z) };
+    }
+    const auto extent = high - low;
+    const auto axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    const auto mid = begin + (end - begin) / 2;
+    std::nth_element(ids_.begin() + begin, ids_.begin() + mid, ids_.begin() + end, [this, axis](int a, int b) {
+        return coordinate(points_[a], axis) < coordinate(points_[b], axis);
+    });
+    axes_[mid] = static_cast<uint8_t>(axis);
+
+    _build(begin, mid);
+    _build(mid + 1, end);
+}
+
+void SpatialIndex::_radius(size_t begin, size_t end, const Point3d& center, double squaredRadius, vector<int>& result) const
+{
+    if (end - begin <= LEAF_SIZE) {
+        for (auto i = begin; i < end; ++i) {
+            if (squaredDistance(points_[i], center) <= squaredRadius)
+                result.push_back(ids_[i]);
+        }
+        return;
+    }
+
+    const auto mid = begin + (end - begin) / 2;
+    if (squaredDistance(points_[mid], center) <= squaredRadius)
+        result.push_back(ids_[mid]);
+
+    const auto offset = coordinate(center, axes_[mid]) - coordinate(points_[mid], axes_[mid]);
+    if (offset <= 0 || offset * offset <= squaredRadius)
+        _radius(begin, mid, center, squaredRadius, result);
+    if (offset >= 0 || offset * offset <= squaredRadius)
+        _radius(mid + 1, end, center, squaredRadius, result);
+}
+
+void SpatialIndex::_nearest(size_t begin, size_t end, const Point3d& center, size_t k,
+    vector<pair<double, int>>& heap, double& squaredBound) const
+{
+    const auto visit = [&](size_t i) {
+        const auto d = squaredDistance(points_[i], center);
+        if (d > squaredBound)
+            return;
+
+        heap.emplace_back(d, ids_[i]);
+        std::push_heap(heap.begin(), heap.end(), closer);
+        if (heap.size() > k) {
+            std::pop_heap(heap.begin(), heap.end(), closer);
+            heap.pop_back();
+        }
+        if (heap.size() == k)
+            squaredBound = std::min(squaredBound, heap.front().first);
+    };
+
+    if (end - begin <= LEAF_SIZE) {
+        for (auto i = begin; i < end; ++i) {
+            visit(i);
+        }
+        return;
+    }
+
+    const auto mid = begin + (end - begin) / 2;
+    visit(mid);
+
+    //Descend the side of the center first, the other side only while it can still hold a closer point
+    const auto offset = coordinate(center, axes_[mid]) - coordinate(points_[mid], axes_[mid]);
+    if (offset <= 0) {
+        _nearest(begin, mid, center, k, heap, squaredBound);
+        if (offset * offset <= squaredBound)
+            _nearest(mid + 1, end, center, k, heap, squaredBound);
+    }
+    else {
+        _nearest(mid + 1, end, center, k, heap, squaredBound);
+        if (offset * offset <= squaredBound)
+            _nearest(begin, mid, center, k, heap, squaredBound);
+    }
+}
+
+vector<int> SpatialIndex::radius(const Point3d& center, double radius) const
+{
+    vector<int> result;
+    if (!points_.empty())
+        _radius(0, points_.size(), center, radius * radius, result);
+    return result;
+}
+
+vector<pair<int, double>> SpatialIndex::nearest(const Point3d& center, int k, double maxDistance) const
+{
+    vector<pair<int, double>> result;
+    if (points_.empty() || k <= 0)
+        return result;
+
+    vector<pair<double, int>> heap;
+    heap.reserve(k + 1);
+    auto squaredBound = maxDistance * maxDistance;
+    _nearest(0, points_.size(), center, static_cast<size_t>(k), heap, squaredBound);
+    std::sort_heap(heap.begin(), heap.end(), closer);
+    for (const auto& [squared, id] : heap) {
+        result.emplace_back(id, std::sqrt(squared));
+    }
+    return result;
+}
+
+vector<vector<int>> SpatialIndex::radius(const vector<Point3d>& centers, double radius) const
+{
+    vector<vector<int>> results(centers.size());
+#pragma omp parallel for schedule(dynamic, 64)
+    for (auto i = 0; i < static_cast<int>(centers.size()); ++i) {
+        results[i] = this->radius(centers[i], radius);
+    }
+    return results;
+}
+
+vector<vector<pair<int, double>>> SpatialIndex::nearest(const vector<Point3d>& centers, int k, double maxDistance) const
+{
+    vector<vector<pair<int, double>>> results(centers.size());
+#pragma omp parallel for schedule(dynamic, 64)
+    for (auto i = 0; i < static_cast<int>(centers.size()); ++i) {
+        results[i] = nearest(centers[i], k, maxDistance);
+    }
+    return results;
+}
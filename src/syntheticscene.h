@@ -0,0 +1,52 @@
+#pragma once
+#include "reconstruction.h"
+#include "trackstore.h"
+#include "utilities.h"
+#include <opencv2/core.hpp>
+#include <string>
+
+/*
+ * Synthetic scenes for the bundle tests: shots on the x axis looking down z, with the camera and the
+ * projection the bundle models, and points observed without noise by a run of consecutive shots.
+ */
+namespace syntheticscene
+{
+    const double FOCAL = 0.9;
+
+    inline Camera camera()
+    {
+        return getPerspectiveCamera(FOCAL, 3000, 4000, 0.0, 0.0);
+    }
+
+    // Projection of a world point by a shot at origin looking down z, as the bundle models it
+    inline cv::Point2f project(const cv::Point3d& point, const cv::Point3d& origin)
+    {
+        const auto p = point - origin;
+        return { static_cast<float>(FOCAL * p.x / p.z), static_cast<float>(FOCAL * p.y / p.z) };
+    }
+
+    // Adds the shots at x = 0 .. numShots - 1, named by their index, with their true position as gps
+    inline void addShotsOnLine(Reconstruction& rec, TrackStore& tracks, int numShots)
+    {
+        for (auto i = 0; i < numShots; ++i) {
+            const auto name = std::to_string(i) + ".jpg";
+            tracks.addImage(name);
+            rec.addShot(name, Shot(name, DEFAULT_CAMERA_ID, Pose(cv::Mat::zeros(3, 1, CV_64F), cv::Vec3d(-i, 0, 0)),
+                ShotMetadata(cv::Point3d(i, 0, 0), 5.0, i, 1)));
+        }
+    }
+
+    // Adds a track seen by the shots firstShot .. lastShot - 1 and its cloud point at a given, possibly
+    // perturbed, position
+    inline void addPoint(Reconstruction& rec, TrackStore& tracks, int track, const cv::Point3d& point,
+        int firstShot, int lastShot, const cv::Point3d& position)
+    {
+        for (auto i = firstShot; i < lastShot; ++i) {
+            tracks.addObservation(track, i, track, project(point, cv::Point3d(i, 0, 0)), 1.0f, cv::Scalar());
+        }
+        CloudPoint cloudPoint;
+        cloudPoint.setId(track);
+        cloudPoint.setPosition(position);
+        rec.addCloudPoint(cloudPoint);
+    }
+} //namespace syntheticscene
@@ -0,0 +1,131 @@
+#include "trackbuilder.h"
+#include <algorithm>
+
+using std::atomic;
+using std::memory_order_relaxed;
+using std::pair;
+using std::vector;
+
+TrackBuilder::TrackBuilder()
+    : featureOffsets_(1, 0)
+    , parents_()
+    , matched_()
+    , trackOffsets_(1, 0)
+    , trackFeatures_()
+{
+}
+
+TrackBuilder::TrackBuilder(const vector<size_t>& featureCounts)
+    : featureOffsets_(1, 0)
+    , parents_()
+    , matched_()
+    , trackOffsets_(1, 0)
+    , trackFeatures_()
+{
+    for (const auto count : featureCounts) {
+        featureOffsets_.push_back(featureOffsets_.back() + static_cast<uint32_t>(count));
+    }
+    parents_.reset(new atomic<uint32_t>[numFeatures()]);
+    matched_.reset(new atomic<uint8_t>[numFeatures()]);
+    for (uint32_t i = 0; i < numFeatures(); ++i) {
+        parents_[i].store(i, memory_order_relaxed);
+        matched_[i].store(0, memory_order_relaxed);
+    }
+}
+
+int TrackBuilder::imageOf(uint32_t featureId) const
+{
+    return static_cast<int>(std::upper_bound(featureOffsets_.begin(), featureOffsets_.end(), featureId) - featureOffsets_.begin()) - 1;
+}
+
+uint32_t TrackBuilder::_find(uint32_t feature) const
+{
+    auto parent = parents_[feature].load(memory_order_relaxed);
+    while (parent != feature) {
+        //Path halving, a failed exchange only means another thread already shortened the path
+        const auto grandParent = parents_[parent].load(memory_order_relaxed);
+        parents_[feature].compare_exchange_weak(parent, grandParent, memory_order_relaxed);
+        feature = grandParent;
+        parent = parents_[feature].load(memory_order_relaxed);
+    }
+    return feature;
+}
+
+void TrackBuilder::_unite(uint32_t a, uint32_t b)
+{
+    while (true) {
+        a = _find(a);
+        b = _find(b);
+        if (a == b)
+            return;
+
+        //Always hang the larger root below the smaller one so no cycle can form
+        if (a < b)
+            std::swap(a, b);
+        auto expected = a;
+        if (parents_[a].compare_exchange_strong(expected, b, memory_order_relaxed))
+            return;
+    }
+}
+
+bool TrackBuilder::validMatches(int queryImage, int trainImage, const int32_t* queryIdx, const int32_t* trainIdx, size_t count) const
+{
+    if (queryImage < 0 || trainImage < 0 || queryImage >= static_cast<int>(numImages()) || trainImage >= static_cast<int>(numImages()))
+        return false;
+
+    //Compared as signed counts so a negative index can not wrap around into range
+    const auto queryCount = static_cast<int64_t>(featureOffsets_[queryImage + 1] - featureOffsets_[queryImage]);
+    const auto trainCount = static_cast<int64_t>(featureOffsets_[trainImage + 1] - featureOffsets_[trainImage]);
+    for (size_t i = 0; i < count; ++i) {
+        if (queryIdx[i] < 0 || queryIdx[i] >= queryCount || trainIdx[i] < 0 || trainIdx[i] >= trainCount)
+            return false;
+    }
+    return true;
+}
+
+bool TrackBuilder::addMatches(int queryImage, int trainImage, const int32_t* queryIdx, const int32_t* trainIdx, size_t count)
+{
+    if (!validMatches(queryImage, trainImage, queryIdx, trainIdx, count))
+        return false;
+
+    const auto queryOffset = featureOffsets_[queryImage];
+    const auto trainOffset = featureOffsets_[trainImage];
+    for (size_t i = 0; i < count; ++i) {
+        const auto query = queryOffset + queryIdx[i];
+        const auto train = trainOffset + trainIdx[i];
+        matched_[query].store(1, memory_order_relaxed);
+        matched_[train].store(1, memory_order_relaxed);
+        _unite(query, train);
+    }
+    return true;
+}
+
+void TrackBuilder::buildTracks(int minTrackLength)
+{
+    //Only matched features can be part of a track
+    vector<pair<uint32_t, uint32_t>> rootsAndFeatures;
+    for (uint32_t feature = 0; feature < numFeatures(); ++feature) {
+        if (matched_[feature].load(memory_order_relaxed))
+            rootsAndFeatures.emplace_back(_find(feature), feature);
+    }
+    std::sort(rootsAndFeatures.begin(), rootsAndFeatures.end());
+
+    trackOffsets_.assign(1, 0);
+    trackFeatures_.clear();
+    for (size_t begin = 0, end = 0; begin < rootsAndFeatures.size(); begin = end) {
+        end = begin + 1;
+        auto consistent = true;
+        while (end < rootsAndFeatures.size() && rootsAndFeatures[end].first == rootsAndFeatures[begin].first) {
+            //Features of a set are sorted by id, so two features of the same image are adjacent
+            consistent = consistent && imageOf(rootsAndFeatures[end].second) != imageOf(rootsAndFeatures[end - 1].second);
+            end++;
+        }
+        if (!consistent || end - begin < static_cast<size_t>(minTrackLength))
+            continue;
+
+        for (auto i = begin; i < end; ++i) {
+            trackFeatures_.push_back(rootsAndFeatures[i].second);
+        }
+        trackOffsets_.push_back(static_cast<uint32_t>(trackFeatures_.size()));
+    }
+}
@@ -0,0 +1,122 @@
+#include "trackstore.h"
+
+using cv::Point2f;
+using cv::Scalar;
+using std::string;
+using std::vector;
+
+TrackStore::TrackStore()
+    : imageNames_()
+    , imageIds_()
+    , observationImage_()
+    , observationTrack_()
+    , observationFeature_()
+    , observationX_()
+    , observationY_()
+    , observationScale_()
+    , observationColor_()
+    , alive_()
+    , bearings_()
+    , trackOffsets_(1, 0)
+    , trackDegree_()
+    , imageOffsets_(1, 0)
+    , imageObservations_()
+{
+}
+
+int TrackStore::addImage(const string& imageName)
+{
+    const auto inserted = imageIds_.emplace(imageName, static_cast<int>(imageNames_.size()));
+    if (inserted.second)
+        imageNames_.push_back(imageName);
+    return inserted.first->second;
+}
+
+void TrackStore::addObservation(int track, int image, int feature, const Point2f& point, float scale, const Scalar& color)
+{
+    CV_Assert(track == static_cast<int>(numTracks()) - 1 || track == static_cast<int>(numTracks()));
+    if (track == static_cast<int>(numTracks())) {
+        trackOffsets_.push_back(trackOffsets_.back());
+        trackDegree_.push_back(0);
+    }
+    observationImage_.push_back(image);
+    observationTrack_.push_back(track);
+    observationFeature_.push_back(feature);
+    observationX_.push_back(point.x);
+    observationY_.push_back(point.y);
+    observationScale_.push_back(scale);
+    for (auto c = 0; c < 3; ++c) {
+        observationColor_.push_back(cv::saturate_cast<uint8_t>(color[c]));
+    }
+    alive_.push_back(1);
+    trackOffsets_.back()++;
+    trackDegree_.back()++;
+}
+
+void TrackStore::buildIndex()
+{
+    //Counting sort of the observations by image keeps them in track order within an image
+    imageOffsets_.assign(numImages() + 1, 0);
+    for (const auto image : observationImage_) {
+        imageOffsets_[image + 1]++;
+    }
+    for (size_t image = 0; image < numImages(); ++image) {
+        imageOffsets_[image + 1] += imageOffsets_[image];
+    }
+    imageObservations_.resize(numObservations());
+    auto next = imageOffsets_;
+    for (uint32_t observation = 0; observation < numObservations(); ++observation) {
+        imageObservations_[next[observationImage_[observation]]++] = observation;
+    }
+}
+
+int TrackStore::imageId(const string& imageName) const
+{
+    const auto image = imageIds_.find(imageName);
+    return image == imageIds_.end() ? -1 : image->second;
+}
+
+Scalar TrackStore::color(uint32_t observation) const
+{
+    const auto c = observationColor_.data() + 3 * static_cast<size_t>(observation);
+    return Scalar(c[0], c[1], c[2]);
+}
+
+int64_t TrackStore::findObservation(int track, int image) const
+{
+    for (auto observation = trackBegin(track); observation < trackEnd(track); ++observation) {
+        if (observationImage_[observation] == image && alive_[observation])
+            return observation;
+    }
+    return -1;
+}
+
+void TrackStore::removeObservation(uint32_t observation)
+{
+    if (!alive_[observation])
+        return;
+
+    alive_[observation] = 0;
+    trackDegree_[observationTrack_[observation]]--;
+}
+
+void TrackStore::removeTrack(int track)
+{
+    for (auto observation = trackBegin(track); observation < trackEnd(track); ++observation) {
+        removeObservation(observation);
+    }
+}
+
+ImagePoints TrackStore::observationPoints() const
+{
+    ImagePoints points;
+    points.x.assign(observationX_.begin(), observationX_.end());
+    points.y.assign(observationY_.begin(), observationY_.end());
+    return points;
+}
+
+void TrackStore::setBearings(Bearings bearings)
+{
+    CV_Assert(bearings.size() == numObservations());
+    bearings_ = std::move(bearings);
+}
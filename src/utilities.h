@@ -4,26 +4,6 @@
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 
-inline void printGraph(TrackGraph tracksGraph) {
-    std::cerr << "Number of vertices is " << tracksGraph.m_vertices.size() << std::endl;
-    std::cerr << "Number of edges is " << tracksGraph.m_edges.size() << std::endl;
-
-    TrackGraph::vertex_iterator i, end;
-    std::pair<TrackGraph::vertex_iterator,
-        TrackGraph::vertex_iterator> vs = boost::vertices(tracksGraph);
-
-    std::copy(vs.first, vs.second,
-        std::ostream_iterator<TrackGraph::vertex_descriptor>{
-        std::cout, "\n"});
-
-    auto es = boost::edges(tracksGraph);
-
-
-    std::copy(es.first, es.second,
-        std::ostream_iterator<TrackGraph::edge_descriptor>{
-        std::cout, "\n"});
-}
-
 inline Camera getPerspectiveCamera(float physicalLens, int height, int width, double k1, double k2) {
     const auto pixelFocal = physicalLens * std::max(height, width);
 
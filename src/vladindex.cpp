@@ -0,0 +1,150 @@
+#include "vladindex.h"
+#include "simdmatcher.h"
+#include "vl/kmeans.h"
+#include "vl/vlad.h"
+#include <algorithm>
+#include <limits>
+
+using cv::Mat;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace
+{
+    const int QUERY_BLOCK_ROWS = 1024;
+
+    // The k images with the highest similarity other than the image itself, best first
+    vector<pair<int, float>> mostSimilar(const float* similarities, int numImages, int image, int k)
+    {
+        vector<pair<int, float>> scores;
+        scores.reserve(numImages);
+        for (auto other = 0; other < numImages; ++other) {
+            if (other != image)
+                scores.emplace_back(other, similarities[other]);
+        }
+
+        const auto numResults = std::min(static_cast<size_t>(std::max(k, 0)), scores.size());
+        std::partial_sort(scores.begin(), scores.begin() + numResults, scores.end(),
+            [](const pair<int, float>& a, const pair<int, float>& b) { return a.second > b.second; });
+        scores.resize(numResults);
+        return scores;
+    }
+} //namespace
+
+VladIndex::VladIndex(int numWords)
+    : numWords_(numWords)
+    , dimension_(0)
+    , words_()
+    , imageNames_()
+    , encodings_()
+{
+}
+
+Mat VladIndex::toFloatDescriptors(const Mat& descriptors)
+{
+    if (descriptors.type() == CV_32F)
+        return descriptors.clone();
+
+    if (descriptors.type() != CV_8U) {
+        Mat converted;
+        descriptors.convertTo(converted, CV_32F);
+        return converted;
+    }
+
+    Mat unpacked(descriptors.rows, descriptors.cols * 8, CV_32F);
+    for (auto i = 0; i < descriptors.rows; ++i) {
+        const auto bytes = descriptors.ptr<uchar>(i);
+        auto bits = unpacked.ptr<float>(i);
+        for (auto j = 0; j < descriptors.cols; ++j) {
+            for (auto b = 0; b < 8; ++b) {
+                bits[8 * j + b] = static_cast<float>((bytes[j] >> b) & 1);
+            }
+        }
+    }
+    return unpacked;
+}
+
+void VladIndex::train(const Mat& samples)
+{
+    const auto data = toFloatDescriptors(samples);
+    CV_Assert(data.isContinuous() && data.rows >= numWords_);
+    dimension_ = data.cols;
+
+    auto kmeans = vl_kmeans_new(VL_TYPE_FLOAT, VlDistanceL2);
+    vl_kmeans_set_algorithm(kmeans, VlKMeansElkan);
+    vl_kmeans_set_initialization(kmeans, VlKMeansPlusPlus);
+    vl_kmeans_set_max_num_iterations(kmeans, 50);
+    vl_kmeans_cluster(kmeans, data.ptr<float>(), dimension_, data.rows, numWords_);
+    const auto centers = static_cast<const float*>(vl_kmeans_get_centers(kmeans));
+    words_.assign(centers, centers + static_cast<size_t>(numWords_) * dimension_);
+    vl_kmeans_delete(kmeans);
+}
+
+vector<float> VladIndex::_encode(const Mat& descriptors) const
+{
+    vector<float> encoding(static_cast<size_t>(numWords_) * dimension_, 0.0f);
+    const auto data = toFloatDescriptors(descriptors);
+    if (data.empty() || data.cols != dimension_)
+        return encoding;
+
+    //Hard assignment to the nearest word, written as the one hot matrix vl_vlad_encode expects
+    vector<float> assignments(static_cast<size_t>(data.rows) * numWords_, 0.0f);
+    for (auto i = 0; i < data.rows; ++i) {
+        auto best = std::numeric_limits<float>::max();
+        auto bestWord = 0;
+        for (auto w = 0; w < numWords_; ++w) {
+            const auto d = squaredL2Distance(data.ptr<float>(i), words_.data() + static_cast<size_t>(w) * dimension_, dimension_);
+            if (d < best) {
+                best = d;
+                bestWord = w;
+            }
+        }
+        assignments[static_cast<size_t>(i) * numWords_ + bestWord] = 1.0f;
+    }
+
+    vl_vlad_encode(encoding.data(), VL_TYPE_FLOAT, words_.data(), dimension_, numWords_,
+        data.ptr<float>(), data.rows, assignments.data(),
+        VL_VLAD_FLAG_SQUARE_ROOT | VL_VLAD_FLAG_NORMALIZE_COMPONENTS);
+    return encoding;
+}
+
+void VladIndex::add(const string& imageName, const Mat& descriptors)
+{
+    CV_Assert(isTrained());
+    const auto encoding = _encode(descriptors);
+    imageNames_.push_back(imageName);
+    encodings_.insert(encodings_.end(), encoding.begin(), encoding.end());
+}
+
+Mat VladIndex::_encodingMatrix() const
+{
+    const auto length = numWords_ * dimension_;
+    return Mat(static_cast<int>(imageNames_.size()), length, CV_32F, const_cast<float*>(encodings_.data()));
+}
+
+vector<pair<int, float>> VladIndex::query(int imageIndex, int k) const
+{
+    const auto encodings = _encodingMatrix();
+    Mat similarities;
+    cv::gemm(encodings.row(imageIndex), encodings, 1.0, cv::noArray(), 0.0, similarities, cv::GEMM_2_T);
+    return mostSimilar(similarities.ptr<float>(0), encodings.rows, imageIndex, k);
+}
+
+vector<vector<pair<int, float>>> VladIndex::queryAll(int k) const
+{
+    const auto numImages = static_cast<int>(imageNames_.size());
+    vector<vector<pair<int, float>>> results(numImages);
+    const auto encodings = _encodingMatrix();
+    //The similarity matrix is computed a block of rows at a time so its memory stays bounded
+    for (auto begin = 0; begin < numImages; begin += QUERY_BLOCK_ROWS) {
+        const auto end = std::min(numImages, begin + QUERY_BLOCK_ROWS);
+        Mat similarities;
+        cv::gemm(encodings.rowRange(begin, end), encodings, 1.0, cv::noArray(), 0.0, similarities, cv::GEMM_2_T);
+#pragma omp parallel for
+        for (auto image = begin; image < end; ++image) {
+            results[image] = mostSimilar(similarities.ptr<float>(image - begin), numImages, image, k);
+        }
+    }
+    return results;
+}
@@ -0,0 +1,391 @@
+#include "vocabularytree.h"
+#include "vl/hikmeans.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+using cv::Mat;
+using std::cerr;
+using std::function;
+using std::ifstream;
+using std::lock_guard;
+using std::mutex;
+using std::ofstream;
+using std::pair;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace
+{
+    const int TRAINING_ITERATIONS = 50;
+
+    template <typename T>
+    void writeArray(ofstream& out, const vector<T>& values)
+    {
+        out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    template <typename T>
+    bool readArray(ifstream& in, vector<T>& values, size_t count)
+    {
+        values.resize(count);
+        in.read(reinterpret_cast<char*>(values.data()), count * sizeof(T));
+        return static_cast<bool>(in);
+    }
+} //namespace
+
+VocabularyTree::VocabularyTree(int branching, int depth)
+    : branching_(branching)
+    , depth_(depth)
+    , dimension_(0)
+    , numWords_(0)
+    , nodeFirstCenter_()
+    , nodeNumCenters_()
+    , centers_()
+    , centerNext_()
+    , imageNames_()
+    , imageIds_()
+    , imageTermOffsets_(1, 0)
+    , imageTerms_()
+    , invertedLists_()
+    , weightsMutex_()
+    , weightsDirty_(true)
+    , idf_()
+    , imageNorms_()
+{
+}
+
+Mat VocabularyTree::toByteDescriptors(const Mat& descriptors)
+{
+    Mat bytes;
+    if (descriptors.type() == CV_8U) {
+        bytes.create(descriptors.rows, descriptors.cols * 8, CV_8U);
+        for (auto i = 0; i < descriptors.rows; ++i) {
+            const auto packed = descriptors.ptr<uchar>(i);
+            auto unpacked = bytes.ptr<uchar>(i);
+            for (auto j = 0; j < descriptors.cols; ++j) {
+                for (auto b = 0; b < 8; ++b) {
+                    unpacked[8 * j + b] = ((packed[j] >> b) & 1) ? 255 : 0;
+                }
+            }
+        }
+        return bytes;
+    }
+
+    Mat data;
+    descriptors.convertTo(data, CV_32F);
+    bytes.create(data.rows, data.cols, CV_8U);
+    for (auto i = 0; i < data.rows; ++i) {
+        const auto norm = cv::norm(data.row(i));
+        const auto scale = norm > 0 ? 512.0 / norm : 0.0;
+        data.row(i).convertTo(bytes.row(i), CV_8U, scale);
+    }
+    return bytes;
+}
+
+int VocabularyTree::_flatten(const void* hikmNode)
+{
+    const auto node = static_cast<const VlHIKMNode*>(hikmNode);
+    const auto numCenters = static_cast<uint32_t>(vl_ikm_get_K(node->filter));
+    const auto centers = vl_ikm_get_centers(node->filter);
+    const auto nodeIndex = static_cast<int>(nodeFirstCenter_.size());
+    const auto firstCenter = static_cast<uint32_t>(centerNext_.size());
+    nodeFirstCenter_.push_back(firstCenter);
+    nodeNumCenters_.push_back(numCenters);
+    centers_.insert(centers_.end(), centers, centers + static_cast<size_t>(numCenters) * dimension_);
+    centerNext_.resize(firstCenter + numCenters);
+
+    for (uint32_t c = 0; c < numCenters; ++c) {
+        //A branch that received fewer samples than the branching factor stops early
+        const auto child = node->children ? node->children[c] : nullptr;
+        if (child && vl_ikm_get_K(child->filter) > 0) {
+            centerNext_[firstCenter + c] = _flatten(child);
+        }
+        else {
+            centerNext_[firstCenter + c] = -static_cast<int32_t>(++numWords_);
+        }
+    }
+    return nodeIndex;
+}
+
+void VocabularyTree::train(const Mat& samples)
+{
+    const auto data = toByteDescriptors(samples);
+    CV_Assert(data.isContinuous() && data.rows >= branching_);
+    dimension_ = data.cols;
+
+    auto hikm = vl_hikm_new(VL_IKM_ELKAN);
+    vl_hikm_init(hikm, dimension_, branching_, depth_);
+    vl_hikm_set_max_niters(hikm, TRAINING_ITERATIONS);
+    vl_hikm_train(hikm, data.ptr<vl_uint8>(), data.rows);
+
+    numWords_ = 0;
+    nodeFirstCenter_.clear();
+    nodeNumCenters_.clear();
+    centers_.clear();
+    centerNext_.clear();
+    _flatten(vl_hikm_get_root(hikm));
+    vl_hikm_delete(hikm);
+
+    imageNames_.clear();
+    imageIds_.clear();
+    imageTermOffsets_.assign(1, 0);
+    imageTerms_.clear();
+    invertedLists_.assign(numWords_, {});
+    lock_guard<mutex> lock(weightsMutex_);
+    weightsDirty_ = true;
+}
+
+uint32_t VocabularyTree::_quantizeOne(const uint8_t* descriptor) const
+{
+    auto node = 0;
+    while (true) {
+        const auto first = nodeFirstCenter_[node];
+        auto best = std::numeric_limits<int64_t>::max();
+        auto bestCenter = first;
+        for (auto c = first; c < first + nodeNumCenters_[node]; ++c) {
+            const auto center = centers_.data() + static_cast<size_t>(c) * dimension_;
+            int64_t distance = 0;
+            for (auto d = 0; d < dimension_; ++d) {
+                const int64_t diff = static_cast<int64_t>(descriptor[d]) - center[d];
+                distance += diff * diff;
+            }
+            if (distance < best) {
+                best = distance;
+                bestCenter = c;
+            }
+        }
+        const auto next = centerNext_[bestCenter];
+        if (next < 0)
+            return static_cast<uint32_t>(-next - 1);
+        node = next;
+    }
+}
+
+vector<uint32_t> VocabularyTree::quantize(const Mat& descriptors) const
+{
+    CV_Assert(isTrained());
+    const auto data = toByteDescriptors(descriptors);
+    if (data.empty())
+        return {};
+
+    //Descriptors of another detector would all fall into arbitrary words
+    CV_Assert(data.cols == dimension_);
+
+    vector<uint32_t> words(data.rows);
+#pragma omp parallel for
+    for (auto i = 0; i < data.rows; ++i) {
+        words[i] = _quantizeOne(data.ptr<uint8_t>(i));
+    }
+    return words;
+}
+
+vector<VocabularyTree::Term> VocabularyTree::bagOfWords(const Mat& descriptors) const
+{
+    auto words = quantize(descriptors);
+    std::sort(words.begin(), words.end());
+    vector<Term> terms;
+    for (const auto word : words) {
+        if (terms.empty() || terms.back().word != word) {
+            terms.push_back({ word, 0 });
+        }
+        terms.back().count++;
+    }
+    return terms;
+}
+
+void VocabularyTree::_addTerms(const string& imageName, const vector<Term>& terms)
+{
+    const auto image = static_cast<uint32_t>(imageNames_.size());
+    imageNames_.push_back(imageName);
+    imageIds_[imageName] = image;
+    imageTerms_.insert(imageTerms_.end(), terms.begin(), terms.end());
+    imageTermOffsets_.push_back(imageTerms_.size());
+    for (const auto& term : terms) {
+        invertedLists_[term.word].push_back({ image, term.count });
+    }
+}
+
+int VocabularyTree::add(const string& imageName, const Mat& descriptors)
+{
+    CV_Assert(isTrained());
+    const auto existing = find(imageName);
+    if (existing >= 0)
+        return existing;
+
+    _addTerms(imageName, bagOfWords(descriptors));
+    lock_guard<mutex> lock(weightsMutex_);
+    weightsDirty_ = true;
+    return static_cast<int>(imageNames_.size()) - 1;
+}
+
+int VocabularyTree::find(const string& imageName) const
+{
+    const auto image = imageIds_.find(imageName);
+    return image == imageIds_.end() ? -1 : image->second;
+}
+
+void VocabularyTree::_updateWeights() const
+{
+    //Adding an image changes the document frequencies of its words, so the weights are refreshed once per batch of adds
+    lock_guard<mutex> lock(weightsMutex_);
+    if (!weightsDirty_)
+        return;
+
+    const auto numImages = static_cast<float>(imageNames_.size());
+    idf_.resize(numWords_);
+    for (size_t word = 0; word < numWords_; ++word) {
+        const auto frequency = invertedLists_[word].size();
+        idf_[word] = frequency ? std::log(numImages / frequency) : 0.0f;
+    }
+
+    imageNorms_.assign(imageNames_.size(), 0.0f);
+    for (size_t image = 0; image < imageNames_.size(); ++image) {
+        auto squaredNorm = 0.0f;
+        for (auto t = imageTermOffsets_[image]; t < imageTermOffsets_[image + 1]; ++t) {
+            const auto weight = imageTerms_[t].count * idf_[imageTerms_[t].word];
+            squaredNorm += weight * weight;
+        }
+        imageNorms_[image] = std::sqrt(squaredNorm);
+    }
+    weightsDirty_ = false;
+}
+
+vector<pair<int, float>> VocabularyTree::_score(const vector<Term>& terms, int k, int exclude,
+    const function<bool(int)>& accept) const
+{
+    _updateWeights();
+
+    //Only images sharing a word with the query are visited
+    unordered_map<uint32_t, float> dotProducts;
+    auto squaredQueryNorm = 0.0f;
+    for (const auto& term : terms) {
+        const auto idf = idf_[term.word];
+        const auto queryWeight = term.count * idf;
+        squaredQueryNorm += queryWeight * queryWeight;
+        if (queryWeight == 0.0f)
+            continue;
+
+        for (const auto& posting : invertedLists_[term.word]) {
+            dotProducts[posting.image] += queryWeight * posting.count * idf;
+        }
+    }
+
+    vector<pair<int, float>> scores;
+    const auto queryNorm = std::sqrt(squaredQueryNorm);
+    for (const auto& [image, dotProduct] : dotProducts) {
+        const auto other = static_cast<int>(image);
+        if (other == exclude || (accept && !accept(other)) || imageNorms_[image] == 0.0f)
+            continue;
+
+        scores.emplace_back(other, dotProduct / (queryNorm * imageNorms_[image]));
+    }
+
+    const auto numResults = std::min(static_cast<size_t>(std::max(k, 0)), scores.size());
+    std::partial_sort(scores.begin(), scores.begin() + numResults, scores.end(),
+        [](const pair<int, float>& a, const pair<int, float>& b) { return a.second > b.second; });
+    scores.resize(numResults);
+    return scores;
+}
+
+vector<pair<int, float>> VocabularyTree::query(int imageIndex, int k, const function<bool(int)>& accept) const
+{
+    const vector<Term> terms(imageTerms_.begin() + imageTermOffsets_[imageIndex],
+        imageTerms_.begin() + imageTermOffsets_[imageIndex + 1]);
+    return _score(terms, k, imageIndex, accept);
+}
+
+vector<pair<int, float>> VocabularyTree::query(const Mat& descriptors, int k, const function<bool(int)>& accept) const
+{
+    return _score(bagOfWords(descriptors), k, -1, accept);
+}
+
+bool VocabularyTree::save(const string& indexFile) const
+{
+    ofstream out(indexFile, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        cerr << "Could not write vocabulary tree " << indexFile << "\n";
+        return false;
+    }
+
+    VocabularyFileHeader header{ VOCABULARY_FILE_MAGIC, VOCABULARY_FILE_VERSION,
+        static_cast<uint32_t>(branching_), static_cast<uint32_t>(depth_), static_cast<uint32_t>(dimension_),
+        static_cast<uint32_t>(nodeFirstCenter_.size()), static_cast<uint32_t>(centerNext_.size()), numWords_,
+        imageNames_.size(), imageTerms_.size() };
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeArray(out, nodeFirstCenter_);
+    writeArray(out, nodeNumCenters_);
+    writeArray(out, centers_);
+    writeArray(out, centerNext_);
+    writeArray(out, imageTermOffsets_);
+    writeArray(out, imageTerms_);
+    for (const auto& imageName : imageNames_) {
+        out << imageName << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+bool VocabularyTree::load(const string& indexFile)
+{
+    ifstream in(indexFile, std::ios::binary);
+    if (!in)
+        return false;
+
+    VocabularyFileHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || header.magic != VOCABULARY_FILE_MAGIC || header.version != VOCABULARY_FILE_VERSION) {
+        cerr << indexFile << " is not a vocabulary tree \n";
+        return false;
+    }
+
+    vector<uint32_t> nodeFirstCenter, nodeNumCenters;
+    vector<int32_t> centers, centerNext;
+    vector<uint64_t> imageTermOffsets;
+    vector<Term> imageTerms;
+    vector<string> imageNames(header.numImages);
+    auto valid = readArray(in, nodeFirstCenter, header.numNodes) &&
+        readArray(in, nodeNumCenters, header.numNodes) &&
+        readArray(in, centers, static_cast<size_t>(header.numCenters) * header.dimension) &&
+        readArray(in, centerNext, header.numCenters) &&
+        readArray(in, imageTermOffsets, header.numImages + 1) &&
+        readArray(in, imageTerms, header.numTerms);
+    for (auto& imageName : imageNames) {
+        valid = valid && std::getline(in, imageName);
+    }
+    if (!valid || imageTermOffsets.back() != header.numTerms) {
+        cerr << "Vocabulary tree " << indexFile << " is truncated \n";
+        return false;
+    }
+
+    branching_ = header.branching;
+    depth_ = header.depth;
+    dimension_ = header.dimension;
+    numWords_ = header.numWords;
+    nodeFirstCenter_ = std::move(nodeFirstCenter);
+    nodeNumCenters_ = std::move(nodeNumCenters);
+    centers_ = std::move(centers);
+    centerNext_ = std::move(centerNext);
+
+    //The inverted lists are rebuilt from the bags of words
+    imageNames_.clear();
+    imageIds_.clear();
+    imageTermOffsets_.assign(1, 0);
+    imageTerms_.clear();
+    invertedLists_.assign(numWords_, {});
+    for (size_t image = 0; image < imageNames.size(); ++image) {
+        const vector<Term> terms(imageTerms.begin() + imageTermOffsets[image],
+            imageTerms.begin() + imageTermOffsets[image + 1]);
+        _addTerms(imageNames[image], terms);
+    }
+    lock_guard<mutex> lock(weightsMutex_);
+    weightsDirty_ = true;
+    return true;
+}
+
+string VocabularyTree::imageKey(const string& flightDirectory, const string& imageName)
+{
+    return flightDirectory + "/" + imageName;
+}
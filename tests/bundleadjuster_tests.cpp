@@ -1,5 +1,7 @@
 #include <catch.hpp>
 #include "../src/bundle.h"
+#include "bundle/bundle_adjuster.h"
+#include <random>
 
 
 SCENARIO("Single camera for bundle adjustment")
@@ -26,4 +28,133 @@ SCENARIO("Single camera for bundle adjustment")
             }
         }
     }
-}
\ No newline at end of file
+}
+
+SCENARIO("Bundle adjustment over dense integer ids")
+{
+    GIVEN("two fixed shots and points with noisy positions")
+    {
+        const auto focal = 0.9;
+        BundleAdjuster ba;
+        const auto camera = ba.AddIndexedPerspectiveCamera(focal, 0, 0, focal, 0, 0, true);
+        const auto shot0 = ba.AddIndexedShot(camera, { 0, 0, 0 }, { 0, 0, 0 }, true);
+        const auto shot1 = ba.AddIndexedShot(camera, { 0, 0, 0 }, { -1, 0, 0 }, true);
+        ba.ReserveIndexed(2, 20, 40);
+
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<double> uniform(-3.0, 3.0);
+        std::normal_distribution<double> noise(0.0, 0.05);
+        std::vector<Eigen::Vector3d> truth;
+        for (auto i = 0; i < 20; ++i) {
+            const Eigen::Vector3d point(uniform(generator), uniform(generator), 10 + uniform(generator));
+            truth.push_back(point);
+            const auto id = ba.AddIndexedPoint(point + Eigen::Vector3d(noise(generator), noise(generator), noise(generator)), false);
+            ba.AddIndexedPointProjectionObservation(shot0, id, focal * point.x() / point.z(), focal * point.y() / point.z(), 1.0);
+            ba.AddIndexedPointProjectionObservation(shot1, id, focal * (point.x() - 1) / point.z(), focal * point.y() / point.z(), 1.0);
+        }
+
+        WHEN("the problem is solved")
+        {
+            ba.SetMaxNumIterations(100);
+            ba.Run();
+
+            THEN("the points are moved back onto their rays and the errors are stored per observation")
+            {
+                REQUIRE(ba.NumIndexedShots() == 2);
+                REQUIRE(ba.NumIndexedPoints() == 20);
+                REQUIRE(ba.NumIndexedObservations() == 40);
+                for (auto observation = 0; observation < ba.NumIndexedObservations(); ++observation) {
+                    REQUIRE(ba.GetIndexedObservationShot(observation) == observation % 2);
+                    REQUIRE(ba.GetIndexedReprojectionError(observation).norm() < 1e-6);
+                }
+                for (auto point = 0; point < ba.NumIndexedPoints(); ++point) {
+                    REQUIRE((ba.GetIndexedPoint(point) - truth[point]).norm() < 1e-3);
+                }
+                REQUIRE(ba.GetIndexedPerspectiveCamera(camera).GetFocal() == focal);
+            }
+        }
+    }
+}
+
+SCENARIO("Choosing the linear solver from the size of the problem")
+{
+    GIVEN("the observations of two points seen by overlapping shots")
+    {
+        std::vector<std::pair<int, int>> pointShots{ { 1, 2 }, { 0, 0 }, { 0, 1 }, { 1, 1 }, { 0, 2 }, { 1, 0 } };
+
+        THEN("every shot pair seeing a common point is counted once")
+        {
+            REQUIRE(CountCovisiblePairs(&pointShots) == 3);
+        }
+    }
+
+    GIVEN("problems of growing size")
+    {
+        const BAProblemStatistics singleShot{ 1, 0, 500, 0 };
+        const BAProblemStatistics localBundle{ 40, 5000, 30000, 300 };
+        const BAProblemStatistics flight{ 20000, 4000000, 20000000, 400000 };
+
+        THEN("small problems are solved densely and large sparse flights iteratively")
+        {
+            const auto single = ChooseSolver(singleShot, 8);
+            REQUIRE(single.linear_solver_type == ceres::DENSE_QR);
+            REQUIRE(single.num_threads == 1);
+
+            const auto local = ChooseSolver(localBundle, 8);
+            REQUIRE(local.linear_solver_type == ceres::DENSE_SCHUR);
+            REQUIRE(local.num_threads == 4);
+
+            const auto large = ChooseSolver(flight, 8);
+            REQUIRE(large.linear_solver_type == ceres::ITERATIVE_SCHUR);
+            REQUIRE(large.num_threads == 8);
+            REQUIRE(flight.VisibilityDensity() < 0.01);
+        }
+
+        THEN("the visibility graph is only counted for problems that may use the cluster preconditioner")
+        {
+            const BALinearAlgebra suiteSparse{ true, true };
+            const BALinearAlgebra eigenSparse{ true, false };
+            REQUIRE_FALSE(NeedsVisibilityDensity(singleShot.num_shots, singleShot.num_points, suiteSparse));
+            REQUIRE_FALSE(NeedsVisibilityDensity(localBundle.num_shots, localBundle.num_points, suiteSparse));
+            REQUIRE(NeedsVisibilityDensity(flight.num_shots, flight.num_points, suiteSparse));
+            REQUIRE_FALSE(NeedsVisibilityDensity(flight.num_shots, 0, suiteSparse));
+            REQUIRE_FALSE(NeedsVisibilityDensity(flight.num_shots, flight.num_points, eigenSparse));
+        }
+    }
+
+    GIVEN("the sparse linear algebra a Ceres build may have")
+    {
+        const BALinearAlgebra suiteSparse{ true, true };
+        const BALinearAlgebra eigenSparse{ true, false };
+        const BALinearAlgebra denseOnly{ false, false };
+
+        THEN("every size and density maps to a solver and preconditioner the build can run")
+        {
+            const struct {
+                BAProblemStatistics statistics;
+                BALinearAlgebra available;
+                ceres::LinearSolverType solver;
+                ceres::PreconditionerType preconditioner;
+            } table[] = {
+                { { 5, 0, 100, -1 }, suiteSparse, ceres::DENSE_QR, ceres::JACOBI },
+                { { 50, 0, 100, -1 }, suiteSparse, ceres::SPARSE_NORMAL_CHOLESKY, ceres::JACOBI },
+                { { 50, 0, 100, -1 }, denseOnly, ceres::DENSE_QR, ceres::JACOBI },
+                { { 100, 5000, 30000, -1 }, denseOnly, ceres::DENSE_SCHUR, ceres::JACOBI },
+                { { 500, 50000, 300000, -1 }, suiteSparse, ceres::SPARSE_SCHUR, ceres::JACOBI },
+                { { 500, 50000, 300000, -1 }, eigenSparse, ceres::SPARSE_SCHUR, ceres::JACOBI },
+                { { 500, 50000, 300000, -1 }, denseOnly, ceres::ITERATIVE_SCHUR, ceres::SCHUR_JACOBI },
+                { { 2000, 400000, 2000000, 20000 }, suiteSparse, ceres::ITERATIVE_SCHUR, ceres::CLUSTER_JACOBI },
+                { { 2000, 400000, 2000000, 1000000 }, suiteSparse, ceres::ITERATIVE_SCHUR, ceres::SCHUR_JACOBI },
+                { { 2000, 400000, 2000000, -1 }, suiteSparse, ceres::ITERATIVE_SCHUR, ceres::SCHUR_JACOBI },
+                { { 2000, 400000, 2000000, 20000 }, eigenSparse, ceres::ITERATIVE_SCHUR, ceres::SCHUR_JACOBI },
+                { { 2000, 400000, 2000000, 20000 }, denseOnly, ceres::ITERATIVE_SCHUR, ceres::SCHUR_JACOBI },
+            };
+            for (const auto& row : table) {
+                const auto choice = ChooseSolver(row.statistics, 8, row.available);
+                INFO(SolverChoiceReport(row.statistics, choice));
+                REQUIRE(choice.linear_solver_type == row.solver);
+                REQUIRE(choice.preconditioner_type == row.preconditioner);
+            }
+        }
+    }
+}
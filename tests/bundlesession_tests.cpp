@@ -0,0 +1,94 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+#include "bundlesession.h"
+#include "syntheticscene.h"
+#include <opencv2/core.hpp>
+
+using cv::Point3d;
+
+SCENARIO("Bundling a reconstruction in place")
+{
+    GIVEN("three shots on a line and points with noisy positions")
+    {
+        Reconstruction rec(syntheticscene::camera());
+        TrackStore tracks;
+        syntheticscene::addShotsOnLine(rec, tracks, 3);
+
+        cv::RNG rng(7);
+        for (auto track = 0; track < 40; ++track) {
+            const Point3d point(rng.uniform(-3.0, 5.0), rng.uniform(-3.0, 3.0), rng.uniform(8.0, 12.0));
+            syntheticscene::addPoint(rec, tracks, track, point, 0, 3,
+                point + Point3d(rng.gaussian(0.05), rng.gaussian(0.05), rng.gaussian(0.05)));
+        }
+        tracks.buildIndex();
+
+        BundleSession session(rec, tracks, false, true);
+        session.setMaxIterations(100);
+
+        WHEN("the session runs")
+        {
+            session.run();
+
+            THEN("the points of the reconstruction are moved back onto their rays")
+            {
+                REQUIRE(session.numShots() == 3);
+                REQUIRE(session.numPoints() == 40);
+                REQUIRE(session.numObservations() == 120);
+                for (const auto& [track, cloudPoint] : rec.getCloudPoints()) {
+                    REQUIRE(cloudPoint.getError().size() == 3);
+                    for (const auto& [shotId, error] : cloudPoint.getError()) {
+                        REQUIRE(error.norm() < 1e-6);
+                    }
+                }
+            }
+        }
+
+        WHEN("a point is erased and an observation removed after a run")
+        {
+            session.run();
+            rec.getCloudPoints().erase(0);
+            tracks.removeObservation(static_cast<uint32_t>(tracks.findObservation(1, 2)));
+            session.sync();
+
+            THEN("they are dropped from the problem and the rest is kept")
+            {
+                REQUIRE(session.numPoints() == 39);
+                REQUIRE(session.numObservations() == 116);
+            }
+        }
+    }
+}
+
+TEST_CASE("Setting up the bundle of a 500 shot reconstruction", "[!benchmark]")
+{
+    const auto numShots = 500;
+    const auto numPoints = 20000;
+    const auto observationsPerPoint = 5;
+    Reconstruction rec(syntheticscene::camera());
+    TrackStore tracks;
+    syntheticscene::addShotsOnLine(rec, tracks, numShots);
+
+    cv::RNG rng(3);
+    for (auto track = 0; track < numPoints; ++track) {
+        const auto first = rng.uniform(0, numShots - observationsPerPoint);
+        const Point3d point(first + rng.uniform(0.0, 1.0) * observationsPerPoint, rng.uniform(-3.0, 3.0), rng.uniform(8.0, 12.0));
+        syntheticscene::addPoint(rec, tracks, track, point, first, first + observationsPerPoint, point);
+    }
+    tracks.buildIndex();
+
+    BENCHMARK("Reading the camera and metadata of every shot")
+    {
+        auto sum = 0.0;
+        for (const auto& [shotId, shot] : rec.getReconstructionShots()) {
+            sum += rec.getCamera(shot.getCameraId()).getPhysicalFocalLength() + shot.getMetadata().gpsDop;
+        }
+        return sum;
+    };
+
+    BENCHMARK("Adding the shots, points and observations to a session")
+    {
+        BundleSession session(rec, tracks, true, false);
+        session.sync();
+        return session.numObservations();
+    };
+}
@@ -195,11 +195,11 @@ SCENARIO("Testing the rotation inverse of a shot")
         Pose p{ rotation, translation };
         const std::string image = "im1";
         const auto camera = getPerspectiveCamera(physicalLens, height, width, dist1, dist2);
-        Shot shot{ image, camera, p };
+        Shot shot{ image, DEFAULT_CAMERA_ID, p };
         WHEN("the inverse of this pose is calculated")
         {
             Matrix3d eigenRotationInverse;
-            const auto bearing = shot.getCamera().normalizedPointToBearingVec(testPoint);
+            const auto bearing = camera.normalizedPointToBearingVec(testPoint);
             const auto rotationInverse = shot.getPose().getRotationMatrixInverse();
             cv2eigen(rotationInverse, eigenRotationInverse);
             Mat expectedRotationInverse = (cv::Mat_<double>(3,3) <<
@@ -233,11 +233,11 @@ SCENARIO("Testing the rotation inverse times bearing of a shot")
         Pose p{ rotation, translation };
         const std::string image = "im1";
         const auto camera = getPerspectiveCamera(physicalLens, height, width, dist1, dist2);
-        Shot shot{ image, camera, p };
+        Shot shot{ image, DEFAULT_CAMERA_ID, p };
         WHEN("the inverse of this pose is calculated")
         {
             Matrix3d eigenRotationInverse;
-            const auto bearing = shot.getCamera().normalizedPointToBearingVec(testPoint);
+            const auto bearing = camera.normalizedPointToBearingVec(testPoint);
             const auto rotationInverse = shot.getPose().getRotationMatrixInverse();
             cv2eigen(rotationInverse, eigenRotationInverse);
             THEN("the inverted pose should be as expected")
@@ -295,4 +295,183 @@ SCENARIO("Testing normalized point conversion")
         }
     }
     
-}
\ No newline at end of file
+}
+SCENARIO("Caching the rotation matrix and the origin of a pose")
+{
+    GIVEN("a pose with rotation vector [1,2,3] and translation vector [4,5,6]")
+    {
+        Mat rotation = (cv::Mat_<double>(3, 1) << 1, 2, 3);
+        Vec3d translation{ 4, 5, 6 };
+        Pose p{ rotation, translation };
+
+        WHEN("the rotation vector and the translation are written in place")
+        {
+            p.rotationData()[0] = 0.1;
+            p.translationData()[2] = -1.0;
+            p.updateCache();
+
+            THEN("the rotation matrix and the origin follow")
+            {
+                cv::Matx33d expectedRotation;
+                cv::Rodrigues(p.getRotationVector(), expectedRotation);
+                const auto expectedOrigin = -(expectedRotation.t() * p.getTranslation());
+                REQUIRE(allClose(expectedRotation, p.getRotationMatrix()));
+                REQUIRE(allClose(expectedOrigin, p.getOrigin()));
+                REQUIRE(allClose(expectedRotation.t(), p.getRotationMatrixInverse()));
+            }
+        }
+
+        WHEN("an array of bearings is rotated to the world")
+        {
+            Eigen::Matrix3Xd bearings = Eigen::Matrix3Xd::Random(3, 37);
+            Eigen::Matrix3Xd worldBearings;
+            p.rotateBearingsToWorld(bearings, worldBearings);
+
+            THEN("every column matches the single bearing rotation")
+            {
+                Matrix3d r;
+                cv::cv2eigen(p.getRotationMatrix(), r);
+                for (auto i = 0; i < bearings.cols(); ++i) {
+                    REQUIRE(allClose(Vector3d(r.transpose() * bearings.col(i)), Vector3d(worldBearings.col(i))));
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Computing the bearings and projections of a whole set of points")
+{
+    GIVEN("a perspective camera and a grid of normalized points")
+    {
+        const auto physicalLens = 0.6;
+        const auto height = 600;
+        const auto width = 800;
+        const auto dist1 = -0.1;
+        const auto dist2 = 0.01;
+        auto c = getPerspectiveCamera(physicalLens, height, width, dist1, dist2);
+
+        ImagePoints points;
+        for (auto i = -5; i <= 5; ++i) {
+            for (auto j = -5; j <= 5; ++j) {
+                points.x.push_back(0.05 * i);
+                points.y.push_back(0.04 * j);
+            }
+        }
+
+        WHEN("the bearings are computed in one batch")
+        {
+            Bearings bearings;
+            c.normalizedPointsToBearings<BrownModel>(points, bearings);
+
+            THEN("every bearing matches the single point conversion")
+            {
+                REQUIRE(bearings.size() == points.size());
+                for (size_t i = 0; i < points.size(); ++i) {
+                    const auto expected = c.normalizedPointToBearingVec(cv::Point2d{ points.x[i], points.y[i] });
+                    const Vector3d actual(bearings.x[i], bearings.y[i], bearings.z[i]);
+                    INFO("expected: " << expected);
+                    INFO("actual: " << actual);
+                    REQUIRE(allClose(expected, actual, 1e-5));
+                }
+            }
+        }
+
+        WHEN("the points go through every camera model and back")
+        {
+            ImagePoints perspective, brown, fisheye;
+            Bearings bearings;
+
+            c.normalizedPointsToBearings<PerspectiveModel>(points, bearings);
+            c.projectPoints<PerspectiveModel>(bearings, perspective);
+            c.normalizedPointsToBearings<BrownModel>(points, bearings);
+            c.projectPoints<BrownModel>(bearings, brown);
+            c.normalizedPointsToBearings<FisheyeModel>(points, bearings);
+            c.projectPoints<FisheyeModel>(bearings, fisheye);
+
+            THEN("the recovered points are the original ones")
+            {
+                for (size_t i = 0; i < points.size(); ++i) {
+                    REQUIRE(perspective.x[i] == Approx(points.x[i]).margin(1e-7));
+                    REQUIRE(perspective.y[i] == Approx(points.y[i]).margin(1e-7));
+                    REQUIRE(brown.x[i] == Approx(points.x[i]).margin(1e-7));
+                    REQUIRE(brown.y[i] == Approx(points.y[i]).margin(1e-7));
+                    REQUIRE(fisheye.x[i] == Approx(points.x[i]).margin(1e-7));
+                    REQUIRE(fisheye.y[i] == Approx(points.y[i]).margin(1e-7));
+                }
+            }
+        }
+
+        WHEN("bearings are projected in one batch")
+        {
+            Bearings bearings;
+            c.normalizedPointsToBearings<PerspectiveModel>(points, bearings);
+            ImagePoints projections;
+            c.projectPoints<PerspectiveModel>(bearings, projections);
+
+            THEN("every projection matches projectBearing")
+            {
+                for (size_t i = 0; i < points.size(); ++i) {
+                    const auto expected = c.projectBearing(Vector3d(bearings.x[i], bearings.y[i], bearings.z[i]));
+                    REQUIRE(projections.x[i] == Approx(expected.x).margin(1e-6));
+                    REQUIRE(projections.y[i] == Approx(expected.y).margin(1e-6));
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Computing the bearings of a camera with rational and thin prism distortion")
+{
+    GIVEN("a camera calibrated with twelve distortion coefficients and a grid of normalized points")
+    {
+        const auto height = 600;
+        const auto width = 800;
+        const auto pixelFocal = 0.6 * width;
+        const Mat cameraMatrix = (cv::Mat_<double>(3, 3) << pixelFocal, 0., width / 2, 0., pixelFocal, height / 2, 0., 0., 1.);
+        const Mat dist = (cv::Mat_<double>(1, 12) <<
+            -0.1, 0.01, 0.001, -0.002, 0.001, 0.05, -0.01, 0.002, 0.001, -0.0005, 0.002, 0.0003);
+        Camera c{ cameraMatrix, dist, height, width };
+
+        ImagePoints points;
+        for (auto i = -5; i <= 5; ++i) {
+            for (auto j = -5; j <= 5; ++j) {
+                points.x.push_back(0.05 * i);
+                points.y.push_back(0.04 * j);
+            }
+        }
+
+        WHEN("the bearings are computed in one batch")
+        {
+            Bearings bearings;
+            c.normalizedPointsToBearings<BrownModel>(points, bearings);
+
+            THEN("every bearing matches the single point conversion")
+            {
+                for (size_t i = 0; i < points.size(); ++i) {
+                    const auto expected = c.normalizedPointToBearingVec(cv::Point2d{ points.x[i], points.y[i] });
+                    const Vector3d actual(bearings.x[i], bearings.y[i], bearings.z[i]);
+                    INFO("expected: " << expected);
+                    INFO("actual: " << actual);
+                    REQUIRE(allClose(expected, actual, 1e-5));
+                }
+            }
+        }
+    }
+
+    GIVEN("a camera calibrated with a tilted sensor")
+    {
+        const Mat cameraMatrix = (cv::Mat_<double>(3, 3) << 480., 0., 400., 0., 480., 300., 0., 0., 1.);
+        Mat dist = Mat::zeros(14, 1, CV_64F);
+        dist.at<double>(12, 0) = 0.01;
+        Camera c{ cameraMatrix, dist, 600, 800 };
+
+        THEN("the batch bearings refuse the distortion instead of dropping the tilt")
+        {
+            ImagePoints points;
+            points.x.push_back(0.1);
+            points.y.push_back(0.1);
+            Bearings bearings;
+            REQUIRE_THROWS_AS(c.normalizedPointsToBearings<BrownModel>(points, bearings), cv::Exception);
+        }
+    }
+}
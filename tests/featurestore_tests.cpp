@@ -0,0 +1,116 @@
+#include <catch.hpp>
+#include <boost/filesystem.hpp>
+#include <vector>
+#include "featurestore.h"
+#include "flightsession.h"
+
+using cv::KeyPoint;
+using cv::Mat;
+using cv::Scalar;
+using std::vector;
+
+namespace
+{
+    void makeFeatures(vector<KeyPoint>& keypoints, Mat& descriptors, vector<Scalar>& colors)
+    {
+        const auto numFeatures = 10;
+        descriptors = Mat(numFeatures, 32, CV_8U);
+        for (auto i = 0; i < numFeatures; ++i) {
+            keypoints.push_back(KeyPoint(0.01f * i, -0.02f * i, 0.5f + i, 10.0f * i));
+            colors.push_back(Scalar(i, 2 * i, 3 * i));
+            for (auto j = 0; j < descriptors.cols; ++j) {
+                descriptors.at<uchar>(i, j) = static_cast<uchar>(i * 7 + j);
+            }
+        }
+    }
+} //namespace
+
+SCENARIO("Round tripping features through the binary feature store")
+{
+    GIVEN("keypoints, ORB style descriptors and colors for an image")
+    {
+        vector<KeyPoint> keypoints;
+        Mat descriptors;
+        vector<Scalar> colors;
+        makeFeatures(keypoints, descriptors, colors);
+
+        WHEN("the features are written to a file and mapped back")
+        {
+            const auto featureFile = (boost::filesystem::temp_directory_path() / "shomagick-test.features").string();
+            REQUIRE(FeatureStore::write(featureFile, keypoints, descriptors, colors));
+            const auto view = FeatureStore::map(featureFile);
+
+            THEN("the view returns the original values without copying the descriptors")
+            {
+                REQUIRE_FALSE(view.empty());
+                REQUIRE(view.size() == keypoints.size());
+                for (size_t i = 0; i < keypoints.size(); ++i) {
+                    REQUIRE(view.x()[i] == keypoints[i].pt.x);
+                    REQUIRE(view.y()[i] == keypoints[i].pt.y);
+                    REQUIRE(view.sizes()[i] == keypoints[i].size);
+                    REQUIRE(view.angles()[i] == keypoints[i].angle);
+                    REQUIRE(view.color(i)[2] == colors[i][2]);
+                }
+                const auto mapped = view.descriptors();
+                REQUIRE(mapped.type() == descriptors.type());
+                REQUIRE(cv::norm(mapped, descriptors, cv::NORM_L1) == 0);
+            }
+            boost::filesystem::remove(featureFile);
+        }
+    }
+
+    GIVEN("a buffer that does not hold a feature file")
+    {
+        vector<char> garbage(64, 'x');
+        THEN("no view is created from it")
+        {
+            REQUIRE(FeatureStore::fromBuffer(garbage).empty());
+        }
+    }
+}
+
+SCENARIO("Converting the legacy YAML features of a flight")
+{
+    GIVEN("a flight whose features are only in a YAML file")
+    {
+        vector<KeyPoint> keypoints;
+        Mat descriptors;
+        vector<Scalar> colors;
+        makeFeatures(keypoints, descriptors, colors);
+
+        const auto directory = boost::filesystem::temp_directory_path() / "shomagick-test-legacy-flight";
+        boost::filesystem::remove_all(directory);
+        boost::filesystem::create_directories(directory / "images");
+        FlightSession flight(directory.string());
+        {
+            cv::FileStorage fs((flight.getImageFeaturesPath() / ("a.jpg" + LEGACY_FEATURE_FILE_EXTENSION)).string(),
+                cv::FileStorage::WRITE);
+            fs << "Keypoints" << keypoints;
+            fs << "Descriptors" << descriptors;
+            fs << "Colors" << colors;
+        }
+        REQUIRE(flight.hasImageFeatures("a.jpg"));
+        REQUIRE_FALSE(boost::filesystem::exists(flight.getImageFeaturesFile("a.jpg")));
+
+        WHEN("the features are loaded")
+        {
+            const auto view = flight.loadFeatureView("a.jpg");
+
+            THEN("the binary file is written and holds the same features")
+            {
+                REQUIRE(boost::filesystem::exists(flight.getImageFeaturesFile("a.jpg")));
+                const auto mapped = FeatureStore::map(flight.getImageFeaturesFile("a.jpg").string());
+                for (const auto& features : { view, mapped }) {
+                    REQUIRE(features.size() == keypoints.size());
+                    for (size_t i = 0; i < keypoints.size(); ++i) {
+                        REQUIRE(features.x()[i] == keypoints[i].pt.x);
+                        REQUIRE(features.sizes()[i] == keypoints[i].size);
+                        REQUIRE(features.color(i)[1] == colors[i][1]);
+                    }
+                    REQUIRE(cv::norm(features.descriptors(), descriptors, cv::NORM_L1) == 0);
+                }
+            }
+        }
+        boost::filesystem::remove_all(directory);
+    }
+}
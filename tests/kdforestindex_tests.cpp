@@ -0,0 +1,151 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+#include "RobustMatcher.h"
+#include "kdforestindex.h"
+#include <opencv2/core.hpp>
+#include <iostream>
+#include <set>
+#include <utility>
+#include <vector>
+
+using cv::DMatch;
+using cv::Mat;
+using std::cout;
+using std::pair;
+using std::set;
+using std::vector;
+
+namespace
+{
+    // SIFT sized descriptors where every other train descriptor is a noisy copy of a query descriptor
+    void makeDescriptors(int numFeatures, Mat& query, Mat& train)
+    {
+        cv::RNG rng(7);
+        query = Mat(numFeatures, 128, CV_32F);
+        train = Mat(numFeatures, 128, CV_32F);
+        rng.fill(query, cv::RNG::NORMAL, 0, 1);
+        rng.fill(train, cv::RNG::NORMAL, 0, 1);
+        Mat noise(1, 128, CV_32F);
+        for (auto i = 0; i < numFeatures; i += 2) {
+            rng.fill(noise, cv::RNG::NORMAL, 0, 0.3);
+            train.row(i) = query.row(i) + noise;
+        }
+    }
+
+    double recall(const vector<DMatch>& approximate, const vector<DMatch>& exact)
+    {
+        set<pair<int, int>> approximatePairs;
+        for (const auto& match : approximate) {
+            approximatePairs.insert({ match.queryIdx, match.trainIdx });
+        }
+        size_t found = 0;
+        for (const auto& match : exact) {
+            found += approximatePairs.count({ match.queryIdx, match.trainIdx });
+        }
+        return exact.empty() ? 1.0 : static_cast<double>(found) / exact.size();
+    }
+} //namespace
+
+SCENARIO("Matching with kd-forests recovers the brute force matches")
+{
+    GIVEN("float descriptors and the brute force matches between them")
+    {
+        Mat query, train;
+        makeDescriptors(4000, query, train);
+        auto matcher = RobustMatcher::create(RobustMatcher::Feature::sift);
+        vector<DMatch> exact;
+        matcher->robustMatch(query, train, exact);
+        REQUIRE_FALSE(exact.empty());
+
+        WHEN("the descriptors are matched with an increasing comparison budget")
+        {
+            const auto queryIndex = KdForestIndex::build(query, KdForestIndex::DEFAULT_NUM_TREES, 32);
+            const auto trainIndex = KdForestIndex::build(train, KdForestIndex::DEFAULT_NUM_TREES, 32);
+            vector<DMatch> cheap;
+            matcher->forestRobustMatch(*queryIndex, *trainIndex, cheap);
+
+            matcher->setMatchingMode(RobustMatcher::MatchingMode::kdForest);
+            matcher->setMaxComparisons(512);
+            vector<DMatch> thorough;
+            matcher->robustMatch(query, train, thorough);
+
+            THEN("recall improves with the budget and is close to brute force")
+            {
+                cout << "kd-forest recall with 32 comparisons " << recall(cheap, exact)
+                    << ", with 512 comparisons " << recall(thorough, exact) << "\n";
+                REQUIRE(recall(thorough, exact) >= recall(cheap, exact));
+                REQUIRE(recall(thorough, exact) > 0.95);
+            }
+        }
+
+        WHEN("the forest matches are added to a vector that already holds matches")
+        {
+            const auto queryIndex = KdForestIndex::build(query);
+            const auto trainIndex = KdForestIndex::build(train);
+            vector<DMatch> single, accumulated{ DMatch(0, 0, 0.0f) };
+            matcher->forestRobustMatch(*queryIndex, *trainIndex, single);
+            matcher->forestRobustMatch(*queryIndex, *trainIndex, accumulated);
+
+            THEN("the earlier matches are kept")
+            {
+                REQUIRE(accumulated.size() == single.size() + 1);
+                REQUIRE(accumulated[0].distance == 0.0f);
+            }
+        }
+    }
+
+    GIVEN("binary descriptors")
+    {
+        Mat binary(10, 32, CV_8U);
+        THEN("no forest is built for them")
+        {
+            REQUIRE(KdForestIndex::build(binary) == nullptr);
+        }
+    }
+
+    GIVEN("descriptors that do not own their memory")
+    {
+        Mat query, train;
+        makeDescriptors(100, query, train);
+        vector<float> storage(query.ptr<float>(), query.ptr<float>() + query.total());
+        const auto index = KdForestIndex::build(Mat(query.rows, query.cols, CV_32F, storage.data()));
+
+        WHEN("the memory is released")
+        {
+            vector<float>().swap(storage);
+
+            THEN("the forest still searches its own copy")
+            {
+                REQUIRE(index->getDescriptors().data != nullptr);
+                vector<ForestNeighbours> neighbours;
+                index->searchTwoNearest(query.rowRange(0, 10), neighbours);
+                for (auto i = 0; i < 10; ++i) {
+                    REQUIRE(neighbours[i].index == i);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Matching 8000 SIFT descriptors per image", "[!benchmark]")
+{
+    Mat query, train;
+    makeDescriptors(8000, query, train);
+    auto matcher = RobustMatcher::create(RobustMatcher::Feature::sift);
+    const auto queryIndex = KdForestIndex::build(query);
+    const auto trainIndex = KdForestIndex::build(train);
+
+    BENCHMARK("BFMatcher kNN in both directions")
+    {
+        vector<DMatch> matches;
+        matcher->robustMatch(query, train, matches);
+        return matches.size();
+    };
+
+    BENCHMARK("kd-forest with cached indexes")
+    {
+        vector<DMatch> matches;
+        matcher->forestRobustMatch(*queryIndex, *trainIndex, matches);
+        return matches.size();
+    };
+}
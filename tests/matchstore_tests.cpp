@@ -0,0 +1,68 @@
+#include <catch.hpp>
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <vector>
+#include "matchstore.h"
+
+using cv::DMatch;
+using std::vector;
+
+SCENARIO("Writing and reading pairwise matches with the match store")
+{
+    GIVEN("an empty matches directory")
+    {
+        const auto directory = boost::filesystem::temp_directory_path() / "shomagick-test-matches";
+        boost::filesystem::remove_all(directory);
+        boost::filesystem::create_directory(directory);
+
+        WHEN("matches for several pairs are appended")
+        {
+            {
+                MatchStoreWriter writer(directory.string());
+                REQUIRE(writer.append("a.jpg", "b.jpg", { DMatch(1, 2, 0.5f), DMatch(3, 4, 1.5f) }));
+                REQUIRE(writer.append("a.jpg", "c.jpg", vector<DMatch>()));
+                REQUIRE(writer.append("b.jpg", "c.jpg", { DMatch(7, 8, 3.0f) }));
+            }
+            const auto store = MatchStore::open(directory.string());
+
+            THEN("every pair can be streamed or looked up directly")
+            {
+                REQUIRE(store.numPairs() == 3);
+                REQUIRE(store.pairsForQuery("a.jpg").size() == 2);
+                PairMatches matches;
+                REQUIRE(store.find("a.jpg", "b.jpg", matches));
+                REQUIRE(matches.count == 2);
+                REQUIRE(matches.queryIdx[1] == 3);
+                REQUIRE(matches.trainIdx[1] == 4);
+                REQUIRE(matches.distance[1] == 1.5f);
+                REQUIRE_FALSE(store.hasPair("c.jpg", "a.jpg"));
+            }
+        }
+
+        WHEN("a run is interrupted while writing an index entry and the pair is matched again")
+        {
+            {
+                MatchStoreWriter writer(directory.string());
+                REQUIRE(writer.append("a.jpg", "b.jpg", { DMatch(1, 2, 0.5f) }));
+            }
+            {
+                std::ofstream index((directory / MATCH_INDEX_FILE).string(), std::ios::binary | std::ios::app);
+                index << "partial";
+            }
+            {
+                MatchStoreWriter writer(directory.string());
+                REQUIRE(writer.append("a.jpg", "b.jpg", { DMatch(5, 6, 0.25f) }));
+            }
+            const auto store = MatchStore::open(directory.string());
+
+            THEN("the partial entry is dropped and the latest matches win")
+            {
+                REQUIRE(store.numPairs() == 1);
+                const auto matches = store.pair(0).toDMatches();
+                REQUIRE(matches.size() == 1);
+                REQUIRE(matches[0].queryIdx == 5);
+            }
+        }
+        boost::filesystem::remove_all(directory);
+    }
+}
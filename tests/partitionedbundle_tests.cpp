@@ -0,0 +1,78 @@
+#include <catch.hpp>
+#include "bundlesession.h"
+#include "partitionedbundle.h"
+#include "syntheticscene.h"
+#include <opencv2/core.hpp>
+
+using cv::Point3d;
+using syntheticscene::FOCAL;
+
+SCENARIO("Bundling a reconstruction in clusters")
+{
+    GIVEN("twelve shots on a line and points with noisy positions")
+    {
+        Reconstruction rec(syntheticscene::camera());
+        TrackStore tracks;
+        syntheticscene::addShotsOnLine(rec, tracks, 12);
+
+        cv::RNG rng(5);
+        for (auto track = 0; track < 40; ++track) {
+            const Point3d point(rng.uniform(0.0, 11.0), rng.uniform(-3.0, 3.0), rng.uniform(15.0, 20.0));
+            syntheticscene::addPoint(rec, tracks, track, point, 0, 12,
+                point + Point3d(rng.gaussian(0.05), rng.gaussian(0.05), rng.gaussian(0.05)));
+        }
+        tracks.buildIndex();
+
+        WHEN("it is bundled in clusters of four shots and as a whole")
+        {
+            Reconstruction monolithic = rec;
+            BundleSession session(monolithic, tracks, false, true);
+            session.setMaxIterations(100);
+            session.run();
+
+            PartitionedBundle partitioned(rec, tracks, false);
+            partitioned.setMaxClusterShots(4);
+            partitioned.setMaxOuterIterations(30);
+            partitioned.setMaxInnerIterations(20);
+            partitioned.run();
+
+            THEN("the points shared by the clusters agree and the accuracy matches the whole solve")
+            {
+                const auto& report = partitioned.getReport();
+                REQUIRE(report.numClusters >= 3);
+                REQUIRE(report.numSeparators == 40);
+                REQUIRE(report.primalResidual < 1e-3);
+                REQUIRE(report.rmsReprojectionError == Approx(PartitionedBundle::rmsReprojectionError(rec, tracks)));
+                REQUIRE(report.rmsReprojectionError < PartitionedBundle::rmsReprojectionError(monolithic, tracks) + 1e-5);
+                for (const auto& [track, cloudPoint] : rec.getCloudPoints()) {
+                    REQUIRE(cloudPoint.getError().size() == 12);
+                }
+            }
+        }
+
+        WHEN("the camera starts from a wrong focal and is refined in clusters and as a whole")
+        {
+            rec.getCamera().setFocalWithPhysical(FOCAL * 1.02);
+            Reconstruction monolithic = rec;
+            BundleSession session(monolithic, tracks, false, false, 0.1);
+            session.setMaxIterations(100);
+            session.run();
+
+            PartitionedBundle partitioned(rec, tracks, false, false, 0.1);
+            partitioned.setMaxClusterShots(4);
+            partitioned.setMaxOuterIterations(30);
+            partitioned.setMaxInnerIterations(20);
+            partitioned.run();
+
+            THEN("the clusters agree on one camera close to the one of the whole solve")
+            {
+                const auto& report = partitioned.getReport();
+                REQUIRE(report.cameraResidual < 1e-3);
+                REQUIRE(rec.getCamera().getPhysicalFocalLength() != FOCAL * 1.02);
+                REQUIRE(rec.getCamera().getPhysicalFocalLength() ==
+                    Approx(monolithic.getCamera().getPhysicalFocalLength()).margin(5e-3));
+                REQUIRE(report.rmsReprojectionError < PartitionedBundle::rmsReprojectionError(monolithic, tracks) + 1e-4);
+            }
+        }
+    }
+}
@@ -0,0 +1,175 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+#include "bundle/bundle_adjuster.h"
+#include "bundle/src/projection_errors.h"
+#include "bundle/src/analytic_projection_errors.h"
+#include <random>
+#include <vector>
+
+using std::vector;
+
+namespace
+{
+    // Evaluates both cost functions with jacobians and requires them to agree
+    void requireSameEvaluation(const ceres::CostFunction& autoDiff, const ceres::CostFunction& analytic,
+        const vector<vector<double>>& blocks)
+    {
+        const auto numResiduals = autoDiff.num_residuals();
+        REQUIRE(analytic.num_residuals() == numResiduals);
+        REQUIRE(analytic.parameter_block_sizes() == autoDiff.parameter_block_sizes());
+
+        vector<const double*> parameters;
+        vector<vector<double>> autoDiffJacobians, analyticJacobians;
+        vector<double*> autoDiffPointers, analyticPointers;
+        for (const auto& block : blocks) {
+            parameters.push_back(block.data());
+            autoDiffJacobians.emplace_back(numResiduals * block.size());
+            analyticJacobians.emplace_back(numResiduals * block.size());
+        }
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            autoDiffPointers.push_back(autoDiffJacobians[i].data());
+            analyticPointers.push_back(analyticJacobians[i].data());
+        }
+
+        vector<double> autoDiffResiduals(numResiduals), analyticResiduals(numResiduals);
+        REQUIRE(autoDiff.Evaluate(parameters.data(), autoDiffResiduals.data(), autoDiffPointers.data()));
+        REQUIRE(analytic.Evaluate(parameters.data(), analyticResiduals.data(), analyticPointers.data()));
+        for (auto i = 0; i < numResiduals; ++i) {
+            REQUIRE(analyticResiduals[i] == Approx(autoDiffResiduals[i]).margin(1e-12));
+        }
+        for (size_t block = 0; block < blocks.size(); ++block) {
+            for (size_t i = 0; i < autoDiffJacobians[block].size(); ++i) {
+                REQUIRE(analyticJacobians[block][i] == Approx(autoDiffJacobians[block][i]).margin(1e-9));
+            }
+        }
+    }
+
+    // A shot and a point in front of it, with rotations both large and close to zero
+    vector<double> randomShot(std::mt19937& generator, bool smallRotation)
+    {
+        std::uniform_real_distribution<double> rotation(smallRotation ? -1e-9 : -1.0, smallRotation ? 1e-9 : 1.0);
+        std::uniform_real_distribution<double> translation(-1.0, 1.0);
+        return { rotation(generator), rotation(generator), rotation(generator),
+            translation(generator), translation(generator), translation(generator) };
+    }
+
+    vector<double> pointInFront(std::mt19937& generator, const vector<double>& shot)
+    {
+        std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+        const double cameraPoint[3] = { uniform(generator), uniform(generator), 5.0 + uniform(generator) };
+        const double inverseRotation[3] = { -shot[BA_SHOT_RX], -shot[BA_SHOT_RY], -shot[BA_SHOT_RZ] };
+        const double shifted[3] = { cameraPoint[0] - shot[BA_SHOT_TX], cameraPoint[1] - shot[BA_SHOT_TY],
+            cameraPoint[2] - shot[BA_SHOT_TZ] };
+        vector<double> point(3);
+        ceres::AngleAxisRotatePoint(inverseRotation, shifted, point.data());
+        return point;
+    }
+} //namespace
+
+SCENARIO("Analytic reprojection jacobians match automatic differentiation")
+{
+    GIVEN("random shots and points in front of them")
+    {
+        std::mt19937 generator(11);
+        vector<vector<double>> shots, points;
+        for (auto i = 0; i < 20; ++i) {
+            shots.push_back(randomShot(generator, i % 4 == 0));
+            points.push_back(pointInFront(generator, shots.back()));
+        }
+
+        THEN("the perspective error agrees")
+        {
+            const vector<double> camera{ 0.9, -0.1, 0.05 };
+            ceres::AutoDiffCostFunction<PerspectiveReprojectionError, 2, 3, 6, 3> autoDiff(
+                new PerspectiveReprojectionError(0.01, -0.02, 0.5));
+            AnalyticReprojectionError<PerspectiveCameraModel> analytic(0.01, -0.02, 0.5);
+            for (size_t i = 0; i < shots.size(); ++i) {
+                requireSameEvaluation(autoDiff, analytic, { camera, shots[i], points[i] });
+            }
+        }
+
+        THEN("the Brown error agrees")
+        {
+            const vector<double> camera{ 0.9, 0.92, 0.01, -0.02, -0.1, 0.05, 0.001, -0.002, 0.01 };
+            ceres::AutoDiffCostFunction<BrownPerspectiveReprojectionError, 2, 9, 6, 3> autoDiff(
+                new BrownPerspectiveReprojectionError(0.01, -0.02, 0.5));
+            AnalyticReprojectionError<BrownPerspectiveCameraModel> analytic(0.01, -0.02, 0.5);
+            for (size_t i = 0; i < shots.size(); ++i) {
+                requireSameEvaluation(autoDiff, analytic, { camera, shots[i], points[i] });
+            }
+        }
+
+        THEN("the fisheye error agrees")
+        {
+            const vector<double> camera{ 0.9, -0.1, 0.05 };
+            ceres::AutoDiffCostFunction<FisheyeReprojectionError, 2, 3, 6, 3> autoDiff(
+                new FisheyeReprojectionError(0.01, -0.02, 0.5));
+            AnalyticReprojectionError<FisheyeCameraModel> analytic(0.01, -0.02, 0.5);
+            for (size_t i = 0; i < shots.size(); ++i) {
+                requireSameEvaluation(autoDiff, analytic, { camera, shots[i], points[i] });
+            }
+        }
+
+        THEN("the equirectangular error agrees")
+        {
+            ceres::AutoDiffCostFunction<EquirectangularReprojectionError, 3, 6, 3> autoDiff(
+                new EquirectangularReprojectionError(0.01, -0.02, 0.5));
+            AnalyticEquirectangularReprojectionError analytic(0.01, -0.02, 0.5);
+            for (size_t i = 0; i < shots.size(); ++i) {
+                requireSameEvaluation(autoDiff, analytic, { shots[i], points[i] });
+            }
+        }
+    }
+}
+
+TEST_CASE("Evaluating the jacobian of a 1000 shot problem", "[!benchmark]")
+{
+    const auto numShots = 1000;
+    const auto numPoints = 20000;
+    const auto observationsPerPoint = 5;
+    std::mt19937 generator(3);
+    std::uniform_int_distribution<int> anyShot(0, numShots - 1);
+    double camera[BA_CAMERA_NUM_PARAMS] = { 0.9, -0.1, 0.05 };
+    vector<vector<double>> shots, points;
+    //The problems keep pointers into the points
+    points.reserve(numPoints);
+    for (auto i = 0; i < numShots; ++i) {
+        shots.push_back(randomShot(generator, false));
+    }
+
+    ceres::Problem::Options options;
+    options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    ceres::Problem autoDiffProblem(options), analyticProblem(options);
+    ceres::CauchyLoss loss(1.0);
+    for (auto i = 0; i < numPoints; ++i) {
+        const auto first = anyShot(generator);
+        points.push_back(pointInFront(generator, shots[first]));
+        for (auto j = 0; j < observationsPerPoint; ++j) {
+            auto& shot = shots[(first + j * 7) % numShots];
+            auto& point = points.back();
+            autoDiffProblem.AddResidualBlock(
+                new ceres::AutoDiffCostFunction<PerspectiveReprojectionError, 2, 3, 6, 3>(
+                    new PerspectiveReprojectionError(0.01, -0.02, 1.0)),
+                &loss, camera, shot.data(), point.data());
+            analyticProblem.AddResidualBlock(
+                new AnalyticReprojectionError<PerspectiveCameraModel>(0.01, -0.02, 1.0),
+                &loss, camera, shot.data(), point.data());
+        }
+    }
+
+    BENCHMARK("Autodiff residuals and jacobian")
+    {
+        double cost;
+        ceres::CRSMatrix jacobian;
+        autoDiffProblem.Evaluate(ceres::Problem::EvaluateOptions(), &cost, nullptr, nullptr, &jacobian);
+        return cost;
+    };
+
+    BENCHMARK("Analytic residuals and jacobian")
+    {
+        double cost;
+        ceres::CRSMatrix jacobian;
+        analyticProblem.Evaluate(ceres::Problem::EvaluateOptions(), &cost, nullptr, nullptr, &jacobian);
+        return cost;
+    };
+}
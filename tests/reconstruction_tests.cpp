@@ -0,0 +1,91 @@
+#include <catch.hpp>
+#include "reconstruction.h"
+#include "trackstore.h"
+#include "utilities.h"
+#include <algorithm>
+#include <opencv2/core.hpp>
+
+using cv::Point2f;
+using cv::Scalar;
+
+SCENARIO("Counting the reconstructed tracks seen by every image")
+{
+    GIVEN("three tracks over three images and a reconstruction following the store")
+    {
+        TrackStore tracks;
+        tracks.addImage("0.jpg");
+        tracks.addImage("1.jpg");
+        tracks.addImage("2.jpg");
+        tracks.addObservation(0, 0, 0, Point2f(), 1.0f, Scalar());
+        tracks.addObservation(0, 1, 0, Point2f(), 1.0f, Scalar());
+        tracks.addObservation(1, 0, 1, Point2f(), 1.0f, Scalar());
+        tracks.addObservation(1, 2, 0, Point2f(), 1.0f, Scalar());
+        tracks.addObservation(2, 1, 1, Point2f(), 1.0f, Scalar());
+        tracks.addObservation(2, 2, 1, Point2f(), 1.0f, Scalar());
+        tracks.buildIndex();
+
+        Reconstruction rec(getPerspectiveCamera(0.9, 3000, 4000, 0.0, 0.0));
+        CloudPoint point;
+        point.setId(0);
+        rec.addCloudPoint(point);
+        rec.setTrackStore(tracks);
+
+        THEN("the points already in the reconstruction are counted")
+        {
+            REQUIRE(rec.reconstructedTrackCount(0) == 1);
+            REQUIRE(rec.reconstructedTrackCount(1) == 1);
+            REQUIRE(rec.reconstructedTrackCount(2) == 0);
+        }
+
+        WHEN("points are added, one of them twice")
+        {
+            rec.takeChangedImages();
+            point.setId(1);
+            rec.addCloudPoint(point);
+            rec.addCloudPoint(point);
+
+            THEN("the images of the new track count it once and are reported as changed")
+            {
+                REQUIRE(rec.reconstructedTrackCount(0) == 2);
+                REQUIRE(rec.reconstructedTrackCount(2) == 1);
+                auto changed = rec.takeChangedImages();
+                std::sort(changed.begin(), changed.end());
+                REQUIRE(changed == std::vector<int>{ 0, 2 });
+                REQUIRE(rec.takeChangedImages().empty());
+            }
+        }
+
+        WHEN("an observation and then a point are removed")
+        {
+            point.setId(2);
+            rec.addCloudPoint(point);
+            rec.removeObservation(2, 2);
+            tracks.removeObservation(static_cast<uint32_t>(tracks.findObservation(2, 2)));
+            rec.removeCloudPoint(0);
+
+            THEN("only the alive observations of reconstructed tracks are counted")
+            {
+                REQUIRE(rec.reconstructedTrackCount(0) == 0);
+                REQUIRE(rec.reconstructedTrackCount(1) == 1);
+                REQUIRE(rec.reconstructedTrackCount(2) == 0);
+                REQUIRE_FALSE(rec.hasTrack(0));
+            }
+        }
+    }
+}
+
+SCENARIO("Adding shots to the camera table of a reconstruction")
+{
+    GIVEN("a reconstruction created with one camera")
+    {
+        Reconstruction rec(getPerspectiveCamera(0.9, 3000, 4000, 0.0, 0.0));
+
+        THEN("shots of that camera are added and shots of an unknown camera are refused")
+        {
+            rec.addShot("0.jpg", Shot("0.jpg", DEFAULT_CAMERA_ID, Pose()));
+            REQUIRE(rec.hasShot("0.jpg"));
+            REQUIRE_THROWS_AS(rec.addShot("1.jpg", Shot("1.jpg", DEFAULT_CAMERA_ID + 1, Pose())), cv::Exception);
+            REQUIRE_FALSE(rec.hasShot("1.jpg"));
+        }
+    }
+}
@@ -0,0 +1,132 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+#include "RobustMatcher.h"
+#include "simdmatcher.h"
+#include <opencv2/core.hpp>
+#include <vector>
+
+using cv::DMatch;
+using cv::Mat;
+using std::vector;
+
+namespace
+{
+    // Train descriptors where every third one is a slightly perturbed copy of a query descriptor
+    void makeDescriptors(int type, int numQuery, int numTrain, int cols, Mat& query, Mat& train)
+    {
+        cv::RNG rng(42);
+        query = Mat(numQuery, cols, type);
+        train = Mat(numTrain, cols, type);
+        if (type == CV_8U) {
+            rng.fill(query, cv::RNG::UNIFORM, 0, 256);
+            rng.fill(train, cv::RNG::UNIFORM, 0, 256);
+        }
+        else {
+            rng.fill(query, cv::RNG::NORMAL, 0, 1);
+            rng.fill(train, cv::RNG::NORMAL, 0, 1);
+        }
+        for (auto i = 0; i < std::min(numQuery, numTrain); i += 3) {
+            query.row(i).copyTo(train.row(i));
+            if (type == CV_8U)
+                train.at<uchar>(i, 0) ^= 1;
+            else
+                train.at<float>(i, 0) += 0.05f;
+        }
+    }
+
+    void requireSameMatches(const vector<DMatch>& simd, const vector<DMatch>& bruteForce)
+    {
+        REQUIRE(simd.size() == bruteForce.size());
+        for (size_t i = 0; i < simd.size(); ++i) {
+            REQUIRE(simd[i].queryIdx == bruteForce[i].queryIdx);
+            REQUIRE(simd[i].trainIdx == bruteForce[i].trainIdx);
+            REQUIRE(simd[i].distance == Approx(bruteForce[i].distance).epsilon(1e-4));
+        }
+    }
+} //namespace
+
+SCENARIO("The single pass matcher returns the same matches as the BFMatcher path")
+{
+    GIVEN("a robust matcher and binary descriptors")
+    {
+        auto matcher = RobustMatcher::create(RobustMatcher::Feature::orb);
+        Mat query, train;
+        makeDescriptors(CV_8U, 600, 700, 32, query, train);
+
+        WHEN("the descriptors are matched with both modes")
+        {
+            vector<DMatch> bruteForce, simd;
+            matcher->setMatchingMode(RobustMatcher::MatchingMode::bruteForce);
+            matcher->robustMatch(query, train, bruteForce);
+            matcher->setMatchingMode(RobustMatcher::MatchingMode::simd);
+            matcher->robustMatch(query, train, simd);
+
+            THEN("the matches are identical")
+            {
+                REQUIRE_FALSE(simd.empty());
+                requireSameMatches(simd, bruteForce);
+            }
+        }
+
+        WHEN("two pairs are matched into the same vector with both modes")
+        {
+            vector<DMatch> bruteForce, simd;
+            matcher->setMatchingMode(RobustMatcher::MatchingMode::bruteForce);
+            matcher->robustMatch(query, train, bruteForce);
+            matcher->robustMatch(train, query, bruteForce);
+            matcher->setMatchingMode(RobustMatcher::MatchingMode::simd);
+            matcher->robustMatch(query, train, simd);
+            matcher->robustMatch(train, query, simd);
+
+            THEN("the matches of the first pair are kept")
+            {
+                requireSameMatches(simd, bruteForce);
+            }
+        }
+    }
+
+    GIVEN("a robust matcher and float descriptors")
+    {
+        auto matcher = RobustMatcher::create(RobustMatcher::Feature::sift);
+        Mat query, train;
+        makeDescriptors(CV_32F, 500, 450, 128, query, train);
+
+        WHEN("the descriptors are matched with both modes")
+        {
+            vector<DMatch> bruteForce, simd;
+            matcher->setMatchingMode(RobustMatcher::MatchingMode::bruteForce);
+            matcher->robustMatch(query, train, bruteForce);
+            matcher->setMatchingMode(RobustMatcher::MatchingMode::simd);
+            matcher->robustMatch(query, train, simd);
+
+            THEN("the matches are identical")
+            {
+                REQUIRE_FALSE(simd.empty());
+                requireSameMatches(simd, bruteForce);
+            }
+        }
+    }
+}
+
+TEST_CASE("Matching 8000 ORB descriptors per image", "[!benchmark]")
+{
+    auto matcher = RobustMatcher::create(RobustMatcher::Feature::orb);
+    Mat query, train;
+    makeDescriptors(CV_8U, 8000, 8000, 32, query, train);
+
+    BENCHMARK("BFMatcher kNN in both directions")
+    {
+        vector<DMatch> matches;
+        matcher->setMatchingMode(RobustMatcher::MatchingMode::bruteForce);
+        matcher->robustMatch(query, train, matches);
+        return matches.size();
+    };
+
+    BENCHMARK("Single pass SIMD kernel")
+    {
+        vector<DMatch> matches;
+        matcher->setMatchingMode(RobustMatcher::MatchingMode::simd);
+        matcher->robustMatch(query, train, matches);
+        return matches.size();
+    };
+}
@@ -0,0 +1,103 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+#include "spatialindex.h"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using cv::Point3d;
+using std::vector;
+
+namespace
+{
+    // Camera positions of a survey flight over a 5km square, in metres
+    vector<Point3d> makePositions(int numImages)
+    {
+        cv::RNG rng(3);
+        vector<Point3d> positions;
+        for (auto i = 0; i < numImages; ++i) {
+            positions.emplace_back(rng.uniform(0.0, 5000.0), rng.uniform(0.0, 5000.0), rng.uniform(90.0, 110.0));
+        }
+        return positions;
+    }
+
+    double distance(const Point3d& a, const Point3d& b)
+    {
+        return cv::norm(a - b);
+    }
+} //namespace
+
+SCENARIO("Finding the images taken near each other")
+{
+    GIVEN("a spatial index over many camera positions")
+    {
+        const auto positions = makePositions(5000);
+        const SpatialIndex index(positions);
+        REQUIRE(index.size() == positions.size());
+
+        WHEN("every position is queried by radius in one batch")
+        {
+            const auto results = index.radius(positions, 60.0);
+
+            THEN("the same images as an exhaustive search are found")
+            {
+                for (size_t i = 0; i < positions.size(); i += 50) {
+                    vector<int> expected;
+                    for (size_t j = 0; j < positions.size(); ++j) {
+                        if (distance(positions[i], positions[j]) <= 60.0)
+                            expected.push_back(static_cast<int>(j));
+                    }
+                    auto found = results[i];
+                    std::sort(found.begin(), found.end());
+                    REQUIRE(found == expected);
+                }
+            }
+        }
+
+        WHEN("every position is queried for its nearest neighbours within a distance")
+        {
+            const auto results = index.nearest(positions, 8, 100.0);
+
+            THEN("the closest images are returned closest first")
+            {
+                for (size_t i = 0; i < positions.size(); i += 50) {
+                    vector<double> distances;
+                    for (const auto& position : positions) {
+                        distances.push_back(distance(positions[i], position));
+                    }
+                    std::sort(distances.begin(), distances.end());
+                    const auto expected = std::count_if(distances.begin(), distances.begin() + 8,
+                        [](double d) { return d <= 100.0; });
+
+                    REQUIRE(static_cast<long>(results[i].size()) == expected);
+                    REQUIRE(results[i].front().first == static_cast<int>(i));
+                    for (size_t n = 0; n < results[i].size(); ++n) {
+                        REQUIRE(results[i][n].second == Approx(distances[n]));
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("an empty index")
+    {
+        const SpatialIndex index;
+        THEN("queries return nothing")
+        {
+            REQUIRE(index.radius(Point3d(0, 0, 0), 10.0).empty());
+            REQUIRE(index.nearest(Point3d(0, 0, 0), 3).empty());
+        }
+    }
+}
+
+TEST_CASE("Candidate pairs of 50000 images", "[!benchmark]")
+{
+    const auto positions = makePositions(50000);
+
+    BENCHMARK("build and query every image by radius")
+    {
+        const SpatialIndex index(positions);
+        return index.radius(positions, 30.0).size();
+    };
+}
@@ -0,0 +1,110 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include <catch.hpp>
+#include "trackbuilder.h"
+#include <numeric>
+#include <set>
+#include <vector>
+
+using std::set;
+using std::vector;
+
+namespace
+{
+    vector<int> trackImages(const TrackBuilder& builder, size_t track)
+    {
+        vector<int> images;
+        for (auto feature = builder.trackBegin(track); feature != builder.trackEnd(track); ++feature) {
+            images.push_back(builder.imageOf(*feature));
+        }
+        return images;
+    }
+} //namespace
+
+SCENARIO("Building tracks from pairwise matches")
+{
+    GIVEN("three images with 4, 5 and 6 features")
+    {
+        TrackBuilder builder({ 4, 5, 6 });
+        REQUIRE(builder.numFeatures() == 15);
+        REQUIRE(builder.featureId(1, 2) == 6);
+        REQUIRE(builder.imageOf(6) == 1);
+        REQUIRE(builder.featureIndexOf(6) == 2);
+        REQUIRE(builder.imageOf(14) == 2);
+
+        WHEN("a feature is matched across all three images and another across two")
+        {
+            const vector<int32_t> query01{ 0, 3 }, train01{ 1, 4 };
+            const vector<int32_t> query12{ 1 }, train12{ 5 };
+            builder.addMatches(0, 1, query01.data(), train01.data(), query01.size());
+            builder.addMatches(1, 2, query12.data(), train12.data(), query12.size());
+            builder.buildTracks(2);
+
+            THEN("there is one track of length three and one of length two")
+            {
+                REQUIRE(builder.numTracks() == 2);
+                set<size_t> sizes{ builder.trackSize(0), builder.trackSize(1) };
+                REQUIRE(sizes == set<size_t>{ 2, 3 });
+                for (size_t track = 0; track < builder.numTracks(); ++track) {
+                    const auto images = trackImages(builder, track);
+                    REQUIRE(std::is_sorted(images.begin(), images.end()));
+                }
+            }
+
+            THEN("a longer minimum length keeps only the long track")
+            {
+                builder.buildTracks(3);
+                REQUIRE(builder.numTracks() == 1);
+                REQUIRE(trackImages(builder, 0) == vector<int>{ 0, 1, 2 });
+            }
+        }
+
+        WHEN("matches join two features of the same image")
+        {
+            const vector<int32_t> query01{ 0, 1 }, train01{ 0, 0 };
+            builder.addMatches(0, 1, query01.data(), train01.data(), query01.size());
+            builder.buildTracks(2);
+
+            THEN("the inconsistent track is dropped")
+            {
+                REQUIRE(builder.numTracks() == 0);
+            }
+        }
+
+        WHEN("matches point outside of the features of their images")
+        {
+            const vector<int32_t> negative{ 0, -1 }, valid{ 0, 1 }, tooLarge{ 0, 5 };
+
+            THEN("they are rejected and nothing is merged")
+            {
+                REQUIRE_FALSE(builder.validMatches(0, 1, negative.data(), valid.data(), 2));
+                REQUIRE_FALSE(builder.addMatches(0, 1, negative.data(), valid.data(), 2));
+                REQUIRE_FALSE(builder.addMatches(1, 0, tooLarge.data(), valid.data(), 2));
+                REQUIRE_FALSE(builder.addMatches(0, 3, valid.data(), valid.data(), 2));
+                REQUIRE(builder.addMatches(0, 1, valid.data(), valid.data(), 2));
+                builder.buildTracks(2);
+                REQUIRE(builder.numTracks() == 2);
+            }
+        }
+    }
+}
+
+TEST_CASE("Tracking 200 images of 8000 features", "[!benchmark]")
+{
+    const auto numImages = 200;
+    const auto numFeatures = 8000;
+    vector<int32_t> identity(numFeatures);
+    std::iota(identity.begin(), identity.end(), 0);
+
+    BENCHMARK("merge the matches of 20 neighbours per image and build the tracks")
+    {
+        TrackBuilder builder(vector<size_t>(numImages, numFeatures));
+#pragma omp parallel for schedule(dynamic)
+        for (auto image = 0; image < numImages; ++image) {
+            for (auto other = image + 1; other < std::min(numImages, image + 21); ++other) {
+                builder.addMatches(image, other, identity.data(), identity.data(), numFeatures / 2);
+            }
+        }
+        builder.buildTracks();
+        return builder.numTracks();
+    };
+}
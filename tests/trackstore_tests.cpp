@@ -0,0 +1,207 @@
+#include <catch.hpp>
+#include "trackstore.h"
+#include "shotracking.h"
+#include "flightsession.h"
+#include "matchstore.h"
+#include <boost/filesystem.hpp>
+#include <opencv2/core.hpp>
+#include <vector>
+
+using cv::DMatch;
+using cv::KeyPoint;
+using cv::Mat;
+using cv::Point2f;
+using cv::Scalar;
+using std::vector;
+
+namespace
+{
+    // Three images and three tracks: track 0 is seen by every image, track 1 by images 0 and 2
+    // and track 2 by images 1 and 2
+    TrackStore makeStore()
+    {
+        TrackStore tracks;
+        const auto a = tracks.addImage("a.jpg");
+        const auto b = tracks.addImage("b.jpg");
+        const auto c = tracks.addImage("c.jpg");
+        tracks.addObservation(0, a, 10, Point2f(0.1f, 0.2f), 1.0f, Scalar(255, 0, 0));
+        tracks.addObservation(0, b, 11, Point2f(0.3f, 0.4f), 2.0f, Scalar(0, 255, 0));
+        tracks.addObservation(0, c, 12, Point2f(0.5f, 0.6f), 3.0f, Scalar(0, 0, 255));
+        tracks.addObservation(1, a, 20, Point2f(-0.1f, 0.1f), 1.0f, Scalar(1, 2, 3));
+        tracks.addObservation(1, c, 21, Point2f(-0.2f, 0.2f), 1.0f, Scalar(4, 5, 6));
+        tracks.addObservation(2, b, 30, Point2f(0.0f, 0.0f), 1.0f, Scalar(7, 8, 9));
+        tracks.addObservation(2, c, 31, Point2f(0.7f, 0.7f), 1.0f, Scalar(10, 11, 12));
+        tracks.buildIndex();
+        return tracks;
+    }
+
+    vector<int> imageTracks(const TrackStore& tracks, int image)
+    {
+        vector<int> result;
+        for (auto observation = tracks.imageBegin(image); observation != tracks.imageEnd(image); ++observation) {
+            if (tracks.isAlive(*observation))
+                result.push_back(tracks.track(*observation));
+        }
+        return result;
+    }
+} //namespace
+
+SCENARIO("Storing the observations of tracks")
+{
+    GIVEN("a store with three images and three tracks")
+    {
+        auto tracks = makeStore();
+        REQUIRE(tracks.numImages() == 3);
+        REQUIRE(tracks.numTracks() == 3);
+        REQUIRE(tracks.numObservations() == 7);
+        REQUIRE(tracks.imageId("b.jpg") == 1);
+        REQUIRE(tracks.imageId("missing.jpg") == -1);
+        REQUIRE(tracks.addImage("b.jpg") == 1);
+
+        THEN("the observations of an image are reached in track order")
+        {
+            REQUIRE(imageTracks(tracks, 0) == vector<int>{ 0, 1 });
+            REQUIRE(imageTracks(tracks, 1) == vector<int>{ 0, 2 });
+            REQUIRE(imageTracks(tracks, 2) == vector<int>{ 0, 1, 2 });
+        }
+
+        THEN("an observation keeps its feature, coordinates, scale and color")
+        {
+            const auto observation = tracks.findObservation(0, 1);
+            REQUIRE(observation >= 0);
+            REQUIRE(tracks.feature(observation) == 11);
+            REQUIRE(tracks.point(observation).x == Approx(0.3));
+            REQUIRE(tracks.point(observation).y == Approx(0.4));
+            REQUIRE(tracks.scale(observation) == 2.0);
+            REQUIRE(tracks.color(observation) == Scalar(0, 255, 0));
+            REQUIRE(tracks.findObservation(1, 1) == -1);
+            REQUIRE(tracks.imageBegin(-1) == tracks.imageEnd(-1));
+        }
+
+        THEN("colors out of the byte range are saturated")
+        {
+            TrackStore saturated;
+            saturated.addImage("a.jpg");
+            saturated.addObservation(0, 0, 0, Point2f(), 1.0f, Scalar(-20, 300, 127.6));
+            saturated.buildIndex();
+            REQUIRE(saturated.color(0) == Scalar(0, 255, 128));
+        }
+
+        WHEN("an outlier observation is removed")
+        {
+            tracks.removeObservation(tracks.findObservation(0, 2));
+
+            THEN("it is skipped but the other observations stay")
+            {
+                REQUIRE(tracks.trackDegree(0) == 2);
+                REQUIRE(tracks.findObservation(0, 2) == -1);
+                REQUIRE(imageTracks(tracks, 2) == vector<int>{ 1, 2 });
+                REQUIRE(imageTracks(tracks, 0) == vector<int>{ 0, 1 });
+            }
+        }
+
+        WHEN("a track is removed")
+        {
+            tracks.removeTrack(1);
+
+            THEN("none of its observations are left")
+            {
+                REQUIRE(tracks.trackDegree(1) == 0);
+                REQUIRE(imageTracks(tracks, 0) == vector<int>{ 0 });
+                REQUIRE(imageTracks(tracks, 2) == vector<int>{ 0, 2 });
+                REQUIRE(tracks.trackDegree(0) == 3);
+            }
+        }
+    }
+}
+
+SCENARIO("Counting the tracks shared by pairs of images")
+{
+    GIVEN("a store with three images and three tracks")
+    {
+        auto tracks = makeStore();
+
+        WHEN("the shared tracks are counted")
+        {
+            const auto counts = ShoTracker::countCommonTracks(tracks);
+
+            THEN("every pair is counted once, most shared tracks first")
+            {
+                REQUIRE(counts.size() == 3);
+                REQUIRE(counts[0].image1 == 0);
+                REQUIRE(counts[0].image2 == 2);
+                REQUIRE(counts[0].numTracks == 2);
+                REQUIRE(counts[1].image1 == 1);
+                REQUIRE(counts[1].image2 == 2);
+                REQUIRE(counts[1].numTracks == 2);
+                REQUIRE(counts[2].image1 == 0);
+                REQUIRE(counts[2].image2 == 1);
+                REQUIRE(counts[2].numTracks == 1);
+            }
+        }
+
+        WHEN("the track lists of the best two pairs are built")
+        {
+            const auto commonTracks = ShoTracker::commonTracks(tracks, 2);
+
+            THEN("only those pairs are returned with their shared tracks")
+            {
+                REQUIRE(commonTracks.size() == 2);
+                REQUIRE(commonTracks[0].imagePair == std::make_pair(std::string("a.jpg"), std::string("c.jpg")));
+                REQUIRE(commonTracks[0].commonTracks == vector<int>{ 0, 1 });
+                REQUIRE(commonTracks[1].imagePair == std::make_pair(std::string("b.jpg"), std::string("c.jpg")));
+                REQUIRE(commonTracks[1].commonTracks == vector<int>{ 0, 2 });
+            }
+        }
+
+        WHEN("an observation is removed")
+        {
+            tracks.removeObservation(tracks.findObservation(0, 2));
+            const auto commonTracks = ShoTracker::commonTracks(tracks);
+
+            THEN("its track is no longer shared with that image")
+            {
+                REQUIRE(commonTracks.size() == 3);
+                for (const auto& track : commonTracks) {
+                    REQUIRE(track.commonTracks.size() == 1);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Building tracks from a match store with a corrupt pair")
+{
+    GIVEN("a flight with three images of three features and the matches of three pairs, one out of range")
+    {
+        const auto directory = boost::filesystem::temp_directory_path() / "shomagick-test-flight";
+        boost::filesystem::remove_all(directory);
+        boost::filesystem::create_directories(directory / "images");
+        FlightSession flight(directory.string());
+
+        const vector<KeyPoint> keypoints{ KeyPoint(1, 1, 2), KeyPoint(2, 2, 2), KeyPoint(3, 3, 2) };
+        const vector<Scalar> colors(3, Scalar(0, 0, 0));
+        for (const auto imageName : { "a.jpg", "b.jpg", "c.jpg" }) {
+            REQUIRE(flight.saveImageFeaturesFile(imageName, keypoints, Mat::zeros(3, 128, CV_32F), colors));
+        }
+        {
+            MatchStoreWriter writer(flight.getImageMatchesPath().string());
+            REQUIRE(writer.append("a.jpg", "b.jpg", { DMatch(0, 0, 0.5f), DMatch(1, 1, 0.5f) }));
+            REQUIRE(writer.append("a.jpg", "c.jpg", { DMatch(2, 7, 0.5f) }));
+            REQUIRE(writer.append("b.jpg", "c.jpg", { DMatch(2, 2, 0.5f) }));
+        }
+        ShoTracker tracker(flight, { { "a.jpg", { "b.jpg", "c.jpg" } }, { "b.jpg", { "c.jpg" } } });
+
+        WHEN("the feature nodes and the tracks are built")
+        {
+            REQUIRE_NOTHROW(tracker.createFeatureNodes());
+            tracker.createTracks();
+
+            THEN("the corrupt pair is skipped and the others are merged")
+            {
+                REQUIRE(tracker.getTrackBuilder().numTracks() == 3);
+            }
+        }
+        boost::filesystem::remove_all(directory);
+    }
+}
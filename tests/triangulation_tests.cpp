@@ -50,3 +50,50 @@ SCENARIO("Triangulating bearings for two generated shots")
         }
     }
 }
+
+SCENARIO("Triangulating many points in one batch")
+{
+    GIVEN("rays from three shots towards a grid of points, one point seen by a single shot")
+    {
+        const vector<Vector3d> shotOrigins{ { 0.0, 0, 0 }, { 1.0, 0, 0 }, { 0.0, 1, 0 } };
+        vector<Vector3d> expected, os, bs;
+        vector<uint32_t> offsets{ 0 };
+        for (auto x = -2; x <= 2; ++x) {
+            for (auto y = -2; y <= 2; ++y) {
+                const Vector3d point{ double(x), double(y), 10.0 };
+                expected.push_back(point);
+                for (const auto& origin : shotOrigins) {
+                    os.push_back(origin);
+                    bs.push_back(unitVector(point - origin));
+                }
+                offsets.push_back(static_cast<uint32_t>(os.size()));
+            }
+        }
+        os.push_back(shotOrigins[0]);
+        bs.push_back(unitVector({ 0.0, 0, 1 }));
+        offsets.push_back(static_cast<uint32_t>(os.size()));
+
+        WHEN("the points are triangulated together")
+        {
+            vector<Vector3d> results;
+            vector<uint8_t> triangulated;
+            csfm::TriangulateBearingsMidpointBatch(os, bs, offsets, results, triangulated);
+
+            THEN("every point seen by several shots is recovered like a single triangulation")
+            {
+                REQUIRE(results.size() == expected.size() + 1);
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    REQUIRE(triangulated[i]);
+                    REQUIRE(allClose(expected[i], results[i]));
+
+                    Vector3d single;
+                    const vector<Vector3d> oList(os.begin() + offsets[i], os.begin() + offsets[i + 1]);
+                    const vector<Vector3d> bList(bs.begin() + offsets[i], bs.begin() + offsets[i + 1]);
+                    REQUIRE(csfm::TriangulateBearingsMidpoint(oList, bList, single));
+                    REQUIRE(allClose(single, results[i]));
+                }
+                REQUIRE_FALSE(triangulated.back());
+            }
+        }
+    }
+}
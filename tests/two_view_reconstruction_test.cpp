@@ -2,12 +2,12 @@
 #include <iostream>
 #include <utility>
 #include <vector>
-#include "../src/flightsession.h"
-#include "../src/shotracking.h"
+#include "flightsession.h"
+#include "shotracking.h"
 #include <boost/filesystem.hpp>
-#include "../src/shomatcher.hpp"
-#include "../src/reconstructor.h"
-#include "../src/utilities.h"
+#include "shomatcher.hpp"
+#include "reconstructor.h"
+#include "utilities.h"
 
 using std::vector;
 using std::string;
@@ -30,24 +30,20 @@ SCENARIO("Testing the two view reconstruction between two images")
     shoMatcher.extractFeatures();
     shoMatcher.runRobustFeatureMatching();
     ShoTracker tracker(flight, shoMatcher.getCandidateImages());
-    vector<pair<ImageFeatureNode, ImageFeatureNode>> featureNodes;
-    vector<FeatureProperty> featureProps;
-    tracker.createFeatureNodes(featureNodes, featureProps);
-    tracker.createTracks(featureNodes);
-    auto tracksGraph = tracker.buildTracksGraph(featureProps);
-    std::cerr << "Created tracks graph " << endl;
-    std::cerr << "Number of vertices is " << tracksGraph.m_vertices.size() << endl;
-    std::cerr << "Number of edges is " << tracksGraph.m_edges.size() << endl;
-    auto commonTracks = tracker.commonTracks(tracksGraph);
-    Reconstructor reconstructor(flight, tracksGraph, tracker.getTrackNodes(), tracker.getImageNodes());
+    tracker.createFeatureNodes();
+    tracker.createTracks();
+    auto trackStore = tracker.buildTrackStore();
+    std::cerr << "Created track store " << endl;
+    std::cerr << "Number of tracks is " << trackStore.numTracks() << endl;
+    std::cerr << "Number of observations is " << trackStore.numObservations() << endl;
+    auto commonTracks = tracker.commonTracks(trackStore);
+    Reconstructor reconstructor(flight, trackStore);
 
     string image1 = "02.jpg";
     string image2 = "03.jpg";
 
-    auto imageNodes = tracker.getImageNodes();
-
-    auto im1 = imageNodes[image1];
-    auto im2 = imageNodes[image2];
+    auto im1 = trackStore.imageId(image1);
+    auto im2 = trackStore.imageId(image2);
 
     TwoViewPose t;
     cv::Mat mask;
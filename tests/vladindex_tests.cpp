@@ -0,0 +1,91 @@
+#include <catch.hpp>
+#include "vladindex.h"
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+using cv::Mat;
+using std::string;
+using std::vector;
+
+namespace
+{
+    // Descriptors of an image of a scene: noisy copies of the scene's landmarks
+    Mat makeImageDescriptors(const Mat& landmarks, cv::RNG& rng)
+    {
+        Mat descriptors = landmarks.clone();
+        Mat noise(landmarks.size(), CV_32F);
+        rng.fill(noise, cv::RNG::NORMAL, 0, 0.1);
+        return descriptors + noise;
+    }
+} //namespace
+
+SCENARIO("Retrieving the images of the same scene with VLAD vectors")
+{
+    GIVEN("two images of each of three scenes")
+    {
+        cv::RNG rng(11);
+        vector<Mat> scenes;
+        for (auto i = 0; i < 3; ++i) {
+            Mat landmarks(200, 32, CV_32F);
+            rng.fill(landmarks, cv::RNG::NORMAL, 0, 1);
+            scenes.push_back(landmarks);
+        }
+
+        VladIndex index(16);
+        Mat samples;
+        vector<Mat> images;
+        for (auto i = 0; i < 6; ++i) {
+            images.push_back(makeImageDescriptors(scenes[i % 3], rng));
+            samples.push_back(images.back());
+        }
+        index.train(samples);
+        for (auto i = 0; i < 6; ++i) {
+            index.add("image" + std::to_string(i), images[i]);
+        }
+
+        WHEN("every image is queried for its best match")
+        {
+            THEN("the other image of the same scene is returned first")
+            {
+                for (auto i = 0; i < 6; ++i) {
+                    const auto results = index.query(i, 2);
+                    REQUIRE(results.size() == 2);
+                    REQUIRE(results[0].first % 3 == i % 3);
+                    REQUIRE(results[0].second > results[1].second);
+                }
+            }
+        }
+
+        WHEN("all the images are queried at once")
+        {
+            const auto allResults = index.queryAll(3);
+
+            THEN("every image gets the results of its own query")
+            {
+                REQUIRE(allResults.size() == 6);
+                for (auto i = 0; i < 6; ++i) {
+                    const auto results = index.query(i, 3);
+                    REQUIRE(allResults[i].size() == results.size());
+                    for (size_t j = 0; j < results.size(); ++j) {
+                        REQUIRE(allResults[i][j].first == results[j].first);
+                        REQUIRE(allResults[i][j].second == Approx(results[j].second));
+                    }
+                }
+            }
+        }
+    }
+
+    GIVEN("binary descriptors")
+    {
+        Mat binary = (cv::Mat_<uchar>(1, 2) << 0x01, 0x80);
+        THEN("they are unpacked to one float per bit")
+        {
+            const auto unpacked = VladIndex::toFloatDescriptors(binary);
+            REQUIRE(unpacked.cols == 16);
+            REQUIRE(unpacked.at<float>(0, 0) == 1.0f);
+            REQUIRE(unpacked.at<float>(0, 1) == 0.0f);
+            REQUIRE(unpacked.at<float>(0, 15) == 1.0f);
+        }
+    }
+}
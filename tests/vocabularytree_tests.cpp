@@ -0,0 +1,159 @@
+#include <catch.hpp>
+#include "vocabularytree.h"
+#include <boost/filesystem.hpp>
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+using cv::Mat;
+using std::string;
+using std::vector;
+
+namespace
+{
+    // SIFT like descriptors of an image of a scene: noisy copies of the scene's landmarks
+    Mat makeImageDescriptors(const Mat& landmarks, cv::RNG& rng)
+    {
+        Mat noise(landmarks.size(), CV_32F);
+        rng.fill(noise, cv::RNG::NORMAL, 0, 0.02);
+        return cv::max(landmarks + noise, 0);
+    }
+
+    string imageName(int i)
+    {
+        return "image" + std::to_string(i);
+    }
+} //namespace
+
+SCENARIO("Ranking images of the same scene with a vocabulary tree")
+{
+    GIVEN("two images of each of three scenes")
+    {
+        cv::RNG rng(11);
+        vector<Mat> scenes;
+        for (auto i = 0; i < 3; ++i) {
+            Mat landmarks(300, 128, CV_32F);
+            rng.fill(landmarks, cv::RNG::UNIFORM, 0, 1);
+            scenes.push_back(landmarks);
+        }
+
+        Mat samples;
+        vector<Mat> images;
+        for (auto i = 0; i < 6; ++i) {
+            images.push_back(makeImageDescriptors(scenes[i % 3], rng));
+            samples.push_back(images.back());
+        }
+        VocabularyTree tree(4, 3);
+        tree.train(samples);
+        REQUIRE(tree.numWords() > 16);
+
+        WHEN("the first flight is saved and the second flight is added to the loaded index")
+        {
+            for (auto i = 0; i < 3; ++i) {
+                tree.add(imageName(i), images[i]);
+            }
+            const auto indexFile = (boost::filesystem::temp_directory_path() / "shomagick-test.tree").string();
+            REQUIRE(tree.save(indexFile));
+
+            VocabularyTree loaded;
+            REQUIRE(loaded.load(indexFile));
+            boost::filesystem::remove(indexFile);
+            for (auto i = 3; i < 6; ++i) {
+                loaded.add(imageName(i), images[i]);
+            }
+
+            THEN("every image ranks the other image of its scene first")
+            {
+                REQUIRE(loaded.size() == 6);
+                REQUIRE(loaded.numWords() == tree.numWords());
+                for (auto i = 0; i < 6; ++i) {
+                    const auto results = loaded.query(i, 2);
+                    REQUIRE(results.size() == 2);
+                    REQUIRE(results[0].first % 3 == i % 3);
+                    REQUIRE(results[0].second > results[1].second);
+                }
+            }
+
+            THEN("an image that is already indexed is not added twice")
+            {
+                REQUIRE(loaded.add(imageName(1), images[1]) == 1);
+                REQUIRE(loaded.size() == 6);
+            }
+
+            THEN("only the accepted images are ranked")
+            {
+                const auto results = loaded.query(images[2], 1, [](int image) { return image != 2; });
+                REQUIRE(results.size() == 1);
+                REQUIRE(results[0].first == 5);
+            }
+        }
+
+        WHEN("an image with descriptors of another length is added")
+        {
+            Mat other(50, 64, CV_32F);
+            rng.fill(other, cv::RNG::UNIFORM, 0, 1);
+
+            THEN("it is refused rather than indexed without words")
+            {
+                REQUIRE(tree.dimension() == 128);
+                REQUIRE_THROWS_AS(tree.add(imageName(0), other), cv::Exception);
+                REQUIRE(tree.size() == 0);
+            }
+        }
+    }
+
+    GIVEN("two flights whose images share file names")
+    {
+        cv::RNG rng(13);
+        Mat samples;
+        vector<Mat> images;
+        for (auto i = 0; i < 4; ++i) {
+            Mat landmarks(300, 128, CV_32F);
+            rng.fill(landmarks, cv::RNG::UNIFORM, 0, 1);
+            images.push_back(makeImageDescriptors(landmarks, rng));
+            samples.push_back(images.back());
+        }
+        VocabularyTree tree(4, 3);
+        tree.train(samples);
+
+        const vector<string> flights{ "/data/flight1", "/data/flight2" };
+        const vector<string> fileNames{ "DJI_0001.JPG", "DJI_0002.JPG" };
+        for (auto flight = 0; flight < 2; ++flight) {
+            for (auto i = 0; i < 2; ++i) {
+                tree.add(VocabularyTree::imageKey(flights[flight], fileNames[i]), images[2 * flight + i]);
+            }
+        }
+
+        THEN("every image of both flights is indexed under its own key")
+        {
+            REQUIRE(tree.size() == 4);
+            for (auto flight = 0; flight < 2; ++flight) {
+                for (auto i = 0; i < 2; ++i) {
+                    REQUIRE(tree.find(VocabularyTree::imageKey(flights[flight], fileNames[i])) == 2 * flight + i);
+                }
+            }
+            REQUIRE(tree.find(fileNames[0]) == -1);
+        }
+
+        THEN("a query restricted to the second flight only ranks its images")
+        {
+            const auto query = tree.find(VocabularyTree::imageKey(flights[1], fileNames[0]));
+            const auto results = tree.query(query, 3, [](int image) { return image >= 2; });
+            REQUIRE(results.size() == 1);
+            REQUIRE(tree.getImageName(results[0].first) == VocabularyTree::imageKey(flights[1], fileNames[1]));
+        }
+    }
+
+    GIVEN("binary descriptors")
+    {
+        Mat binary = (cv::Mat_<uchar>(1, 2) << 0x01, 0x80);
+        THEN("they are unpacked to one byte per bit")
+        {
+            const auto bytes = VocabularyTree::toByteDescriptors(binary);
+            REQUIRE(bytes.cols == 16);
+            REQUIRE(bytes.at<uchar>(0, 0) == 255);
+            REQUIRE(bytes.at<uchar>(0, 1) == 0);
+            REQUIRE(bytes.at<uchar>(0, 15) == 255);
+        }
+    }
+}